@@ -160,6 +160,10 @@
 #include "flashrom.h"
 #include "devices.h"
 
+#if defined(CPU_AARCH64) || defined(USE_ARMNEON)
+#include <arm_neon.h>
+#endif
+
 // 43 48 49 4E 4F 4E 20 20 4F 2D 36 35 38 2D 32 20 32 34
 #define FIRMWAREVERSION "CHINON  O-658-2 24"
 
@@ -263,60 +267,89 @@ static uae_u32 akiko_buffer[8];
 static int akiko_read_offset, akiko_write_offset;
 static uae_u32 akiko_result[8];
 
-/* Optimised Chunky-to-Planar algorithm by Mequa */
-static uae_u32 akiko_precalc_shift[32];
-static uae_u32 akiko_precalc_bytenum[32][8];
-static void akiko_precalculate (void)
+/* Chunky-to-Planar as a bit matrix transpose.
+ *
+ * Bit i + 8 * k of akiko_buffer[j] ends up in bit k + 4 * (7 - j) of
+ * akiko_result[i]. Pairs of buffer longs form four 8x8 bit matrices
+ * (akiko_buffer[7 - 2 * g] in the low half, akiko_buffer[6 - 2 * g] in the
+ * high half) whose transposes hold byte g of every plane. */
+#define C2P_MASK1 0x00AA00AA00AA00AAULL
+#define C2P_MASK2 0x0000CCCC0000CCCCULL
+#define C2P_MASK3 0x00000000F0F0F0F0ULL
+
+#if defined(CPU_AARCH64) || defined(USE_ARMNEON)
+
+#define C2P_TRANSPOSE_STEP(x, shift, mask) \
+	t = vandq_u64 (veorq_u64 (x, vshrq_n_u64 (x, shift)), mask); \
+	x = veorq_u64 (veorq_u64 (x, t), vshlq_n_u64 (t, shift));
+
+static void akiko_c2p_do (void)
 {
-	uae_u32 i, j;
-	for (i = 0; i < 32; i++) {
-		akiko_precalc_shift  [(int)i] = 1 << i;
-		for (j = 0; j < 8; j++) {
-			akiko_precalc_bytenum[(int)i][(int)j] = (i >> 3) + ((7 - j) << 2);
-		}
-	}
+	uint64x2_t m1 = vdupq_n_u64 (C2P_MASK1);
+	uint64x2_t m2 = vdupq_n_u64 (C2P_MASK2);
+	uint64x2_t m3 = vdupq_n_u64 (C2P_MASK3);
+	uint64x2_t x01, x23, t;
+	uint8x8x2_t z01, z23;
+	uint16x4x2_t lo, hi;
+
+	x01 = vcombine_u64 (vcreate_u64 (akiko_buffer[7] | ((uae_u64)akiko_buffer[6] << 32)),
+		vcreate_u64 (akiko_buffer[5] | ((uae_u64)akiko_buffer[4] << 32)));
+	x23 = vcombine_u64 (vcreate_u64 (akiko_buffer[3] | ((uae_u64)akiko_buffer[2] << 32)),
+		vcreate_u64 (akiko_buffer[1] | ((uae_u64)akiko_buffer[0] << 32)));
+	C2P_TRANSPOSE_STEP (x01, 7, m1);
+	C2P_TRANSPOSE_STEP (x23, 7, m1);
+	C2P_TRANSPOSE_STEP (x01, 14, m2);
+	C2P_TRANSPOSE_STEP (x23, 14, m2);
+	C2P_TRANSPOSE_STEP (x01, 28, m3);
+	C2P_TRANSPOSE_STEP (x23, 28, m3);
+
+	/* gather byte i of the four matrices into plane i */
+	z01 = vzip_u8 (vget_low_u8 (vreinterpretq_u8_u64 (x01)), vget_high_u8 (vreinterpretq_u8_u64 (x01)));
+	z23 = vzip_u8 (vget_low_u8 (vreinterpretq_u8_u64 (x23)), vget_high_u8 (vreinterpretq_u8_u64 (x23)));
+	lo = vzip_u16 (vreinterpret_u16_u8 (z01.val[0]), vreinterpret_u16_u8 (z23.val[0]));
+	hi = vzip_u16 (vreinterpret_u16_u8 (z01.val[1]), vreinterpret_u16_u8 (z23.val[1]));
+	vst1_u16 ((uint16_t*)&akiko_result[0], lo.val[0]);
+	vst1_u16 ((uint16_t*)&akiko_result[2], lo.val[1]);
+	vst1_u16 ((uint16_t*)&akiko_result[4], hi.val[0]);
+	vst1_u16 ((uint16_t*)&akiko_result[6], hi.val[1]);
+}
+
+#else
+
+STATIC_INLINE uae_u64 c2p_transpose8 (uae_u64 x)
+{
+	uae_u64 t;
+
+	t = (x ^ (x >> 7)) & C2P_MASK1;
+	x = x ^ t ^ (t << 7);
+	t = (x ^ (x >> 14)) & C2P_MASK2;
+	x = x ^ t ^ (t << 14);
+	t = (x ^ (x >> 28)) & C2P_MASK3;
+	x = x ^ t ^ (t << 28);
+	return x;
 }
 
 static void akiko_c2p_do (void)
 {
+	uae_u64 y0, y1, y2, y3;
 	int i;
 
+	y0 = c2p_transpose8 (akiko_buffer[7] | ((uae_u64)akiko_buffer[6] << 32));
+	y1 = c2p_transpose8 (akiko_buffer[5] | ((uae_u64)akiko_buffer[4] << 32));
+	y2 = c2p_transpose8 (akiko_buffer[3] | ((uae_u64)akiko_buffer[2] << 32));
+	y3 = c2p_transpose8 (akiko_buffer[1] | ((uae_u64)akiko_buffer[0] << 32));
 	for (i = 0; i < 8; i++) {
-		akiko_result[i]    =  (((akiko_buffer[0] & akiko_precalc_shift[i])    != 0) << (akiko_precalc_bytenum[i][0])   )
-				    	   |  (((akiko_buffer[1] & akiko_precalc_shift[i])    != 0) << (akiko_precalc_bytenum[i][1])   )
-				    	   |  (((akiko_buffer[2] & akiko_precalc_shift[i])    != 0) << (akiko_precalc_bytenum[i][2])   )
-				    	   |  (((akiko_buffer[3] & akiko_precalc_shift[i])    != 0) << (akiko_precalc_bytenum[i][3])   )
-				    	   |  (((akiko_buffer[4] & akiko_precalc_shift[i])    != 0) << (akiko_precalc_bytenum[i][4])   )
-				    	   |  (((akiko_buffer[5] & akiko_precalc_shift[i])    != 0) << (akiko_precalc_bytenum[i][5])   )
-				    	   |  (((akiko_buffer[6] & akiko_precalc_shift[i])    != 0) << (akiko_precalc_bytenum[i][6])   )
-				    	   |  (((akiko_buffer[7] & akiko_precalc_shift[i])    != 0) << (akiko_precalc_bytenum[i][7])   )
-						   |  (((akiko_buffer[0] & akiko_precalc_shift[i+8])  != 0) << (akiko_precalc_bytenum[i+8][0]) )
-				    	   |  (((akiko_buffer[1] & akiko_precalc_shift[i+8])  != 0) << (akiko_precalc_bytenum[i+8][1]) )
-				    	   |  (((akiko_buffer[2] & akiko_precalc_shift[i+8])  != 0) << (akiko_precalc_bytenum[i+8][2]) )
-				    	   |  (((akiko_buffer[3] & akiko_precalc_shift[i+8])  != 0) << (akiko_precalc_bytenum[i+8][3]) )
-				    	   |  (((akiko_buffer[4] & akiko_precalc_shift[i+8])  != 0) << (akiko_precalc_bytenum[i+8][4]) )
-				    	   |  (((akiko_buffer[5] & akiko_precalc_shift[i+8])  != 0) << (akiko_precalc_bytenum[i+8][5]) )
-				    	   |  (((akiko_buffer[6] & akiko_precalc_shift[i+8])  != 0) << (akiko_precalc_bytenum[i+8][6]) )
-				    	   |  (((akiko_buffer[7] & akiko_precalc_shift[i+8])  != 0) << (akiko_precalc_bytenum[i+8][7]) )
-						   |  (((akiko_buffer[0] & akiko_precalc_shift[i+16]) != 0) << (akiko_precalc_bytenum[i+16][0]))
-				    	   |  (((akiko_buffer[1] & akiko_precalc_shift[i+16]) != 0) << (akiko_precalc_bytenum[i+16][1]))
-				    	   |  (((akiko_buffer[2] & akiko_precalc_shift[i+16]) != 0) << (akiko_precalc_bytenum[i+16][2]))
-				    	   |  (((akiko_buffer[3] & akiko_precalc_shift[i+16]) != 0) << (akiko_precalc_bytenum[i+16][3]))
-				    	   |  (((akiko_buffer[4] & akiko_precalc_shift[i+16]) != 0) << (akiko_precalc_bytenum[i+16][4]))
-				    	   |  (((akiko_buffer[5] & akiko_precalc_shift[i+16]) != 0) << (akiko_precalc_bytenum[i+16][5]))
-				    	   |  (((akiko_buffer[6] & akiko_precalc_shift[i+16]) != 0) << (akiko_precalc_bytenum[i+16][6]))
-				    	   |  (((akiko_buffer[7] & akiko_precalc_shift[i+16]) != 0) << (akiko_precalc_bytenum[i+16][7]))
-						   |  (((akiko_buffer[0] & akiko_precalc_shift[i+24]) != 0) << (akiko_precalc_bytenum[i+24][0]))
-				    	   |  (((akiko_buffer[1] & akiko_precalc_shift[i+24]) != 0) << (akiko_precalc_bytenum[i+24][1]))
-				    	   |  (((akiko_buffer[2] & akiko_precalc_shift[i+24]) != 0) << (akiko_precalc_bytenum[i+24][2]))
-				    	   |  (((akiko_buffer[3] & akiko_precalc_shift[i+24]) != 0) << (akiko_precalc_bytenum[i+24][3]))
-				    	   |  (((akiko_buffer[4] & akiko_precalc_shift[i+24]) != 0) << (akiko_precalc_bytenum[i+24][4]))
-				    	   |  (((akiko_buffer[5] & akiko_precalc_shift[i+24]) != 0) << (akiko_precalc_bytenum[i+24][5]))
-				    	   |  (((akiko_buffer[6] & akiko_precalc_shift[i+24]) != 0) << (akiko_precalc_bytenum[i+24][6]))
-				    	   |  (((akiko_buffer[7] & akiko_precalc_shift[i+24]) != 0) << (akiko_precalc_bytenum[i+24][7]));
+		akiko_result[i] = (uae_u32)(y0 & 0xff) | ((uae_u32)(y1 & 0xff) << 8)
+			| ((uae_u32)(y2 & 0xff) << 16) | ((uae_u32)(y3 & 0xff) << 24);
+		y0 >>= 8;
+		y1 >>= 8;
+		y2 >>= 8;
+		y3 >>= 8;
 	}
 }
 
+#endif
+
 static void akiko_c2p_write (int offset, uae_u32 v)
 {
 	if (offset == 3)
@@ -1910,7 +1943,6 @@ int akiko_init (void)
 		return 0;
 	device_add_reset_imm(akiko_reset);
 	akiko_free ();
-	akiko_precalculate ();
 	unitnum = -1;
 	sys_cddev_open ();
 	sector_buffer_1 = xmalloc (uae_u8, SECTOR_BUFFER_SIZE * 2352);
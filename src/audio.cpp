@@ -48,6 +48,10 @@ STATIC_INLINE bool usehacks (void)
 
 #include "sinctable.cpp"
 
+#if defined(CPU_AARCH64) || defined(USE_ARMNEON)
+#include <arm_neon.h>
+#endif
+
 typedef struct {
 	int time, output;
 } sinc_queue_t;
@@ -323,6 +327,56 @@ static void sinc_prehandler_paula (uae_u32 best_evtime)
   }
 }
 
+#if defined(CPU_AARCH64) || defined(USE_ARMNEON)
+
+/* BLEP mixing for the four Paula channels in parallel NEON lanes. Each lane
+ * walks the queue of its channel and drops out at the first entry that is
+ * out of age range, so the sums are identical to the scalar queue walk. */
+static void sinc_blep_neon (int const *winsinc, int *sums)
+{
+  int32_t init[4], qt[4], pos[4];
+
+  for (int i = 0; i < 4; i++) {
+		struct audio_channel_data2 *acd = audio_data[i];
+    init[i] = acd->sinc_output_state << 17;
+    qt[i] = acd->sinc_queue_time;
+    pos[i] = acd->sinc_queue_head;
+  }
+
+  int32x4_t sum = vld1q_s32(init);
+  int32x4_t qtime = vld1q_s32(qt);
+  int32x4_t maxage = vdupq_n_s32(SINC_QUEUE_MAX_AGE);
+  int32x4_t zero = vdupq_n_s32(0);
+  uint32x4_t active = vdupq_n_u32(~0U);
+
+  for (int j = 0; j < SINC_QUEUE_LENGTH; j++) {
+    int32_t t[4], o[4], a[4], w[4];
+    for (int i = 0; i < 4; i++) {
+      sinc_queue_t *q = &audio_data[i]->sinc_queue[(pos[i] + j) & (SINC_QUEUE_LENGTH - 1)];
+      t[i] = q->time;
+      o[i] = q->output;
+    }
+    int32x4_t age = vsubq_s32(qtime, vld1q_s32(t));
+    active = vandq_u32(active, vandq_u32(vcltq_s32(age, maxage), vcgeq_s32(age, zero)));
+    uint32x2_t any = vorr_u32(vget_low_u32(active), vget_high_u32(active));
+    if ((vget_lane_u32(any, 0) | vget_lane_u32(any, 1)) == 0)
+      break;
+
+    /* inactive lanes fetch winsinc[0] and mask the product away */
+    vst1q_s32(a, vbslq_s32(active, age, zero));
+    w[0] = winsinc[a[0]];
+    w[1] = winsinc[a[1]];
+    w[2] = winsinc[a[2]];
+    w[3] = winsinc[a[3]];
+    int32x4_t prod = vmulq_s32(vld1q_s32(w), vld1q_s32(o));
+    sum = vsubq_s32(sum, vandq_s32(prod, vreinterpretq_s32_u32(active)));
+  }
+
+  vst1q_s32(sums, sum);
+}
+
+#endif
+
 /* this interpolator performs BLEP mixing (bleps are shaped like integrated sinc
  * functions) with a type of BLEP that matches the filtering configuration. */
 static void samplexx_sinc_handler (int *datasp)
@@ -339,6 +393,18 @@ static void samplexx_sinc_handler (int *datasp)
   }
   winsinc = winsinc_integral[n];
 
+#if defined(CPU_AARCH64) || defined(USE_ARMNEON)
+  int sums[AUDIO_CHANNELS_PAULA];
+  sinc_blep_neon (winsinc, sums);
+  for (i = 0; i < AUDIO_CHANNELS_PAULA; i++) {
+    int v = sums[i] >> 15;
+  	if (v > 32767)
+	    v = 32767;
+	  else if (v < -32768)
+	    v = -32768;
+	  datasp[i] = v;
+  }
+#else
   for (i = 0; i < AUDIO_CHANNELS_PAULA; i++) {
     int j, v;
 		struct audio_channel_data2 *acd = audio_data[i];
@@ -360,6 +426,7 @@ static void samplexx_sinc_handler (int *datasp)
 	    v = -32768;
 	  datasp[i] = v;
   }
+#endif
 }
 
 static void sample16i_sinc_handler (void)
@@ -1072,7 +1139,8 @@ static int sound_prefs_changed (void)
 		return 0;
   if (changed_prefs.produce_sound != currprefs.produce_sound
     || changed_prefs.sound_stereo != currprefs.sound_stereo
-    || changed_prefs.sound_freq != currprefs.sound_freq)
+    || changed_prefs.sound_freq != currprefs.sound_freq
+    || changed_prefs.sound_maxbsiz != currprefs.sound_maxbsiz)
     return 1;
 
   if (changed_prefs.sound_stereo_separation != currprefs.sound_stereo_separation
@@ -1120,6 +1188,7 @@ static void set_audio(void)
 	currprefs.produce_sound = changed_prefs.produce_sound;
 	currprefs.sound_stereo = changed_prefs.sound_stereo;
 	currprefs.sound_freq = changed_prefs.sound_freq;
+	currprefs.sound_maxbsiz = changed_prefs.sound_maxbsiz;
 
   currprefs.sound_stereo_separation = changed_prefs.sound_stereo_separation;
   currprefs.sound_mixed_stereo_delay = changed_prefs.sound_mixed_stereo_delay;
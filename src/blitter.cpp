@@ -17,6 +17,10 @@
 #include "blitter.h"
 #include "blit.h"
 
+#if defined(CPU_AARCH64) || defined(USE_ARMNEON)
+#include <arm_neon.h>
+#endif
+
 /* we must not change ce-mode while blitter is running.. */
 static int blitter_cycle_exact, immediate_blits;
 static int blt_statefile_type;
@@ -272,6 +276,241 @@ STATIC_INLINE void chipmem_agnus_wput2 (uaecptr addr, uae_u32 w)
 	chipmem_wput_indirect (addr, w);
 }
 
+/* Row blitter for minterms without a generated fast path and for fill
+ * mode. All A, B and C words of a row are fetched first, then the row is
+ * shifted, combined and filled at once and finally written to D. */
+
+static uae_u16 blit_rowa[BLITTER_MAX_WORDS + 1], blit_rowb[BLITTER_MAX_WORDS + 1];
+static uae_u16 blit_rowc[BLITTER_MAX_WORDS], blit_rowd[BLITTER_MAX_WORDS];
+static uae_u16 blit_rowp[BLITTER_MAX_WORDS];
+
+/* w[0] is the previous word, w[1..n] the fetched words. Result goes to w[0..n-1]. */
+static void blit_row_shift(uae_u16 *w, int n, int shift, int desc)
+{
+	int i = 0;
+
+	if (shift == (desc ? 16 : 0)) {
+		memmove(w, w + 1, n * sizeof(uae_u16));
+		return;
+	}
+#if defined(CPU_AARCH64) || defined(USE_ARMNEON)
+	int16x8_t curshift = vdupq_n_s16(desc ? 16 - shift : -shift);
+	int16x8_t prevshift = vdupq_n_s16(desc ? -shift : 16 - shift);
+	for (; i + 8 <= n; i += 8) {
+		uint16x8_t prev = vld1q_u16(w + i);
+		uint16x8_t cur = vld1q_u16(w + i + 1);
+		vst1q_u16(w + i, vorrq_u16(vshlq_u16(cur, curshift), vshlq_u16(prev, prevshift)));
+	}
+#endif
+	for (; i < n; i++) {
+		if (desc)
+			w[i] = (((uae_u32)w[i + 1] << 16) | w[i]) >> shift;
+		else
+			w[i] = (((uae_u32)w[i] << 16) | w[i + 1]) >> shift;
+	}
+}
+
+/* Any minterm as a select tree: A chooses the nibble, B the pair and C the bit */
+static void blit_row_minterm(uae_u16 *d, const uae_u16 *a, const uae_u16 *b, const uae_u16 *c, int n, uae_u8 mt)
+{
+	uae_u16 k[8];
+	int i = 0;
+
+	for (int t = 0; t < 8; t++)
+		k[t] = (mt & (1 << t)) ? 0xffff : 0;
+#if defined(CPU_AARCH64) || defined(USE_ARMNEON)
+	uint16x8_t k0 = vdupq_n_u16(k[0]), k1 = vdupq_n_u16(k[1]), k2 = vdupq_n_u16(k[2]), k3 = vdupq_n_u16(k[3]);
+	uint16x8_t k4 = vdupq_n_u16(k[4]), k5 = vdupq_n_u16(k[5]), k6 = vdupq_n_u16(k[6]), k7 = vdupq_n_u16(k[7]);
+	for (; i + 8 <= n; i += 8) {
+		uint16x8_t va = vld1q_u16(a + i);
+		uint16x8_t vb = vld1q_u16(b + i);
+		uint16x8_t vc = vld1q_u16(c + i);
+		uint16x8_t hi = vbslq_u16(vb, vbslq_u16(vc, k7, k6), vbslq_u16(vc, k5, k4));
+		uint16x8_t lo = vbslq_u16(vb, vbslq_u16(vc, k3, k2), vbslq_u16(vc, k1, k0));
+		vst1q_u16(d + i, vbslq_u16(va, hi, lo));
+	}
+#endif
+	for (; i < n; i++) {
+		uae_u16 va = a[i], vb = b[i], vc = c[i];
+		uae_u16 c76 = (vc & k[7]) | (~vc & k[6]);
+		uae_u16 c54 = (vc & k[5]) | (~vc & k[4]);
+		uae_u16 c32 = (vc & k[3]) | (~vc & k[2]);
+		uae_u16 c10 = (vc & k[1]) | (~vc & k[0]);
+		uae_u16 hi = (vb & c76) | (~vb & c54);
+		uae_u16 lo = (vb & c32) | (~vb & c10);
+		d[i] = (va & hi) | (~va & lo);
+	}
+}
+
+/* Fill from bit 0 upwards. Within a word the fill carry is the prefix
+ * parity of the data bits, only the carry between words is serial. */
+static int blit_row_fill(uae_u16 *d, int n, int fc, int ife)
+{
+	uae_u16 *p = blit_rowp;
+	int i = 0;
+
+#if defined(CPU_AARCH64) || defined(USE_ARMNEON)
+	for (; i + 8 <= n; i += 8) {
+		uint16x8_t v = vld1q_u16(d + i);
+		v = veorq_u16(v, vshlq_n_u16(v, 1));
+		v = veorq_u16(v, vshlq_n_u16(v, 2));
+		v = veorq_u16(v, vshlq_n_u16(v, 4));
+		v = veorq_u16(v, vshlq_n_u16(v, 8));
+		vst1q_u16(p + i, v);
+	}
+#endif
+	for (; i < n; i++) {
+		uae_u16 v = d[i];
+		v ^= v << 1;
+		v ^= v << 2;
+		v ^= v << 4;
+		v ^= v << 8;
+		p[i] = v;
+	}
+	for (i = 0; i < n; i++) {
+		uae_u16 fcmask = fc ? 0xffff : 0;
+		if (ife)
+			d[i] |= (uae_u16)(p[i] << 1) ^ fcmask;
+		else
+			d[i] = p[i] ^ fcmask;
+		fc ^= p[i] >> 15;
+	}
+	return fc;
+}
+
+static void blit_row_range(uae_s64 start, int mod, int desc, uae_s64 *lo, uae_s64 *hi)
+{
+	int bytes = blt_info.hblitsize * 2;
+	uae_s64 last = start + (uae_s64)(bytes + mod) * (blt_info.vblitsize - 1) * (desc ? -1 : 1);
+	uae_s64 first = start;
+
+	if (last < first) {
+		uae_s64 t = first;
+		first = last;
+		last = t;
+	}
+	if (desc) {
+		*lo = first - bytes + 2;
+		*hi = last + 2;
+	} else {
+		*lo = first;
+		*hi = last + bytes;
+	}
+}
+
+/* D is written one word after the next source fetch. Fetching a whole row
+ * first only gives the same result if D never writes a source word that
+ * is fetched later. That holds if they don't overlap at all, or if they
+ * use the same non-negative modulo and D does not run ahead of the
+ * source. */
+static bool blit_row_source_ok(uae_u8 *src, int smod, uaecptr dst, int dmod, int desc)
+{
+	uae_s64 slo, shi, dlo, dhi;
+	uae_s64 s, d;
+
+	if (!src)
+		return true;
+	s = src - chipmem_bank.baseaddr;
+	d = dst & chipmem_full_mask;
+	blit_row_range(s, smod, desc, &slo, &shi);
+	blit_row_range(d, dmod, desc, &dlo, &dhi);
+	if (dhi <= slo || shi <= dlo)
+		return true;
+	if (smod != dmod || dmod < 0)
+		return false;
+	return desc ? d >= s : d <= s;
+}
+
+static bool blit_row_ok(uae_u8 *pta, uae_u8 *ptb, uae_u8 *ptc, uaecptr ptd, int desc)
+{
+	if (!ptd)
+		return true;
+	return blit_row_source_ok(pta, blt_info.bltamod, ptd, blt_info.bltdmod, desc) &&
+		blit_row_source_ok(ptb, blt_info.bltbmod, ptd, blt_info.bltdmod, desc) &&
+		blit_row_source_ok(ptc, blt_info.bltcmod, ptd, blt_info.bltdmod, desc);
+}
+
+static void blitter_dorows(uae_u8 *pta, uae_u8 *ptb, uae_u8 *ptc, uaecptr ptd, int desc)
+{
+	int i, j;
+	int n = blt_info.hblitsize;
+	int step = desc ? -2 : 2;
+	int amod = desc ? -blt_info.bltamod : blt_info.bltamod;
+	int bmod = desc ? -blt_info.bltbmod : blt_info.bltbmod;
+	int cmod = desc ? -blt_info.bltcmod : blt_info.bltcmod;
+	int dmod = desc ? -blt_info.bltdmod : blt_info.bltdmod;
+	int ashift = desc ? blt_info.blitdownashift : blt_info.blitashift;
+	int bshift = desc ? blt_info.blitdownbshift : blt_info.blitbshift;
+	uae_u8 mt = bltcon0 & 0xFF;
+	uae_u16 totald = 0;
+
+	if (!ptb) {
+		for (i = 0; i < n; i++)
+			blit_rowb[i] = blt_info.bltbhold;
+	}
+	if (!ptc) {
+		for (i = 0; i < n; i++)
+			blit_rowc[i] = blt_info.bltcdat;
+	}
+	for (j = 0; j < blt_info.vblitsize; j++) {
+		blit_rowa[0] = blt_info.bltaold;
+		for (i = 0; i < n; i++) {
+			uae_u16 bltadat;
+			if (pta) {
+				bltadat = blt_info.bltadat = do_get_mem_word ((uae_u16 *)pta);
+				pta += step;
+			} else
+				bltadat = blt_info.bltadat;
+			blit_rowa[i + 1] = bltadat & blit_masktable[i];
+		}
+		blt_info.bltaold = blit_rowa[n];
+		blit_row_shift(blit_rowa, n, ashift, desc);
+
+		if (ptb) {
+			blit_rowb[0] = blt_info.bltbold;
+			for (i = 0; i < n; i++) {
+				blit_rowb[i + 1] = do_get_mem_word ((uae_u16 *)ptb);
+				ptb += step;
+			}
+			blt_info.bltbold = blt_info.bltbdat = blit_rowb[n];
+			blit_row_shift(blit_rowb, n, bshift, desc);
+			blt_info.bltbhold = blit_rowb[n - 1];
+			ptb += bmod;
+		}
+
+		if (ptc) {
+			for (i = 0; i < n; i++) {
+				blit_rowc[i] = do_get_mem_word ((uae_u16 *)ptc);
+				ptc += step;
+			}
+			blt_info.bltcdat = blit_rowc[n - 1];
+			if (desc)
+				blt_info.bltbdat = blt_info.bltcdat;
+			ptc += cmod;
+		}
+
+		blit_row_minterm(blit_rowd, blit_rowa, blit_rowb, blit_rowc, n, mt);
+		blitfc = !!(bltcon1 & 0x4);
+		if (blitfill)
+			blitfc = blit_row_fill(blit_rowd, n, blitfc, blitife);
+
+		for (i = 0; i < n; i++)
+			totald |= blit_rowd[i];
+		if (ptd) {
+			for (i = 0; i < n; i++) {
+				chipmem_agnus_wput2 (ptd, blit_rowd[i]);
+				ptd += step;
+			}
+			ptd += dmod;
+		}
+		if (pta)
+			pta += amod;
+	}
+	blt_info.bltddat = blit_rowd[n - 1];
+	if (totald)
+		blt_info.blitzero = 0;
+}
+
 static void blitter_dofast(void)
 {
   int i,j;
@@ -301,6 +540,8 @@ static void blitter_dofast(void)
 
   if (blitfunc_dofast[mt] && !blitfill) {
   	(*blitfunc_dofast[mt])(bltadatptr, bltbdatptr, bltcdatptr, bltddatptr, &blt_info);
+	} else if (blit_row_ok(bltadatptr, bltbdatptr, bltcdatptr, bltddatptr, 0)) {
+		blitter_dorows(bltadatptr, bltbdatptr, bltcdatptr, bltddatptr, 0);
 	} else {
 	  uae_u32 blitbhold = blt_info.bltbhold;
 	  uaecptr dstp = 0;
@@ -394,6 +635,8 @@ static void blitter_dofast_desc(void)
   }
   if (blitfunc_dofast_desc[mt] && !blitfill) {
 		(*blitfunc_dofast_desc[mt])(bltadatptr, bltbdatptr, bltcdatptr, bltddatptr, &blt_info);
+	} else if (blit_row_ok(bltadatptr, bltbdatptr, bltcdatptr, bltddatptr, 1)) {
+		blitter_dorows(bltadatptr, bltbdatptr, bltcdatptr, bltddatptr, 1);
 	} else {
 	  uae_u32 blitbhold = blt_info.bltbhold;
 	  uaecptr dstp = 0;
@@ -15,6 +15,8 @@
 #include "custom.h"
 #include "cd32_fmv.h"
 #include "devices.h"
+#include "uae.h"
+#include "threaddep/thread.h"
 
 #include "cda_play.h"
 #include "archivers/mp2/kjmp2.h"
@@ -257,6 +259,31 @@ static uae_u16 mpeg_io_reg;
 static mpeg2dec_t *mpeg_decoder;
 static const mpeg2_info_t *mpeg_info;
 
+/* libmpeg2 also runs on a worker thread. On the emulation thread the
+ * decoder above only parses, with slice decoding skipped, so the bitstream
+ * is consumed and pictures are counted at the same hsyncs as before. Every
+ * chunk it takes is copied to the worker, which decodes the same stream
+ * into the same video buffers in the same order. A picture has to be there
+ * when it is due for display, only then the emulation waits for it. The
+ * worker can be ahead by the CL450 video buffers at most. */
+struct fmv_decode_chunk
+{
+	struct fmv_decode_chunk *next;
+	uae_u8 *data;
+	int len;
+	int pixbytes;
+};
+
+static uae_thread_id fmv_decode_tid;
+static uae_sem_t fmv_decode_lock, fmv_decode_work, fmv_decode_slot, fmv_decode_done;
+static volatile bool fmv_decode_running, fmv_decode_quit, fmv_decode_abort, fmv_decode_busy;
+static mpeg2dec_t *fmv_decode_mpeg;
+static const mpeg2_info_t *fmv_decode_info;
+static struct fmv_decode_chunk *fmv_decode_chunk_first, *fmv_decode_chunk_last, *fmv_decode_chunk_active;
+/* pictures decoded and shown since the last flush */
+static int fmv_decode_pictures, fmv_decode_shown;
+static int fmv_decode_width, fmv_decode_height, fmv_decode_pixbytes;
+
 static void do_irq(void)
 {
 	safe_interrupt_set(false);
@@ -740,6 +767,224 @@ static void cl450_write_dram(int addr, uae_u16 w)
 	fmv_ram_bank.baseaddr[addr * 2 + 1] = w;
 }
 
+static void fmv_decode_chunk_free(struct fmv_decode_chunk *c)
+{
+	if (!c)
+		return;
+	xfree(c->data);
+	xfree(c);
+}
+
+/* Decode until the queued chunks are used up */
+static void fmv_decode_run(void)
+{
+	for (;;) {
+		if (fmv_decode_abort)
+			return;
+		mpeg2_state_t mpeg_state = mpeg2_parse(fmv_decode_mpeg);
+		switch (mpeg_state)
+		{
+			case STATE_BUFFER:
+			{
+				struct fmv_decode_chunk *c;
+				// libmpeg2 is done with the previous chunk
+				fmv_decode_chunk_free(fmv_decode_chunk_active);
+				uae_sem_wait(&fmv_decode_lock);
+				c = fmv_decode_abort ? NULL : fmv_decode_chunk_first;
+				if (c) {
+					fmv_decode_chunk_first = c->next;
+					if (!fmv_decode_chunk_first)
+						fmv_decode_chunk_last = NULL;
+				}
+				fmv_decode_chunk_active = c;
+				uae_sem_post(&fmv_decode_lock);
+				if (!c)
+					return;
+				fmv_decode_pixbytes = c->pixbytes;
+				mpeg2_buffer(fmv_decode_mpeg, c->data, c->data + c->len);
+			}
+			break;
+			case STATE_SEQUENCE:
+				mpeg2_convert(fmv_decode_mpeg, fmv_decode_pixbytes == 2 ? mpeg2convert_rgb16 : mpeg2convert_rgb32, NULL);
+				fmv_decode_width = fmv_decode_info->sequence->width;
+				fmv_decode_height = fmv_decode_info->sequence->height;
+				break;
+			case STATE_SLICE:
+			case STATE_END:
+				if (fmv_decode_info->display_fbuf) {
+					int slot;
+					// the buffer must have been shown
+					uae_sem_wait(&fmv_decode_lock);
+					while (fmv_decode_pictures - fmv_decode_shown >= CL450_VIDEO_BUFFERS && !fmv_decode_abort) {
+						uae_sem_post(&fmv_decode_lock);
+						uae_sem_wait(&fmv_decode_slot);
+						uae_sem_wait(&fmv_decode_lock);
+					}
+					slot = fmv_decode_pictures & (CL450_VIDEO_BUFFERS - 1);
+					uae_sem_post(&fmv_decode_lock);
+					if (fmv_decode_abort)
+						return;
+					memcpy(videoram[slot].data, fmv_decode_info->display_fbuf->buf[0], fmv_decode_width * fmv_decode_height * fmv_decode_pixbytes);
+					videoram[slot].width = fmv_decode_width;
+					videoram[slot].height = fmv_decode_height;
+					videoram[slot].depth = fmv_decode_pixbytes;
+					uae_sem_wait(&fmv_decode_lock);
+					fmv_decode_pictures++;
+					uae_sem_post(&fmv_decode_lock);
+					uae_sem_post(&fmv_decode_done);
+				}
+				break;
+			default:
+				break;
+		}
+	}
+}
+
+static int fmv_decode_thread(void *v)
+{
+	for (;;) {
+		uae_sem_wait(&fmv_decode_work);
+		if (fmv_decode_quit)
+			break;
+		uae_sem_wait(&fmv_decode_lock);
+		if (fmv_decode_abort) {
+			uae_sem_post(&fmv_decode_lock);
+			continue;
+		}
+		fmv_decode_busy = true;
+		uae_sem_post(&fmv_decode_lock);
+		fmv_decode_run();
+		uae_sem_wait(&fmv_decode_lock);
+		fmv_decode_busy = false;
+		uae_sem_post(&fmv_decode_lock);
+	}
+	return 0;
+}
+
+static void fmv_decode_start(void)
+{
+	if (fmv_decode_running || !mpeg_decoder)
+		return;
+	fmv_decode_mpeg = mpeg2_init();
+	if (!fmv_decode_mpeg)
+		return;
+	fmv_decode_info = mpeg2_info(fmv_decode_mpeg);
+	uae_sem_init(&fmv_decode_lock, 0, 1);
+	uae_sem_init(&fmv_decode_work, 0, 0);
+	uae_sem_init(&fmv_decode_slot, 0, 0);
+	uae_sem_init(&fmv_decode_done, 0, 0);
+	fmv_decode_quit = false;
+	fmv_decode_abort = false;
+	fmv_decode_pictures = fmv_decode_shown = 0;
+	fmv_decode_running = uae_start_thread(_T("cd32fmv"), fmv_decode_thread, NULL, &fmv_decode_tid) != 0;
+	if (!fmv_decode_running) {
+		uae_sem_destroy(&fmv_decode_lock);
+		uae_sem_destroy(&fmv_decode_work);
+		uae_sem_destroy(&fmv_decode_slot);
+		uae_sem_destroy(&fmv_decode_done);
+		mpeg2_close(fmv_decode_mpeg);
+		fmv_decode_mpeg = NULL;
+		return;
+	}
+	// the worker decodes, here the stream is only parsed
+	mpeg2_skip(mpeg_decoder, 1);
+}
+
+/* Stop decoding, drop everything queued or decoded ahead and reset both
+ * decoders. The worker only starts a run while abort is clear, so once it
+ * is seen idle with abort set it cannot touch its decoder until the reset
+ * is done. */
+static void fmv_decode_flush(void)
+{
+	if (mpeg_decoder)
+		mpeg2_reset(mpeg_decoder, 1);
+	if (!fmv_decode_running)
+		return;
+	mpeg2_skip(mpeg_decoder, 1);
+	uae_sem_wait(&fmv_decode_lock);
+	fmv_decode_abort = true;
+	while (fmv_decode_busy) {
+		uae_sem_post(&fmv_decode_lock);
+		uae_sem_post(&fmv_decode_slot);
+		sleep_millis(1);
+		uae_sem_wait(&fmv_decode_lock);
+	}
+	mpeg2_reset(fmv_decode_mpeg, 1);
+	while (uae_sem_trywait(&fmv_decode_done) == 0);
+	while (uae_sem_trywait(&fmv_decode_slot) == 0);
+	while (fmv_decode_chunk_first) {
+		struct fmv_decode_chunk *c = fmv_decode_chunk_first;
+		fmv_decode_chunk_first = c->next;
+		fmv_decode_chunk_free(c);
+	}
+	fmv_decode_chunk_last = NULL;
+	fmv_decode_chunk_free(fmv_decode_chunk_active);
+	fmv_decode_chunk_active = NULL;
+	fmv_decode_pictures = fmv_decode_shown = 0;
+	fmv_decode_abort = false;
+	uae_sem_post(&fmv_decode_lock);
+}
+
+static void fmv_decode_stop(void)
+{
+	if (!fmv_decode_running)
+		return;
+	fmv_decode_flush();
+	fmv_decode_quit = true;
+	uae_sem_post(&fmv_decode_work);
+	uae_wait_thread(fmv_decode_tid);
+	fmv_decode_running = false;
+	uae_sem_destroy(&fmv_decode_lock);
+	uae_sem_destroy(&fmv_decode_work);
+	uae_sem_destroy(&fmv_decode_slot);
+	uae_sem_destroy(&fmv_decode_done);
+	mpeg2_close(fmv_decode_mpeg);
+	fmv_decode_mpeg = NULL;
+}
+
+/* Copy of a chunk the parser took, for the worker */
+static void fmv_decode_queue(const uae_u8 *data, int len)
+{
+	struct fmv_decode_chunk *c = xcalloc(struct fmv_decode_chunk, 1);
+	c->data = xmalloc(uae_u8, len);
+	memcpy(c->data, data, len);
+	c->len = len;
+	c->pixbytes = currprefs.color_mode != 5 ? 2 : 4;
+	uae_sem_wait(&fmv_decode_lock);
+	if (fmv_decode_chunk_last)
+		fmv_decode_chunk_last->next = c;
+	else
+		fmv_decode_chunk_first = c;
+	fmv_decode_chunk_last = c;
+	uae_sem_post(&fmv_decode_lock);
+	uae_sem_post(&fmv_decode_work);
+}
+
+/* The picture in the next video buffer is due: wait for the worker if it
+ * is not done with it yet */
+static void fmv_decode_wait_picture(void)
+{
+	uae_sem_wait(&fmv_decode_lock);
+	while (fmv_decode_pictures <= fmv_decode_shown) {
+		uae_sem_post(&fmv_decode_lock);
+		if (uae_sem_trywait_delay(&fmv_decode_done, 1000) != 0) {
+			write_log(_T("CL450 picture %d not decoded in time\n"), fmv_decode_shown);
+			uae_sem_wait(&fmv_decode_lock);
+			break;
+		}
+		uae_sem_wait(&fmv_decode_lock);
+	}
+	uae_sem_post(&fmv_decode_lock);
+}
+
+static void fmv_decode_picture_shown(void)
+{
+	uae_sem_wait(&fmv_decode_lock);
+	fmv_decode_shown++;
+	uae_sem_post(&fmv_decode_lock);
+	uae_sem_post(&fmv_decode_slot);
+}
+
 static void cl450_parse_frame(void)
 {
 	for (;;) {
@@ -771,6 +1016,8 @@ static void cl450_parse_frame(void)
 				}
 				memcpy(&fmv_ram_bank.baseaddr[CL450_MPEG_DECODE_BUFFER] + libmpeg_offset, &fmv_ram_bank.baseaddr[CL450_MPEG_BUFFER], cl450_buffer_offset);
 				mpeg2_buffer(mpeg_decoder, &fmv_ram_bank.baseaddr[CL450_MPEG_DECODE_BUFFER] + libmpeg_offset, &fmv_ram_bank.baseaddr[CL450_MPEG_DECODE_BUFFER] + libmpeg_offset + cl450_buffer_offset);
+				if (fmv_decode_running)
+					fmv_decode_queue(&fmv_ram_bank.baseaddr[CL450_MPEG_DECODE_BUFFER] + libmpeg_offset, cl450_buffer_offset);
 				libmpeg_offset += cl450_buffer_offset;
 				if (libmpeg_offset >= CL450_MPEG_DECODE_BUFFER_SIZE - CL450_MPEG_BUFFER_SIZE)
 					libmpeg_offset = 0;
@@ -779,7 +1026,8 @@ static void cl450_parse_frame(void)
 			break;
 			case STATE_SEQUENCE:
 				cl450_frame_pixbytes = currprefs.color_mode != 5 ? 2 : 4;
-				mpeg2_convert(mpeg_decoder, cl450_frame_pixbytes == 2 ? mpeg2convert_rgb16 : mpeg2convert_rgb32, NULL);
+				if (!fmv_decode_running)
+					mpeg2_convert(mpeg_decoder, cl450_frame_pixbytes == 2 ? mpeg2convert_rgb16 : mpeg2convert_rgb32, NULL);
 				cl450_set_status(CL_INT_SEQ_V);
 				cl450_frame_rate = mpeg_info->sequence->frame_period ? 27000000 / mpeg_info->sequence->frame_period : 0;
 				cl450_frame_width = mpeg_info->sequence->width;
@@ -797,10 +1045,13 @@ static void cl450_parse_frame(void)
 			case STATE_SLICE:
 			case STATE_END:
 				if (mpeg_info->display_fbuf) {
-					memcpy(videoram[cl450_videoram_write].data, mpeg_info->display_fbuf->buf[0], cl450_frame_width * cl450_frame_height * cl450_frame_pixbytes);
-					videoram[cl450_videoram_write].width = cl450_frame_width;
-					videoram[cl450_videoram_write].height = cl450_frame_height;
-					videoram[cl450_videoram_write].depth = cl450_frame_pixbytes;
+					// with the worker running it fills this buffer
+					if (!fmv_decode_running) {
+						memcpy(videoram[cl450_videoram_write].data, mpeg_info->display_fbuf->buf[0], cl450_frame_width * cl450_frame_height * cl450_frame_pixbytes);
+						videoram[cl450_videoram_write].width = cl450_frame_width;
+						videoram[cl450_videoram_write].height = cl450_frame_height;
+						videoram[cl450_videoram_write].depth = cl450_frame_pixbytes;
+					}
 					cl450_videoram_write++;
 					cl450_videoram_write &= CL450_VIDEO_BUFFERS - 1;
 					cl450_videoram_cnt++;
@@ -830,8 +1081,7 @@ static void cl450_reset(void)
 	cl450_videoram_read = 0;
 	cl450_videoram_cnt = 0;
 	memset(cl450_regs, 0, sizeof cl450_regs);
-	if (mpeg_decoder)
-		mpeg2_reset(mpeg_decoder, 1);
+	fmv_decode_flush();
 	if (fmv_ram_bank.baseaddr) {
 		memset(fmv_ram_bank.baseaddr, 0, 0x100);
 		write_log(_T("CL450 reset\n"));
@@ -1341,11 +1591,15 @@ static void cd32_fmv_hsync_handler(void)
 	if (cl450_video_hsync_wait == 0) {
 		cl450_set_status(CL_INT_PIC_D);
 		if (cl450_videoram_cnt > 0) {
+			if (fmv_decode_running)
+				fmv_decode_wait_picture();
 			cd32_fmv_new_image(videoram[cl450_videoram_read].width, videoram[cl450_videoram_read].height, 
 				videoram[cl450_videoram_read].depth, cl450_blank ? NULL : videoram[cl450_videoram_read].data);
 			cl450_videoram_read++;
 			cl450_videoram_read &= CL450_VIDEO_BUFFERS - 1;
 			cl450_videoram_cnt--;
+			if (fmv_decode_running)
+				fmv_decode_picture_shown();
 		}
 		cl450_video_hsync_wait = max_sync_vpos;
 		while (remaining_sync_vpos >= 1.0) {
@@ -1402,6 +1656,7 @@ static void cd32_fmv_free(void)
 	cda = NULL;
 	xfree(pcmaudio);
 	pcmaudio = NULL;
+	fmv_decode_stop();
 	if (mpeg_decoder)
 		mpeg2_close(mpeg_decoder);
 	mpeg_decoder = NULL;
@@ -1448,6 +1703,7 @@ addrbank *cd32_fmv_init (struct autoconfig_info *aci)
 		mpeg_decoder = mpeg2_init();
 		mpeg_info = mpeg2_info(mpeg_decoder);
 	}
+	fmv_decode_start();
 	fmv_bank.mask = fmv_board_size - 1;
 	map_banks(&fmv_rom_bank, (fmv_start + ROM_BASE) >> 16, fmv_rom_size >> 16, 0);
 	map_banks(&fmv_ram_bank, (fmv_start + RAM_BASE) >> 16, fmv_ram_size >> 16, 0);
@@ -1079,6 +1079,7 @@ static void cfgfile_save_options (struct zfile *f, struct uae_prefs *p, int type
   cfgfile_write (f, _T("sound_stereo_separation"), _T("%d"), p->sound_stereo_separation);
   cfgfile_write (f, _T("sound_stereo_mixing_delay"), _T("%d"), p->sound_mixed_stereo_delay >= 0 ? p->sound_mixed_stereo_delay : 0);
   cfgfile_write (f, _T("sound_frequency"), _T("%d"), p->sound_freq);
+  cfgfile_write (f, _T("sound_max_buff"), _T("%d"), p->sound_maxbsiz);
   cfgfile_write_str (f, _T("sound_interpol"), interpolmode[p->sound_interpol]);
   cfgfile_write_str (f, _T("sound_filter"), soundfiltermode1[p->sound_filter]);
   cfgfile_write_str (f, _T("sound_filter_type"), soundfiltermode2[p->sound_filter_type]);
@@ -1090,6 +1091,8 @@ static void cfgfile_save_options (struct zfile *f, struct uae_prefs *p, int type
 	cfgfile_write_bool (f, _T("compfpu"), p->compfpu);
 #endif
   cfgfile_write (f, _T("cachesize"), _T("%d"), p->cachesize);
+	cfgfile_write_bool (f, _T("comp_persist"), p->comp_persist);
+	cfgfile_write_bool (f, _T("comp_profile"), p->comp_profile);
 
 	for (i = 0; i < MAX_JPORTS; i++) {
 		struct jport *jp = &p->jports[i];
@@ -1137,6 +1140,8 @@ static void cfgfile_save_options (struct zfile *f, struct uae_prefs *p, int type
   cfgfile_dwrite_str (f, _T("absolute_mouse"), abspointers[p->input_tablet]);
 
   cfgfile_write (f, _T("gfx_framerate"), _T("%d"), p->gfx_framerate);
+	cfgfile_write (f, _T("gfx_render_threads"), _T("%d"), p->gfx_render_threads);
+	cfgfile_write_bool (f, _T("gfx_line_cache"), p->gfx_line_cache);
   write_resolution (f, _T("gfx_width"), _T("gfx_height"), &p->gfx_monitor.gfx_size); /* compatibility with old versions */
 	cfgfile_write (f, _T("gfx_top_windowed"), _T("%d"), p->gfx_monitor.gfx_size.y);
 	cfgfile_write(f, _T("gfx_left_windowed"), _T("%d"), p->gfx_monitor.gfx_size.x);
@@ -1272,11 +1277,18 @@ static void cfgfile_save_options (struct zfile *f, struct uae_prefs *p, int type
 		: _T("FOO")));
 
 	cfgfile_dwrite_bool (f, _T("warp"), p->turbo_emulation);
+	cfgfile_write_bool (f, _T("state_replay"), p->statecapture);
+	cfgfile_write (f, _T("state_replay_rate"), _T("%d"), p->statecapturerate);
+	cfgfile_write (f, _T("state_replay_buffers"), _T("%d"), p->statecapturebuffersize);
+	cfgfile_write (f, _T("statefile_compression"), _T("%d"), p->statefile_compress);
+	cfgfile_write_bool (f, _T("statefile_incremental"), p->statefile_incremental);
+	cfgfile_write_bool (f, _T("statefile_async"), p->statefile_async);
 
 #ifdef FILESYS
 	write_filesys_config (p, f);
 	cfgfile_dwrite (f, _T("filesys_max_size"), _T("%d"), p->filesys_limit);
 	cfgfile_dwrite (f, _T("filesys_max_name_length"), _T("%d"), p->filesys_max_name);
+	cfgfile_dwrite_bool (f, _T("hardfile_mmap"), p->hardfile_mmap);
 #endif
 	cfgfile_dwrite_bool(f, _T("harddrive_write_protect"), p->harddrive_read_only);
 
@@ -1761,12 +1773,18 @@ static int cfgfile_parse_host (struct uae_prefs *p, TCHAR *option, TCHAR *value)
 	}
 
   if (cfgfile_intval (option, value, _T("sound_frequency"), &p->sound_freq, 1)
+    || cfgfile_intval (option, value, _T("sound_max_buff"), &p->sound_maxbsiz, 1)
 		|| cfgfile_intval (option, value, _T("sound_volume_paula"), &p->sound_volume_paula, 1)
 		|| cfgfile_intval (option, value, _T("sound_volume_cd"), &p->sound_volume_cd, 1)
 	  || cfgfile_intval (option, value, _T("sound_stereo_separation"), &p->sound_stereo_separation, 1)
 	  || cfgfile_intval (option, value, _T("sound_stereo_mixing_delay"), &p->sound_mixed_stereo_delay, 1)
 
 	  || cfgfile_intval (option, value, _T("gfx_framerate"), &p->gfx_framerate, 1)
+		|| cfgfile_intval (option, value, _T("gfx_render_threads"), &p->gfx_render_threads, 1)
+		|| cfgfile_yesno (option, value, _T("gfx_line_cache"), &p->gfx_line_cache)
+		|| cfgfile_intval (option, value, _T("state_replay_rate"), &p->statecapturerate, 1)
+		|| cfgfile_intval (option, value, _T("state_replay_buffers"), &p->statecapturebuffersize, 1)
+		|| cfgfile_intval (option, value, _T("statefile_compression"), &p->statefile_compress, 1)
 		|| cfgfile_intval(option, value, _T("gfx_top_windowed"), &p->gfx_monitor.gfx_size.y, 1)
 		|| cfgfile_intval(option, value, _T("gfx_left_windowed"), &p->gfx_monitor.gfx_size.x, 1)
 		|| cfgfile_intval (option, value, _T("gfx_refreshrate"), &p->gfx_apmode[APMODE_NATIVE].gfx_refreshrate, 1)
@@ -1798,6 +1816,10 @@ static int cfgfile_parse_host (struct uae_prefs *p, TCHAR *option, TCHAR *value)
 		|| cfgfile_yesno (option, value, _T("floppy2wp"), &p->floppyslots[2].forcedwriteprotect)
 		|| cfgfile_yesno (option, value, _T("floppy3wp"), &p->floppyslots[3].forcedwriteprotect)
 		|| cfgfile_yesno(option, value, _T("warp"), &p->turbo_emulation)
+		|| cfgfile_yesno (option, value, _T("state_replay"), &p->statecapture)
+		|| cfgfile_yesno (option, value, _T("statefile_incremental"), &p->statefile_incremental)
+		|| cfgfile_yesno (option, value, _T("statefile_async"), &p->statefile_async)
+		|| cfgfile_yesno (option, value, _T("hardfile_mmap"), &p->hardfile_mmap)
     || cfgfile_yesno (option, value, _T("bsdsocket_emu"), &p->socket_emu))
 	  return 1;
 
@@ -2761,6 +2783,8 @@ static int cfgfile_parse_hardware (struct uae_prefs *p, const TCHAR *option, TCH
 	  || cfgfile_yesno (option, value, _T("ntsc"), &p->ntscmode)
 	  || cfgfile_yesno (option, value, _T("cpu_24bit_addressing"), &p->address_space_24)
 		|| cfgfile_yesno (option, value, _T("fpu_strict"), &p->fpu_strict)
+		|| cfgfile_yesno (option, value, _T("comp_persist"), &p->comp_persist)
+		|| cfgfile_yesno (option, value, _T("comp_profile"), &p->comp_profile)
 #ifdef USE_JIT_FPU
 		|| cfgfile_yesno (option, value, _T("compfpu"), &p->compfpu)
 #endif
@@ -4194,6 +4218,7 @@ void default_prefs (struct uae_prefs *p, bool reset, int type)
   p->sound_stereo_separation = 7;
   p->sound_mixed_stereo_delay = 0;
   p->sound_freq = DEFAULT_SOUND_FREQ;
+  p->sound_maxbsiz = DEFAULT_SOUND_MAXB;
   p->sound_interpol = 0;
   p->sound_filter = FILTER_SOUND_OFF;
   p->sound_filter_type = 0;
@@ -4205,9 +4230,13 @@ void default_prefs (struct uae_prefs *p, bool reset, int type)
 	p->compfpu = 0;
 #endif
   p->cachesize = 0;
+	p->comp_persist = false;
+	p->comp_profile = false;
 
   p->gfx_framerate = 0;
-#ifdef RASPBERRY
+	p->gfx_render_threads = 1;
+	p->gfx_line_cache = true;
+#if defined(RASPBERRY) || defined(HEADLESS)
 	p->gfx_monitor.gfx_size.width = 640;
 	p->gfx_monitor.gfx_size.height = 262;
   p->gfx_resolution = RES_HIRES;
@@ -4226,6 +4255,12 @@ void default_prefs (struct uae_prefs *p, bool reset, int type)
 	p->leds_on_screen_mask[0] = p->leds_on_screen_mask[1] = 0x01fe;
 	p->scsi = 0;
 	p->turbo_emulation = 0;
+	p->statecapture = false;
+	p->statecapturerate = 25;
+	p->statecapturebuffersize = 20;
+	p->statefile_compress = 1;
+	p->statefile_incremental = false;
+	p->statefile_async = true;
 	p->boot_rom = 0;
 #ifdef FAST_COPPER_DEFAULT_ON
   p->fast_copper = 1;
@@ -4281,6 +4316,7 @@ void default_prefs (struct uae_prefs *p, bool reset, int type)
   p->ntscmode = 0;
 	p->filesys_limit = 0;
 	p->filesys_max_name = 107;
+	p->hardfile_mmap = false;
 
   p->fastmem[0].size = 0x00000000;
 	p->mbresmem_low.size = 0x00000000;
@@ -907,16 +907,14 @@ static void update_mirrors(void)
 	set_chipset_mode();
 }
 
-extern struct color_entry colors_for_drawing;
-
 void notice_new_xcolors (void)
 {
   update_mirrors ();
 	docols(&current_colors);
-  docols(&colors_for_drawing);
 	for (int i = 0; i < (MAXVPOS + 1)*2; i++) {
 		docols(curr_color_tables + i);
 	}
+	notice_screen_contents_lost ();
 }
 
 static void record_color_change2 (int hpos, int regno, uae_u32 value)
@@ -7003,6 +7001,7 @@ static void hsync_handler (void)
 			uae_reset (0, 0);
 			return;
 		}
+		savestate_capture (false);
 	}
 	hsync_handler_post (vs);
 }
@@ -8366,6 +8365,14 @@ void check_prefs_changed_custom (void)
 	if (!config_changed)
 		return;
   currprefs.gfx_framerate = changed_prefs.gfx_framerate;
+	currprefs.gfx_render_threads = changed_prefs.gfx_render_threads;
+	currprefs.gfx_line_cache = changed_prefs.gfx_line_cache;
+	currprefs.statecapture = changed_prefs.statecapture;
+	currprefs.statecapturerate = changed_prefs.statecapturerate;
+	currprefs.statecapturebuffersize = changed_prefs.statecapturebuffersize;
+	currprefs.statefile_compress = changed_prefs.statefile_compress;
+	currprefs.statefile_incremental = changed_prefs.statefile_incremental;
+	currprefs.statefile_async = changed_prefs.statefile_async;
 	if (currprefs.turbo_emulation != changed_prefs.turbo_emulation)
 		warpmode (changed_prefs.turbo_emulation);
   if (inputdevice_config_change_test ())
@@ -215,6 +215,7 @@ void do_leave_program (void)
 	device_func_free();
   memory_cleanup ();
 	free_shm ();
+	savestate_free_records ();
   cfgfile_addcfgparam (0);
   machdep_free ();
 	driveclick_free();
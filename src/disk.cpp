@@ -31,6 +31,7 @@
 #include "caps/generic_caps.h"
 #endif
 #include "crc32.h"
+#include "threaddep/thread.h"
 #include "fsdb.h"
 #include "statusline.h"
 #include "tinyxml2.h"
@@ -131,6 +132,18 @@ typedef struct {
 #define DRIVE_ID_35HD  0xAAAAAAAA
 #define DRIVE_ID_525SD 0x55555555 /* 40 track 5.25 drive , kickstart does not recognize this */
 
+/* Encoded AmigaDOS and DiskSpare tracks, so that stepping back and forth
+ * does not read and MFM encode the same sectors again. */
+#define MFMCACHE_TRACKS 8
+struct mfmcache {
+	int track;
+	int tracklen;
+	int skipoffset;
+	int writelen;
+	uae_u32 stamp;
+	uae_u16 *mfm;
+};
+
 typedef enum { ADF_NONE = -1, ADF_NORMAL, ADF_EXT1, ADF_EXT2, ADF_FDI, ADF_IPF, ADF_PCDOS, ADF_KICK, ADF_SKICK, ADF_NORMAL_HEADER } drive_filetype;
 typedef struct {
   struct zfile *diskfile;
@@ -185,6 +198,8 @@ typedef struct {
 	int lastrev;
 	bool track_access_done;
 	bool fourms;
+	struct mfmcache mfmcache[MFMCACHE_TRACKS];
+	uae_u32 mfmcache_stamp;
 } drive;
 
 #define MIN_STEPLIMIT_CYCLE (CYCLE_UNIT * 140)
@@ -589,8 +604,11 @@ static void drive_settype_id (drive *drv)
   }
 }
 
+static void mfmcache_invalidate (drive *drv, int track);
+
 static void drive_image_free (drive *drv)
 {
+	mfmcache_invalidate (drv, -1);
 	switch (drv->filetype)
 	{
 	case ADF_IPF:
@@ -1622,21 +1640,19 @@ static void decode_pcdos (drive *drv)
   drv->tracklen = (dstmfmbuf - drv->bigmfmbuf) * 16;
 }
 
-static void decode_amigados (drive *drv)
+/* Returns the track length in bits */
+static int decode_amigados (drive *drv, int tr, uae_u16 *dstmfmbuf, int *skipoffset)
 {
   /* Normal AmigaDOS format track */
-  int tr = drv->cyl * 2 + side;
   int sec;
 	int dstmfmoffset = 0;
-  uae_u16 *dstmfmbuf = drv->bigmfmbuf;
   int len = drv->num_secs * 544 + FLOPPY_GAP_LEN;
 	int prevbit;
 
   trackid *ti = drv->trackdata + tr;
 	memset (dstmfmbuf, 0xaa, len * 2);
 	dstmfmoffset += FLOPPY_GAP_LEN;
-	drv->skipoffset = (FLOPPY_GAP_LEN * 8) / 3 * 2;
-	drv->tracklen = len * 2 * 8;
+	*skipoffset = (FLOPPY_GAP_LEN * 8) / 3 * 2;
 
 	prevbit = 0;
   for (sec = 0; sec < drv->num_secs; sec++) {
@@ -1728,6 +1744,7 @@ static void decode_amigados (drive *drv)
 		// so that final word has correct MFM encoding
 		dstmfmbuf[dstmfmoffset % len] = mfmbuf[i];
   }
+	return len * 2 * 8;
 }
 
 /*
@@ -1741,20 +1758,17 @@ static void decode_amigados (drive *drv)
  *
  */
 
-static void decode_diskspare (drive *drv)
+static int decode_diskspare (drive *drv, int tr, uae_u16 *dstmfmbuf, int *skipoffset)
 {
-  int tr = drv->cyl * 2 + side;
   int sec;
   int dstmfmoffset = 0;
   int size = 512 + 8;
-  uae_u16 *dstmfmbuf = drv->bigmfmbuf;
   int len = drv->num_secs * size + FLOPPY_GAP_LEN;
 
   trackid *ti = drv->trackdata + tr;
   memset (dstmfmbuf, 0xaa, len * 2);
   dstmfmoffset += FLOPPY_GAP_LEN;
-  drv->skipoffset = (FLOPPY_GAP_LEN * 8) / 3 * 2;
-  drv->tracklen = len * 2 * 8;
+  *skipoffset = (FLOPPY_GAP_LEN * 8) / 3 * 2;
 
   for (sec = 0; sec < drv->num_secs; sec++) {
 	  uae_u8 secbuf[512 + 8];
@@ -1812,6 +1826,208 @@ static void decode_diskspare (drive *drv)
 	    dstmfmoffset++;
   	}
   }
+	return len * 2 * 8;
+}
+
+/*
+ * MFM track cache
+ *
+ * All cache entries and the prefetch queue are protected by mfmcache_lock.
+ * The prefetch thread only reads a drive's image file while it holds the
+ * lock and only for queued tracks. mfmcache_idle() drops the queued tracks
+ * of a drive, after that the image file belongs to the emulation thread
+ * alone until the next track is buffered.
+ */
+
+#define MFMCACHE_JOBS 8
+
+struct mfmcache_job {
+	drive *drv;
+	int track;
+};
+
+static uae_sem_t mfmcache_lock, mfmcache_work;
+static uae_thread_id mfmcache_tid;
+static volatile bool mfmcache_running, mfmcache_quit;
+static struct mfmcache_job mfmcache_jobs[MFMCACHE_JOBS];
+static int mfmcache_jobcnt;
+
+static bool mfmcache_cancache (drive *drv, int tr)
+{
+	if (!drv->diskfile || tr < 0 || tr >= drv->num_tracks)
+		return false;
+	if (drv->writediskfile && drv->writetrackdata[tr].bitlen > 0)
+		return false;
+	return drv->trackdata[tr].type == TRACK_AMIGADOS || drv->trackdata[tr].type == TRACK_DISKSPARE;
+}
+
+static struct mfmcache *mfmcache_find (drive *drv, int tr)
+{
+	for (int i = 0; i < MFMCACHE_TRACKS; i++) {
+		struct mfmcache *c = &drv->mfmcache[i];
+		if (c->tracklen > 0 && c->track == tr && c->writelen == FLOPPY_WRITE_LEN)
+			return c;
+	}
+	return NULL;
+}
+
+static struct mfmcache *mfmcache_encode (drive *drv, int tr)
+{
+	struct mfmcache *c = &drv->mfmcache[0];
+
+	for (int i = 1; i < MFMCACHE_TRACKS && c->tracklen > 0; i++) {
+		struct mfmcache *c2 = &drv->mfmcache[i];
+		if (c2->tracklen == 0 || c2->stamp < c->stamp)
+			c = c2;
+	}
+	if (!c->mfm)
+		c->mfm = xmalloc (uae_u16, 0x4000 * DDHDMULT);
+	if (!c->mfm)
+		return NULL;
+	c->track = tr;
+	c->writelen = FLOPPY_WRITE_LEN;
+	if (drv->trackdata[tr].type == TRACK_AMIGADOS)
+		c->tracklen = decode_amigados (drv, tr, c->mfm, &c->skipoffset);
+	else
+		c->tracklen = decode_diskspare (drv, tr, c->mfm, &c->skipoffset);
+	c->stamp = ++drv->mfmcache_stamp;
+	return c;
+}
+
+static void mfmcache_dropjobs (drive *drv)
+{
+	int j = 0;
+	for (int i = 0; i < mfmcache_jobcnt; i++) {
+		if (mfmcache_jobs[i].drv != drv)
+			mfmcache_jobs[j++] = mfmcache_jobs[i];
+	}
+	mfmcache_jobcnt = j;
+}
+
+static void mfmcache_queue (drive *drv, int tr)
+{
+	if (mfmcache_jobcnt >= MFMCACHE_JOBS || !mfmcache_cancache (drv, tr) || mfmcache_find (drv, tr))
+		return;
+	mfmcache_jobs[mfmcache_jobcnt].drv = drv;
+	mfmcache_jobs[mfmcache_jobcnt].track = tr;
+	mfmcache_jobcnt++;
+}
+
+static int mfmcache_thread (void *v)
+{
+	for (;;) {
+		uae_sem_wait (&mfmcache_work);
+		if (mfmcache_quit)
+			break;
+		uae_sem_wait (&mfmcache_lock);
+		while (mfmcache_jobcnt > 0) {
+			struct mfmcache_job job = mfmcache_jobs[0];
+			mfmcache_jobcnt--;
+			memmove (&mfmcache_jobs[0], &mfmcache_jobs[1], mfmcache_jobcnt * sizeof (struct mfmcache_job));
+			if (mfmcache_cancache (job.drv, job.track) && !mfmcache_find (job.drv, job.track))
+				mfmcache_encode (job.drv, job.track);
+			// let the emulation thread in between tracks
+			uae_sem_post (&mfmcache_lock);
+			uae_sem_wait (&mfmcache_lock);
+		}
+		uae_sem_post (&mfmcache_lock);
+	}
+	return 0;
+}
+
+static void mfmcache_start (void)
+{
+	if (mfmcache_running)
+		return;
+	uae_sem_init (&mfmcache_lock, 0, 1);
+	uae_sem_init (&mfmcache_work, 0, 0);
+	mfmcache_quit = false;
+	mfmcache_jobcnt = 0;
+	mfmcache_running = uae_start_thread (_T("floppy prefetch"), mfmcache_thread, NULL, &mfmcache_tid) != 0;
+	if (!mfmcache_running) {
+		uae_sem_destroy (&mfmcache_lock);
+		uae_sem_destroy (&mfmcache_work);
+	}
+}
+
+static void mfmcache_stop (void)
+{
+	if (!mfmcache_running)
+		return;
+	mfmcache_quit = true;
+	uae_sem_post (&mfmcache_work);
+	uae_wait_thread (mfmcache_tid);
+	mfmcache_running = false;
+	uae_sem_destroy (&mfmcache_lock);
+	uae_sem_destroy (&mfmcache_work);
+}
+
+/* Must be called before the emulation thread uses the drive's image file */
+static void mfmcache_idle (drive *drv)
+{
+	if (!mfmcache_running)
+		return;
+	uae_sem_wait (&mfmcache_lock);
+	mfmcache_dropjobs (drv);
+	uae_sem_post (&mfmcache_lock);
+}
+
+/* Forget one track or all tracks (-1) */
+static void mfmcache_invalidate (drive *drv, int track)
+{
+	if (mfmcache_running)
+		uae_sem_wait (&mfmcache_lock);
+	mfmcache_dropjobs (drv);
+	for (int i = 0; i < MFMCACHE_TRACKS; i++) {
+		struct mfmcache *c = &drv->mfmcache[i];
+		if (track < 0 || c->track == track)
+			c->tracklen = 0;
+	}
+	if (mfmcache_running)
+		uae_sem_post (&mfmcache_lock);
+}
+
+static void mfmcache_free (drive *drv)
+{
+	for (int i = 0; i < MFMCACHE_TRACKS; i++) {
+		struct mfmcache *c = &drv->mfmcache[i];
+		xfree (c->mfm);
+		c->mfm = NULL;
+		c->tracklen = 0;
+	}
+}
+
+static void drive_fill_encoded (drive *drv, int tr)
+{
+	struct mfmcache *c;
+
+	mfmcache_start ();
+	if (mfmcache_running)
+		uae_sem_wait (&mfmcache_lock);
+	c = mfmcache_find (drv, tr);
+	if (!c)
+		c = mfmcache_encode (drv, tr);
+	if (c) {
+		memcpy (drv->bigmfmbuf, c->mfm, c->tracklen / 8);
+		drv->tracklen = c->tracklen;
+		drv->skipoffset = c->skipoffset;
+		c->stamp = ++drv->mfmcache_stamp;
+	} else if (drv->trackdata[tr].type == TRACK_AMIGADOS) {
+		drv->tracklen = decode_amigados (drv, tr, drv->bigmfmbuf, &drv->skipoffset);
+	} else {
+		drv->tracklen = decode_diskspare (drv, tr, drv->bigmfmbuf, &drv->skipoffset);
+	}
+	if (mfmcache_running) {
+		bool queued;
+		// other side first, then the neighbouring cylinders
+		mfmcache_queue (drv, tr ^ 1);
+		mfmcache_queue (drv, tr + 2);
+		mfmcache_queue (drv, tr - 2);
+		queued = mfmcache_jobcnt > 0;
+		uae_sem_post (&mfmcache_lock);
+		if (queued)
+			uae_sem_post (&mfmcache_work);
+	}
 }
 
 static void drive_fill_bigbuf (drive * drv, int force)
@@ -1828,6 +2044,7 @@ static void drive_fill_bigbuf (drive * drv, int force)
   
   if (!force && drv->buffered_cyl == drv->cyl && drv->buffered_side == side)
   	return;
+	mfmcache_idle (drv);
   drv->indexoffset = 0;
   drv->multi_revolution = 0;
   drv->tracktiming[0] = 0;
@@ -1865,13 +2082,9 @@ static void drive_fill_bigbuf (drive * drv, int force)
 
 	  decode_pcdos(drv);
 
-  } else if (ti->type == TRACK_AMIGADOS) {
-
-  	decode_amigados(drv);
+  } else if (ti->type == TRACK_AMIGADOS || ti->type == TRACK_DISKSPARE) {
 
-  } else if (ti->type == TRACK_DISKSPARE) {
-
-  	decode_diskspare (drv);
+		drive_fill_encoded (drv, tr);
 
 	} else if (ti->type == TRACK_NONE) {
 
@@ -2240,6 +2453,7 @@ static bool convert_adf_to_ext2 (drive *drv, int mode)
 
 	if (drv->filetype != ADF_NORMAL)
 		return false;
+	mfmcache_invalidate (drv, -1);
 	_tcscpy (name, currprefs.floppyslots[drv - floppy].df);
 	if (!name[0])
 		return false;
@@ -2286,6 +2500,7 @@ static void drive_write_data (drive * drv)
   int ret = -1;
 	int tr = drv->cyl * 2 + side;
 
+	mfmcache_invalidate (drv, tr);
   if (drive_writeprotected (drv) || drv->trackdata[tr].type == TRACK_NONE) {
     /* read original track back because we didn't really write anything */
     drv->buffered_side = 2;
@@ -3734,9 +3949,11 @@ void DSKPTL (uae_u16 v)
 
 void DISK_free (void)
 {
+	mfmcache_stop ();
 	for (int dr = 0; dr < MAX_FLOPPY_DRIVES; dr++) {
     drive *drv = &floppy[dr];
     drive_image_free (drv);
+		mfmcache_free (drv);
   }
 }
 
@@ -3788,135 +4005,442 @@ static void load_track (int num, int cyl, int side, int *sectable)
 
 using namespace tinyxml2;
 
-static bool abr_loaded;
-static tinyxml2::XMLDocument abr_xml[2];
+/*
+ * Bootblock database (abr/brainfile.xml and abr/catlist.xml)
+ *
+ * Both files are parsed once and compiled into a flat entry table. CRC32
+ * lookups go through a hash table. Recog signatures are bucketed by one
+ * of their offset/value pairs, using a small set of offsets that covers
+ * every signature. A lookup then only checks the buckets selected by the
+ * bootblock bytes at those offsets.
+ *
+ * The compiled table is stored in abr/brainfile.cache and reused until
+ * either XML file changes.
+ */
+
+#define ABR_CACHE_MAGIC 0x55414252 /* UABR */
+#define ABR_CACHE_VERSION 1
+
+struct abr_entry {
+	uae_u32 crc32;
+	uae_s32 hascrc;
+	uae_s32 recog, nrecog;	/* pairs in abr_pairs, nrecog 0 never matches */
+	uae_s32 name, classname; /* offsets in abr_strings or -1 */
+};
+
+struct abr_cacheheader {
+	uae_u32 magic, version;
+	uae_u32 xmlsize[2], xmlcrc32[2];
+	uae_u32 entries, pairs, strings;
+};
+
+static bool abr_loaded, abr_tried;
 static const TCHAR* abr_files[] = { _T("brainfile.xml"), _T("catlist.xml"), NULL };
+static const TCHAR *abr_cachefile = _T("brainfile.cache");
 
-static void abrcheck(struct diskinfo *di)
+static struct abr_entry *abr_entries;
+static int abr_numentries, abr_maxentries;
+static uae_u16 *abr_pairs;
+static int abr_numpairs, abr_maxpairs;
+static char *abr_strings;
+static int abr_stringsize, abr_maxstrings;
+
+/* CRC32 hash table, entry + 1, 0 = free */
+static int *abr_crchash;
+static uae_u32 abr_crchashmask;
+/* signature buckets keyed by offset * 256 + value, chained through abr_rnext */
+static int abr_pivots[1024];
+static int abr_numpivots;
+static uae_u32 *abr_rkeys;
+static int *abr_rhead, *abr_rnext;
+static uae_u32 abr_rhashmask;
+
+STATIC_INLINE uae_u32 abr_hash (uae_u32 v)
 {
-	TCHAR path[MAX_DPATH];
+	return v * 2654435761u;
+}
 
-	if (!abr_loaded) {
-		bool error = false;
-		for (int i = 0; abr_files[i] && !error; i++) {
-			get_plugin_path(path, sizeof(path) / sizeof(TCHAR), _T("abr"));
-			_tcscat(path, abr_files[i]);
-			FILE *f = fopen(path, _T("rb"));
-			if (f) {
-				tinyxml2::XMLError err = abr_xml[i].LoadFile(f);
-				if (err != XML_SUCCESS) {
-					write_log(_T("failed to parse '%s': %d\n"), path, err);
-					error = true;
-				}
-				fclose(f);
-			} else {
-				error = true;
+static int abr_addstring (const char *s)
+{
+	int len, offset;
+
+	if (!s)
+		return -1;
+	len = strlen (s) + 1;
+	if (abr_stringsize + len > abr_maxstrings) {
+		abr_maxstrings = (abr_stringsize + len) * 2;
+		abr_strings = xrealloc (char, abr_strings, abr_maxstrings);
+	}
+	offset = abr_stringsize;
+	memcpy (abr_strings + offset, s, len);
+	abr_stringsize += len;
+	return offset;
+}
+
+/* "offset,value,offset,value,..." Returns the number of pairs or 0 if
+ * the signature is malformed and can never match. */
+static int abr_addrecog (const char *tr)
+{
+	int start = abr_numpairs;
+
+	while (tr) {
+		int offset = atoi (tr);
+		if (offset < 0 || offset > 1023)
+			break;
+		tr = strchr (tr, ',');
+		if (!tr || !tr[1])
+			break;
+		tr++;
+		int val = atoi (tr);
+		if (val < 0 || val > 255)
+			break;
+		if (abr_numpairs + 2 > abr_maxpairs) {
+			abr_maxpairs = (abr_numpairs + 2) * 2;
+			abr_pairs = xrealloc (uae_u16, abr_pairs, abr_maxpairs);
+		}
+		abr_pairs[abr_numpairs++] = offset;
+		abr_pairs[abr_numpairs++] = val;
+		tr = strchr (tr, ',');
+		if (!tr)
+			return (abr_numpairs - start) / 2;
+		tr++;
+	}
+	abr_numpairs = start;
+	return 0;
+}
+
+static void abr_free (void)
+{
+	xfree (abr_entries);
+	xfree (abr_pairs);
+	xfree (abr_strings);
+	xfree (abr_crchash);
+	xfree (abr_rkeys);
+	xfree (abr_rhead);
+	xfree (abr_rnext);
+	abr_entries = NULL;
+	abr_pairs = NULL;
+	abr_strings = NULL;
+	abr_crchash = NULL;
+	abr_rkeys = NULL;
+	abr_rhead = abr_rnext = NULL;
+	abr_numentries = abr_maxentries = 0;
+	abr_numpairs = abr_maxpairs = 0;
+	abr_stringsize = abr_maxstrings = 0;
+	abr_numpivots = 0;
+}
+
+static const char *abr_categoryname (XMLDocument *catlist, const char *t_class)
+{
+	XMLElement *ecats = catlist->FirstChildElement("Categories");
+	if (!ecats)
+		return NULL;
+	for (XMLElement *ecat = ecats->FirstChildElement("Category"); ecat; ecat = ecat->NextSiblingElement()) {
+		XMLElement *ecatr = ecat->FirstChildElement("abbrev");
+		if (ecatr) {
+			const char *catabbr = ecatr->GetText();
+			if (catabbr && !strcmp(catabbr, t_class)) {
+				XMLElement *ecatn = ecat->FirstChildElement("Name");
+				if (ecatn && ecatn->GetText())
+					return ecatn->GetText();
 			}
 		}
-		if (!error) {
-			abr_loaded = true;
+	}
+	return NULL;
+}
+
+static bool abr_compile (const char *xml[2], const int size[2])
+{
+	XMLDocument doc[2];
+
+	for (int i = 0; i < 2; i++) {
+		XMLError err = doc[i].Parse(xml[i], size[i]);
+		if (err != XML_SUCCESS) {
+			write_log(_T("failed to parse '%s': %d\n"), abr_files[i], err);
+			return false;
 		}
 	}
-	if (!abr_loaded)
-		return;
-	tinyxml2::XMLElement *detectedelementcrc32 = NULL;
-	tinyxml2::XMLElement *detectedelementrecog = NULL;
-	tinyxml2::XMLElement *e = abr_xml[0].FirstChildElement("Bootblocks");
-	if (e) {
+	XMLElement *e = doc[0].FirstChildElement("Bootblocks");
+	if (e)
 		e = e->FirstChildElement("Bootblock");
-		if (e) {
-			do {
-				tinyxml2::XMLElement *ercrc = e->FirstChildElement("CRC");
-				if (ercrc) {
-					const char *n_crc32 = ercrc->GetText();
-					if (strlen(n_crc32) == 8) {
-						char *endptr;
-						uae_u32 crc32 = strtol(n_crc32, &endptr, 16);
-						if (di->bootblockcrc32 == crc32) {
-							detectedelementcrc32 = e;
-						}
-					}
-				}
-				tinyxml2::XMLElement *er = e->FirstChildElement("Recog");
-				if (er) {
-					const char *tr = er->GetText();
-					bool detected = false;
-					while (tr) {
-						int offset = atoi(tr);
-						if (offset < 0 || offset > 1023)
-							break;
-						tr = strchr(tr, ',');
-						if (!tr || !tr[1])
-							break;
-						tr++;
-						int val = atoi(tr);
-						if (val < 0 || val > 255)
-							break;
-						if (di->bootblock[offset] != val)
-							break;
-						tr = strchr(tr, ',');
-						if (!tr) {
-							detected = true;
-						} else {
-							tr++;
-						}
-					}
-					if (detected) {
-						detectedelementrecog = e;
-					}
-				}
-				e = e->NextSiblingElement();
-			} while (e && !detectedelementcrc32);
+	for (; e; e = e->NextSiblingElement()) {
+		struct abr_entry *ae;
+		if (abr_numentries >= abr_maxentries) {
+			abr_maxentries = abr_maxentries ? abr_maxentries * 2 : 1024;
+			abr_entries = xrealloc (struct abr_entry, abr_entries, abr_maxentries);
+		}
+		ae = &abr_entries[abr_numentries++];
+		memset (ae, 0, sizeof (struct abr_entry));
+		ae->name = ae->classname = -1;
+		XMLElement *ercrc = e->FirstChildElement("CRC");
+		if (ercrc) {
+			const char *n_crc32 = ercrc->GetText();
+			if (n_crc32 && strlen(n_crc32) == 8) {
+				char *endptr;
+				ae->crc32 = strtoul(n_crc32, &endptr, 16);
+				ae->hascrc = 1;
+			}
+		}
+		XMLElement *er = e->FirstChildElement("Recog");
+		if (er) {
+			ae->recog = abr_numpairs;
+			ae->nrecog = abr_addrecog (er->GetText());
+		}
+		XMLElement *e_name = e->FirstChildElement("Name");
+		if (e_name)
+			ae->name = abr_addstring (e_name->GetText());
+		XMLElement *e_class = e->FirstChildElement("Class");
+		if (e_class && e_class->GetText())
+			ae->classname = abr_addstring (abr_categoryname (&doc[1], e_class->GetText()));
+	}
+	return true;
+}
 
-			if (detectedelementcrc32 != NULL || detectedelementrecog != NULL) {
-				if (detectedelementcrc32) {
-					e = detectedelementcrc32;
-				} else {
-					e = detectedelementrecog;
-				}
-				tinyxml2::XMLElement *e_name = e->FirstChildElement("Name");
-				if (e_name) {
-					const char *n_name = e_name->GetText();
-					if (n_name) {
-						TCHAR *s = au(n_name);
-						_tcscpy(di->bootblockinfo, s);
-						xfree(s);
-					}
-				}
-				tinyxml2::XMLElement *e_class = e->FirstChildElement("Class");
-				if (e_class) {
-					const char *t_class = e_class->GetText();
-					if (t_class) {
-						tinyxml2::XMLElement *ecats = abr_xml[1].FirstChildElement("Categories");
-						if (ecats) {
-							tinyxml2::XMLElement *ecat = ecats->FirstChildElement("Category");
-							if (ecat) {
-								do {
-									tinyxml2::XMLElement *ecatr = ecat->FirstChildElement("abbrev");
-									if (ecatr) {
-										const char *catabbr = ecatr->GetText();
-										if (!strcmp(catabbr, t_class)) {
-											tinyxml2::XMLElement *ecatn = ecat->FirstChildElement("Name");
-											if (ecatn) {
-												const char *n_catname = ecatn->GetText();
-												if (n_catname) {
-													TCHAR *s = au(n_catname);
-													_tcscpy(di->bootblockclass, s);
-													xfree(s);
-													break;
-												}
-											}
-										}
-									}
-									ecat = ecat->NextSiblingElement();
-								} while (ecat);
-							}
-						}
-						return;
-					}
-				}
+static void abr_buildindex (void)
+{
+	int cnt[1024];
+	int remaining = 0;
+	uae_u32 size;
+
+	for (size = 16; size < abr_numentries * 2; size <<= 1);
+	abr_crchashmask = size - 1;
+	abr_crchash = xcalloc (int, size);
+	for (int i = 0; i < abr_numentries; i++) {
+		struct abr_entry *ae = &abr_entries[i];
+		if (!ae->hascrc)
+			continue;
+		uae_u32 h = abr_hash (ae->crc32) & abr_crchashmask;
+		// keep the first entry of a CRC, like the linear scan did
+		while (abr_crchash[h] && abr_entries[abr_crchash[h] - 1].crc32 != ae->crc32)
+			h = (h + 1) & abr_crchashmask;
+		if (!abr_crchash[h])
+			abr_crchash[h] = i + 1;
+	}
+
+	abr_rhashmask = size - 1;
+	abr_rkeys = xmalloc (uae_u32, size);
+	abr_rhead = xmalloc (int, size);
+	abr_rnext = xmalloc (int, abr_numentries);
+	for (uae_u32 h = 0; h < size; h++)
+		abr_rkeys[h] = 0xffffffff;
+	// -2 marks signatures that are not in a bucket yet
+	for (int i = 0; i < abr_numentries; i++) {
+		abr_rnext[i] = abr_entries[i].nrecog ? -2 : -1;
+		if (abr_entries[i].nrecog)
+			remaining++;
+	}
+
+	// greedily pick the offset shared by most signatures not bucketed yet
+	abr_numpivots = 0;
+	while (remaining > 0) {
+		int best = 0;
+		memset (cnt, 0, sizeof cnt);
+		for (int i = 0; i < abr_numentries; i++) {
+			if (abr_rnext[i] != -2)
+				continue;
+			for (int j = 0; j < abr_entries[i].nrecog; j++)
+				cnt[abr_pairs[abr_entries[i].recog + j * 2]]++;
+		}
+		for (int o = 1; o < 1024; o++) {
+			if (cnt[o] > cnt[best])
+				best = o;
+		}
+		abr_pivots[abr_numpivots++] = best;
+		for (int i = 0; i < abr_numentries; i++) {
+			struct abr_entry *ae = &abr_entries[i];
+			int j;
+			if (abr_rnext[i] != -2)
+				continue;
+			for (j = 0; j < ae->nrecog; j++) {
+				if (abr_pairs[ae->recog + j * 2] == best)
+					break;
+			}
+			if (j == ae->nrecog)
+				continue;
+			uae_u32 key = best * 256 + abr_pairs[ae->recog + j * 2 + 1];
+			uae_u32 h = abr_hash (key) & abr_rhashmask;
+			while (abr_rkeys[h] != 0xffffffff && abr_rkeys[h] != key)
+				h = (h + 1) & abr_rhashmask;
+			if (abr_rkeys[h] == 0xffffffff) {
+				abr_rkeys[h] = key;
+				abr_rhead[h] = -1;
+			}
+			abr_rnext[i] = abr_rhead[h];
+			abr_rhead[h] = i;
+			remaining--;
+		}
+	}
+}
+
+static bool abr_recogmatch (struct abr_entry *ae, const uae_u8 *bootblock)
+{
+	const uae_u16 *p = abr_pairs + ae->recog;
+	for (int j = 0; j < ae->nrecog; j++, p += 2) {
+		if (bootblock[p[0]] != p[1])
+			return false;
+	}
+	return true;
+}
+
+/* First entry with a matching CRC, otherwise the last matching signature */
+static struct abr_entry *abr_find (struct diskinfo *di)
+{
+	int best = -1;
+	uae_u32 h = abr_hash (di->bootblockcrc32) & abr_crchashmask;
+
+	while (abr_crchash[h]) {
+		struct abr_entry *ae = &abr_entries[abr_crchash[h] - 1];
+		if (ae->crc32 == di->bootblockcrc32)
+			return ae;
+		h = (h + 1) & abr_crchashmask;
+	}
+	for (int i = 0; i < abr_numpivots; i++) {
+		uae_u32 key = abr_pivots[i] * 256 + di->bootblock[abr_pivots[i]];
+		h = abr_hash (key) & abr_rhashmask;
+		while (abr_rkeys[h] != 0xffffffff && abr_rkeys[h] != key)
+			h = (h + 1) & abr_rhashmask;
+		if (abr_rkeys[h] == 0xffffffff)
+			continue;
+		for (int e = abr_rhead[h]; e > best; e = abr_rnext[e]) {
+			if (abr_recogmatch (&abr_entries[e], di->bootblock))
+				best = e;
+		}
+	}
+	return best >= 0 ? &abr_entries[best] : NULL;
+}
+
+static bool abr_loadcache (const TCHAR *path, const int size[2], const uae_u32 crc[2])
+{
+	struct abr_cacheheader hdr;
+	bool ok = false;
+	FILE *f = fopen(path, _T("rb"));
+
+	if (!f)
+		return false;
+	if (fread (&hdr, sizeof hdr, 1, f) == 1 && hdr.magic == ABR_CACHE_MAGIC && hdr.version == ABR_CACHE_VERSION &&
+		hdr.xmlsize[0] == size[0] && hdr.xmlsize[1] == size[1] && hdr.xmlcrc32[0] == crc[0] && hdr.xmlcrc32[1] == crc[1] &&
+		hdr.entries < 0x100000 && hdr.pairs < 0x1000000 && hdr.strings < 0x1000000) {
+		abr_numentries = abr_maxentries = hdr.entries;
+		abr_numpairs = abr_maxpairs = hdr.pairs;
+		abr_stringsize = abr_maxstrings = hdr.strings;
+		abr_entries = xmalloc (struct abr_entry, abr_numentries + 1);
+		abr_pairs = xmalloc (uae_u16, abr_numpairs + 1);
+		abr_strings = xmalloc (char, abr_stringsize + 1);
+		if (fread (abr_entries, sizeof (struct abr_entry), abr_numentries, f) == abr_numentries &&
+			fread (abr_pairs, sizeof (uae_u16), abr_numpairs, f) == abr_numpairs &&
+			fread (abr_strings, 1, abr_stringsize, f) == abr_stringsize) {
+			ok = true;
+			abr_strings[abr_stringsize] = 0;
+			for (int i = 0; i < abr_numentries && ok; i++) {
+				struct abr_entry *ae = &abr_entries[i];
+				/* strings are offsets or -1, anything else rebuilds the cache */
+				if (ae->name < -1 || ae->name >= abr_stringsize || ae->classname < -1 || ae->classname >= abr_stringsize ||
+					ae->nrecog < 0 || ae->recog < 0 || ae->nrecog > abr_numpairs / 2 || ae->recog > abr_numpairs - ae->nrecog * 2)
+					ok = false;
+			}
+			for (int i = 0; i < abr_numpairs && ok; i += 2) {
+				if (abr_pairs[i] > 1023 || abr_pairs[i + 1] > 255)
+					ok = false;
 			}
 		}
+		if (!ok)
+			abr_free ();
+	}
+	fclose(f);
+	return ok;
+}
+
+static void abr_savecache (const TCHAR *path, const int size[2], const uae_u32 crc[2])
+{
+	struct abr_cacheheader hdr;
+	FILE *f = fopen(path, _T("wb"));
+
+	if (!f)
+		return;
+	memset (&hdr, 0, sizeof hdr);
+	hdr.magic = ABR_CACHE_MAGIC;
+	hdr.version = ABR_CACHE_VERSION;
+	for (int i = 0; i < 2; i++) {
+		hdr.xmlsize[i] = size[i];
+		hdr.xmlcrc32[i] = crc[i];
+	}
+	hdr.entries = abr_numentries;
+	hdr.pairs = abr_numpairs;
+	hdr.strings = abr_stringsize;
+	bool ok = fwrite (&hdr, sizeof hdr, 1, f) == 1 &&
+		fwrite (abr_entries, sizeof (struct abr_entry), abr_numentries, f) == abr_numentries &&
+		fwrite (abr_pairs, sizeof (uae_u16), abr_numpairs, f) == abr_numpairs &&
+		fwrite (abr_strings, 1, abr_stringsize, f) == abr_stringsize;
+	fclose(f);
+	if (!ok)
+		remove(path);
+}
+
+static void abr_load (void)
+{
+	TCHAR path[MAX_DPATH];
+	char *xml[2] = { NULL, NULL };
+	int size[2];
+	uae_u32 crc[2];
+	bool error = false;
+
+	abr_tried = true;
+	for (int i = 0; abr_files[i] && !error; i++) {
+		get_plugin_path(path, sizeof(path) / sizeof(TCHAR), _T("abr"));
+		_tcscat(path, abr_files[i]);
+		FILE *f = fopen(path, _T("rb"));
+		error = true;
+		if (f) {
+			fseek(f, 0, SEEK_END);
+			size[i] = ftell(f);
+			fseek(f, 0, SEEK_SET);
+			xml[i] = xmalloc (char, size[i] + 1);
+			if (xml[i] && size[i] > 0 && fread(xml[i], 1, size[i], f) == size[i]) {
+				xml[i][size[i]] = 0;
+				crc[i] = get_crc32 (xml[i], size[i]);
+				error = false;
+			}
+			fclose(f);
+		}
+	}
+	if (!error) {
+		get_plugin_path(path, sizeof(path) / sizeof(TCHAR), _T("abr"));
+		_tcscat(path, abr_cachefile);
+		if (!abr_loadcache (path, size, crc)) {
+			if (abr_compile ((const char**)xml, size)) {
+				abr_savecache (path, size, crc);
+			} else {
+				abr_free ();
+				error = true;
+			}
+		}
+	}
+	if (!error) {
+		abr_buildindex ();
+		abr_loaded = true;
+	}
+	xfree (xml[0]);
+	xfree (xml[1]);
+}
+
+static void abrcheck(struct diskinfo *di)
+{
+	if (!abr_tried)
+		abr_load ();
+	if (!abr_loaded)
+		return;
+	struct abr_entry *ae = abr_find (di);
+	if (!ae)
+		return;
+	if (ae->name >= 0) {
+		TCHAR *s = au(abr_strings + ae->name);
+		_tcscpy(di->bootblockinfo, s);
+		xfree(s);
+	}
+	if (ae->classname >= 0) {
+		TCHAR *s = au(abr_strings + ae->classname);
+		_tcscpy(di->bootblockclass, s);
+		xfree(s);
 	}
 }
 
@@ -3943,6 +4467,7 @@ int DISK_examine_image (struct uae_prefs *p, int num, struct diskinfo *di, bool
 		side = oldside;
     return 1;
 	}
+	mfmcache_idle (drv);
 	di->imagecrc32 = zfile_crc32 (drv->diskfile);
 	di->unreadable = false;
   decode_buffer (drv->bigmfmbuf, drv->cyl, 11, drv->ddhd, drv->filetype, &drvsec, sectable, 1);
@@ -4051,6 +4576,7 @@ static uae_u32 getadfcrc (drive *drv)
 
 	if (!drv->diskfile)
 		return 0;
+	mfmcache_idle (drv);
 	zfile_fseek (drv->diskfile, 0, SEEK_END);
 	size = (int)zfile_ftell (drv->diskfile);
 	b = xmalloc (uae_u8, size);
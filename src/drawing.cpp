@@ -62,6 +62,11 @@ static smp_comm_pipe *volatile render_pipe = 0;
 static uae_sem_t render_sem = 0;
 static bool volatile render_thread_busy = false;
 
+/* Line drawing state below is private to the thread drawing the line, so
+ * bands of one frame can be drawn concurrently by the band workers. */
+#define RENDER_TLS __thread
+#define MAX_RENDER_WORKERS 4
+
 extern int sprite_buffer_res;
 int lores_shift, shres_shift;
 
@@ -92,7 +97,7 @@ bool aga_mode;
    coordinates.  Zero if the resolution is the same, positive if window coordinates
    have a higher resolution (i.e. we're stretching the image), negative if window
    coordinates have a lower resolution (i.e. we're shrinking the image).  */
-static int res_shift;
+static RENDER_TLS int res_shift;
 
 static int linedbl;
 
@@ -124,24 +129,24 @@ struct spritepixelsbuf {
 	uae_u16 stfmdata;
 	uae_u16 data;
 };
-static struct spritepixelsbuf spritepixels_buffer[MAX_PIXELS_PER_LINE];
-static struct spritepixelsbuf *spritepixels;
-static int sprite_first_x, sprite_last_x;
+static RENDER_TLS struct spritepixelsbuf spritepixels_buffer[MAX_PIXELS_PER_LINE];
+static RENDER_TLS struct spritepixelsbuf *spritepixels;
+static RENDER_TLS int sprite_first_x, sprite_last_x;
 
 /* AGA mode color lookup tables */
 unsigned int xredcolors[256], xgreencolors[256], xbluecolors[256];
 static int dblpf_ind1_aga[256], dblpf_ind2_aga[256];
 
-struct color_entry colors_for_drawing;
+static RENDER_TLS struct color_entry colors_for_drawing;
 static struct color_entry direct_colors_for_drawing;
 
-static xcolnr *p_acolors;
-static xcolnr *p_xcolors;
+static RENDER_TLS xcolnr *p_acolors;
+static RENDER_TLS xcolnr *p_xcolors;
 
 /* The size of these arrays is pretty arbitrary; it was chosen to be "more
    than enough".  The coordinates used for indexing into these arrays are
    almost, but not quite, Amiga coordinates (there's a constant offset).  */
-static union pixdata_u {
+static RENDER_TLS union pixdata_u {
 	uae_u64 apixels_q[MAX_PIXELS_PER_LINE * 2 / sizeof(uae_u64)];
 	uae_u32 apixels_l[MAX_PIXELS_PER_LINE * 2 / sizeof(uae_u32)];
   uae_u8 apixels[MAX_PIXELS_PER_LINE * 2];
@@ -151,14 +156,44 @@ uae_u16 spixels[2 * MAX_SPR_PIXELS];
 
 struct sprite_stb spixstate;
 
-static uae_u32 ham_linebuf[MAX_PIXELS_PER_LINE * 2];
+static RENDER_TLS uae_u32 ham_linebuf[MAX_PIXELS_PER_LINE * 2];
 
-static uae_u8 *xlinebuffer;
+static RENDER_TLS uae_u8 *xlinebuffer;
 
 static int *amiga2aspect_line_map, *native2amiga_line_map;
 static int native2amiga_line_map_height;
 static uae_u8 **row_map;
-static uae_u8 row_tmp[MAX_PIXELS_PER_LINE * 32 / 8];
+
+/* Signature of the inputs last drawn into each output row. A line whose
+ * signature still matches, drawn into the same row buffer, is not drawn again. */
+struct line_cache_entry {
+	uae_u64 sig;
+	uae_u8 *buf;
+	int gen;
+};
+static struct line_cache_entry *line_cache;
+static int line_cache_gen = 1;
+static bool line_cache_on;
+static uae_u8 *line_cache_bufmem;
+static uae_u64 line_cache_frame_sig;
+static RENDER_TLS int band_lines_drawn, band_lines_skipped;
+static int frame_lines_drawn, frame_lines_skipped;
+static uae_u64 total_lines_drawn, total_lines_skipped;
+static int total_line_frames;
+/* Time spent drawing native lines, per gfx_render_threads setting */
+static frame_time_t frame_render_time;
+static uae_u64 total_render_time[MAX_RENDER_WORKERS + 1];
+static frame_time_t worst_render_time[MAX_RENDER_WORKERS + 1];
+static int total_render_frames[MAX_RENDER_WORKERS + 1];
+/* Lines below the screen are drawn here. Each band thread has its own,
+   row_map has NULL for those lines. */
+static RENDER_TLS uae_u8 row_tmp[MAX_PIXELS_PER_LINE * 32 / 8];
+
+STATIC_INLINE uae_u8 *row_ptr (int y)
+{
+	uae_u8 *p = row_map[y];
+	return p ? p : row_tmp;
+}
 static int max_drawn_amiga_line;
 
 /* line_draw_funcs: pfield_do_linetoscr, pfield_do_fill_line, decode_ham */
@@ -168,6 +203,7 @@ static bool screenlocked = false;
 static int next_line_to_render = 0;
 static int linestate_first_undecided = 0;
 static bool nextline_as_previous = false;
+static RENDER_TLS bool line_as_previous;
 
 uae_u8 line_data[(MAXVPOS + 2) * 2][MAX_PLANES * MAX_WORDS_PER_LINE * 2];
 
@@ -184,15 +220,15 @@ static int thisframe_y_adjust_real, max_ypos_thisframe, min_ypos_for_screen;
 /* These are generated by the drawing code from the line_decisions array for
    each line that needs to be drawn.  These are basically extracted out of
    bit fields in the hardware registers.  */
-static int bplmode, bplehb, bplham, bpldualpf, bpldualpfpri;
-static int bpldualpf2of, bplplanecnt, ecsshres;
-static int bplbypass;
-static int bplres;
-static int plf1pri, plf2pri, bplxor, bpland, bpldelay_sh;
-static uae_u32 plf_sprite_mask;
-static int sbasecol[2] = { 16, 16 };
-static int hposblank;
-static bool sprite_smaller_than_64, sprite_smaller_than_64_inuse;
+static RENDER_TLS int bplmode, bplehb, bplham, bpldualpf, bpldualpfpri;
+static RENDER_TLS int bpldualpf2of, bplplanecnt, ecsshres;
+static RENDER_TLS int bplbypass;
+static RENDER_TLS int bplres;
+static RENDER_TLS int plf1pri, plf2pri, bplxor, bpland, bpldelay_sh;
+static RENDER_TLS uae_u32 plf_sprite_mask;
+static RENDER_TLS int sbasecol[2] = { 16, 16 };
+static RENDER_TLS int hposblank;
+static RENDER_TLS bool sprite_smaller_than_64, sprite_smaller_than_64_inuse;
 
 static void set_inhibit_frame (int bit)
 {
@@ -244,8 +280,8 @@ STATIC_INLINE int res_shift_from_window (int x)
   return x << -res_shift;
 }
 
-static struct decision *dp_for_drawing;
-static struct draw_info *dip_for_drawing;
+static RENDER_TLS struct decision *dp_for_drawing;
+static RENDER_TLS struct draw_info *dip_for_drawing;
 
 STATIC_INLINE int get_shdelay_add(void)
 {
@@ -264,17 +300,17 @@ STATIC_INLINE int get_shdelay_add(void)
    where do we start drawing the playfield, where do we start drawing the right border.
    All of these are forced into the visible window (VISIBLE_LEFT_BORDER .. VISIBLE_RIGHT_BORDER).
    PLAYFIELD_START and PLAYFIELD_END are in window coordinates.  */
-static int playfield_start, playfield_end;
-static int real_playfield_start, real_playfield_end;
-static int playfield_diff;
-static int sprite_playfield_start, sprite_end;
-static int may_require_hard_way;
-static int native_ddf_left, native_ddf_right;
-
-static int pixels_offset;
-static int src_pixel;
+static RENDER_TLS int playfield_start, playfield_end;
+static RENDER_TLS int real_playfield_start, real_playfield_end;
+static RENDER_TLS int playfield_diff;
+static RENDER_TLS int sprite_playfield_start, sprite_end;
+static RENDER_TLS int may_require_hard_way;
+static RENDER_TLS int native_ddf_left, native_ddf_right;
+
+static RENDER_TLS int pixels_offset;
+static RENDER_TLS int src_pixel;
 /* How many pixels in window coordinates which are to the left of the left border.  */
-static int unpainted;
+static RENDER_TLS int unpainted;
 
 STATIC_INLINE xcolnr getbgc (int blank)
 {
@@ -622,7 +658,7 @@ static void fill_line_border (void)
 	}
 }
 
-static int sprite_shdelay;
+static RENDER_TLS int sprite_shdelay;
 static uae_u8 render_sprites (int pos, int dualpf, uae_u8 apixel, int aga)
 {
 	struct spritepixelsbuf *spb = &spritepixels[pos];
@@ -891,9 +927,9 @@ static int linetoscr_16_shrink2_sh(int spix, int dpix, int stoppos)
 
 typedef int(*call_linetoscr)(int spix, int dpix, int dpix_end);
 
-static call_linetoscr pfield_do_linetoscr_normal;
-static call_linetoscr pfield_do_linetoscr_sprite;
-static call_linetoscr pfield_do_linetoscr_spriteonly;
+static RENDER_TLS call_linetoscr pfield_do_linetoscr_normal;
+static RENDER_TLS call_linetoscr pfield_do_linetoscr_sprite;
+static RENDER_TLS call_linetoscr pfield_do_linetoscr_spriteonly;
 
 static void pfield_do_linetoscr(int start, int stop, int blank)
 {
@@ -909,8 +945,8 @@ static int pfield_do_nothing(int a, int b, int c)
 }
 
 /* AGA subpixel delay hack */
-static call_linetoscr pfield_do_linetoscr_shdelay_normal;
-static call_linetoscr pfield_do_linetoscr_shdelay_sprite;
+static RENDER_TLS call_linetoscr pfield_do_linetoscr_shdelay_normal;
+static RENDER_TLS call_linetoscr pfield_do_linetoscr_shdelay_sprite;
 
 static int pfield_do_linetoscr_normal_shdelay(int spix, int dpix, int dpix_end)
 {
@@ -1141,8 +1177,8 @@ static void dummy_worker (int start, int stop, int blank)
 {
 }
 
-static int ham_decode_pixel;
-static uae_u32 ham_lastcolor;
+static RENDER_TLS int ham_decode_pixel;
+static RENDER_TLS uae_u32 ham_lastcolor;
 
 /* Decode HAM in the invisible portion of the display (left of VISIBLE_LEFT_BORDER),
  * but don't draw anything in.  This is done to prepare HAM_LASTCOLOR for later,
@@ -1510,7 +1546,7 @@ static pfield_doline_func pfield_doline_n[9]={
 
 #else
 
-static uae_u8 *real_bplpt[8];
+static RENDER_TLS uae_u8 *real_bplpt[8];
 
 STATIC_INLINE void pfield_doline32_1(uae_u32 *pixels, int wordcount, int planes)
 {
@@ -1622,6 +1658,9 @@ void init_row_map (void)
 	if (!row_map) {
 		row_map = xmalloc(uae_u8*, max_uae_height + 1);
 	}
+	if (!line_cache) {
+		line_cache = xcalloc(struct line_cache_entry, max_uae_height + 1);
+	}
 
 	if (oldbufmem && oldbufmem == vidinfo->drawbuffer.bufmem &&
 		oldheight == vidinfo->drawbuffer.outheight &&
@@ -1629,7 +1668,7 @@ void init_row_map (void)
 		return;
 	j = oldheight == 0 ? max_uae_height : oldheight;
   for (i = vidinfo->drawbuffer.outheight; i < max_uae_height + 1 && i < j + 1; i++) {
-    row_map[i] = row_tmp;
+    row_map[i] = NULL;
   }
   for (i = 0, j = 0; i < vidinfo->drawbuffer.outheight; i++, j += vidinfo->drawbuffer.rowbytes) {
 		row_map[i] = vidinfo->drawbuffer.bufmem + j;
@@ -1820,8 +1859,8 @@ static void pfield_expand_dp_bplconx (int regno, int v)
 	set_res_shift();
 }
 
-static int drawing_color_matches;
-static enum { color_match_acolors, color_match_full } color_match_type;
+static RENDER_TLS int drawing_color_matches;
+static RENDER_TLS enum { color_match_acolors, color_match_full } color_match_type;
 
 /* Set up colors_for_drawing to the state at the beginning of the currently drawn
    line.  Try to avoid copying color tables around whenever possible.  */
@@ -1961,6 +2000,97 @@ STATIC_INLINE bool is_color_changes(struct draw_info *di)
 	return changes > 1 || (changes == 1 && regno != 0xffff && regno != -1);
 }
 
+STATIC_INLINE uae_u64 line_hash (uae_u64 h, uae_u32 v)
+{
+	return (h ^ v) * 0x100000001b3ULL;
+}
+
+static uae_u64 line_hash_buf (uae_u64 h, const uae_u8 *p, int len)
+{
+	for (; len >= 4; len -= 4, p += 4) {
+		uae_u32 v;
+		memcpy (&v, p, 4);
+		h = line_hash (h, v);
+	}
+	while (len-- > 0)
+		h = line_hash (h, *p++);
+	return h;
+}
+
+/* Everything pfield_draw_line() reads for this line, except per frame
+ * state which is in line_cache_frame_sig. */
+static uae_u64 line_signature (int lineno, int follow_ypos)
+{
+	struct decision *dp = dp_for_drawing;
+	struct draw_info *dip = dip_for_drawing;
+	struct color_entry *ce = curr_color_tables + dp->ctable;
+	uae_u64 h = line_hash (line_cache_frame_sig, follow_ypos);
+
+	h = line_hash (h, dp->plfleft);
+	h = line_hash (h, dp->plfright);
+	h = line_hash (h, dp->plflinelen);
+	h = line_hash (h, dp->diwfirstword);
+	h = line_hash (h, dp->diwlastword);
+	h = line_hash (h, dp->bplcon0 | (dp->bplcon2 << 16));
+	h = line_hash (h, dp->bplcon3 | (dp->bplcon4bm << 16));
+	h = line_hash (h, dp->bplcon4sp | (dp->fmode << 16));
+	h = line_hash (h, dp->nr_planes | (dp->bplres << 8) | (dp->ham_seen << 16) | (dp->ham_at_start << 17)
+		| (dp->bordersprite_seen << 18) | (dp->xor_seen << 19));
+
+	h = line_hash (h, ce->extra);
+	if (aga_mode)
+		h = line_hash_buf (h, (uae_u8 *)ce->color_regs_aga, sizeof ce->color_regs_aga);
+	else
+		h = line_hash_buf (h, (uae_u8 *)ce->color_regs_ecs, sizeof ce->color_regs_ecs);
+
+	h = line_hash (h, dip->nr_color_changes);
+	for (int i = dip->first_color_change; i <= dip->last_color_change; i++) {
+		h = line_hash (h, curr_color_changes[i].linepos);
+		h = line_hash (h, curr_color_changes[i].regno);
+		h = line_hash (h, curr_color_changes[i].value);
+	}
+
+	h = line_hash (h, dip->nr_sprites);
+	for (int i = 0; i < dip->nr_sprites; i++) {
+		struct sprite_entry *e = curr_sprite_entries + dip->first_sprite_entry + i;
+		int len = e->max - e->pos;
+		h = line_hash (h, e->pos | (e->max << 16));
+		h = line_hash (h, e->has_attached);
+		if (len > 0) {
+			h = line_hash_buf (h, (uae_u8 *)(spixels + e->first_pixel), len * sizeof(uae_u16));
+			h = line_hash_buf (h, spixstate.stb + e->first_pixel, len);
+			h = line_hash_buf (h, (uae_u8 *)(spixstate.stbfm + e->first_pixel), len * sizeof(uae_u16));
+		}
+	}
+
+	if (dp->plfleft >= 0) {
+		for (int i = 0; i < dp->nr_planes; i++)
+			h = line_hash_buf (h, line_data[lineno] + i * MAX_WORDS_PER_LINE * 2, dp->plflinelen * 4);
+	}
+	return h;
+}
+
+STATIC_INLINE bool line_cache_match (int row, uae_u64 sig)
+{
+	struct line_cache_entry *lc = &line_cache[row];
+	return lc->gen == line_cache_gen && lc->sig == sig && lc->buf == row_ptr (row);
+}
+
+STATIC_INLINE void line_cache_set (int row, uae_u64 sig)
+{
+	struct line_cache_entry *lc = &line_cache[row];
+	lc->sig = sig;
+	lc->buf = row_ptr (row);
+	lc->gen = line_cache_gen;
+}
+
+/* Something other than pfield_draw_line() wrote to the native screen. */
+void notice_screen_contents_lost (void)
+{
+	if (++line_cache_gen == 0)
+		line_cache_gen = 1;
+}
+
 static void pfield_draw_line (int lineno, int gfx_ypos, int follow_ypos)
 {
 	struct vidbuf_description *vidinfo = &adisplays.gfxvidinfo;
@@ -1972,15 +2102,29 @@ static void pfield_draw_line (int lineno, int gfx_ypos, int follow_ypos)
   dip_for_drawing = curr_drawinfo + lineno;
 
   if(currprefs.gfx_vresolution && !interlace_seen) {
-    if(nextline_as_previous) {
-      nextline_as_previous = false;
+    if(line_as_previous) {
+      line_as_previous = false;
       return;
     }
-    nextline_as_previous = true;
+    line_as_previous = true;
     if(follow_ypos >= 0) {
       do_double = 1;
 		}
   }
+
+	if (line_cache_on) {
+		int follow = do_double ? follow_ypos : -1;
+		uae_u64 sig = line_signature (lineno, follow);
+		if (line_cache_match (gfx_ypos, sig) && (follow < 0 || line_cache_match (follow, sig))) {
+			band_lines_skipped++;
+			return;
+		}
+		line_cache_set (gfx_ypos, sig);
+		if (follow >= 0)
+			line_cache_set (follow, sig);
+	}
+	band_lines_drawn++;
+
 	if (dp_for_drawing->plfleft < 0) {
 		border = 1;
 	}
@@ -1988,7 +2132,7 @@ static void pfield_draw_line (int lineno, int gfx_ypos, int follow_ypos)
 	have_color_changes = is_color_changes(dip_for_drawing);
 	sprite_smaller_than_64_inuse = false;
    
-  xlinebuffer = row_map[gfx_ypos];
+  xlinebuffer = row_ptr (gfx_ypos);
 	xlinebuffer -= linetoscr_x_adjust_pixbytes;
 
 	if (border == 0) {
@@ -2046,7 +2190,7 @@ static void pfield_draw_line (int lineno, int gfx_ypos, int follow_ypos)
 			do_color_changes (pfield_do_fill_line, dip_for_drawing->nr_sprites ? pfield_do_linetoscr_spr : pfield_do_linetoscr);
 
 		if (do_double) {
-			memcpy (row_map[follow_ypos], row_map[gfx_ypos], vidinfo->drawbuffer.pixbytes * vidinfo->drawbuffer.outwidth);
+			memcpy (row_ptr (follow_ypos), row_ptr (gfx_ypos), vidinfo->drawbuffer.pixbytes * vidinfo->drawbuffer.outwidth);
 		}
 
 		if (dip_for_drawing->nr_sprites) {
@@ -2080,7 +2224,7 @@ static void pfield_draw_line (int lineno, int gfx_ypos, int follow_ypos)
       }
 
 			if (do_double) {
-				xlinebuffer = row_map[follow_ypos] - linetoscr_x_adjust_pixbytes;
+				xlinebuffer = row_ptr (follow_ypos) - linetoscr_x_adjust_pixbytes;
 				fill_line_border();
 			}
 			return;
@@ -2101,7 +2245,7 @@ static void pfield_draw_line (int lineno, int gfx_ypos, int follow_ypos)
 		}
 
 		if (do_double) {
-			memcpy (row_map[follow_ypos], row_map[gfx_ypos], vidinfo->drawbuffer.pixbytes * vidinfo->drawbuffer.outwidth);
+			memcpy (row_ptr (follow_ypos), row_ptr (gfx_ypos), vidinfo->drawbuffer.pixbytes * vidinfo->drawbuffer.outwidth);
 		}
 
 	}
@@ -2149,8 +2293,6 @@ static void init_drawing_frame (void)
   nextline_as_previous = false;
 
   center_image ();
-
-  drawing_color_matches = -1;
 }
 
 static uae_u8 *status_line_ptr(int line)
@@ -2168,33 +2310,186 @@ static void draw_status_line (int line, int statusy)
   draw_status_line_single (buf, vidinfo->drawbuffer.pixbytes, statusy, vidinfo->drawbuffer.outwidth, xredcolors, xgreencolors, xbluecolors);
 }
 
+struct render_band {
+	int first, last;
+	bool as_previous;
+	int drawn, skipped;
+};
+static struct render_band render_bands[MAX_RENDER_WORKERS];
+static uae_thread_id render_worker_tid[MAX_RENDER_WORKERS];
+static uae_sem_t render_worker_sem[MAX_RENDER_WORKERS];
+static uae_sem_t render_band_done_sem = 0;
+static int render_workers = 0;
+static bool volatile render_workers_quit = false;
+
+/* Bands shorter than this are not worth waking up a worker for */
+#define MIN_BAND_LINES 8
+
+static void draw_band (struct render_band *band)
+{
+	// Colors and line renderers may be stale in this thread, start from scratch.
+	drawing_color_matches = -1;
+	line_as_previous = band->as_previous;
+	pfield_set_linetoscr ();
+	band_lines_drawn = 0;
+	band_lines_skipped = 0;
+
+	for (int i = band->first; i < band->last; i++) {
+		int i1 = i + min_ypos_for_screen;
+		int whereline = amiga2aspect_line_map[i1];
+		int wherenext = amiga2aspect_line_map[i1 + 1];
+
+		if (whereline < 0)
+			continue;
+
+		hposblank = 0;
+		pfield_draw_line (i + thisframe_y_adjust_real, whereline, wherenext);
+	}
+	band->drawn = band_lines_drawn;
+	band->skipped = band_lines_skipped;
+}
+
+static int render_worker_thread (void *arg)
+{
+	int w = (int)(uintptr_t)arg;
+
+	for (;;) {
+		uae_sem_wait (&render_worker_sem[w]);
+		if (render_workers_quit)
+			break;
+		draw_band (&render_bands[w]);
+		uae_sem_post (&render_band_done_sem);
+	}
+	return 0;
+}
+
+static void start_render_workers (int count)
+{
+	if (render_band_done_sem == 0)
+		uae_sem_init (&render_band_done_sem, 0, 0);
+	while (render_workers < count) {
+		int w = render_workers + 1;
+		uae_sem_init (&render_worker_sem[w], 0, 0);
+		if (!uae_start_thread (_T("render band"), render_worker_thread, (void *)(uintptr_t)w, &render_worker_tid[w])) {
+			uae_sem_destroy (&render_worker_sem[w]);
+			render_worker_sem[w] = 0;
+			break;
+		}
+		render_workers = w;
+	}
+}
+
+static void stop_render_workers (void)
+{
+	render_workers_quit = true;
+	for (int w = 1; w <= render_workers; w++) {
+		uae_sem_post (&render_worker_sem[w]);
+		uae_wait_thread (render_worker_tid[w]);
+		render_worker_tid[w] = 0;
+		uae_sem_destroy (&render_worker_sem[w]);
+		render_worker_sem[w] = 0;
+	}
+	render_workers = 0;
+	render_workers_quit = false;
+	if (render_band_done_sem) {
+		uae_sem_destroy (&render_band_done_sem);
+		render_band_done_sem = 0;
+	}
+}
+
+/* Draw all lines from next_line_to_render up to the first undecided one.
+ * The lines are split into bands; the calling thread draws the first band
+ * and the band workers draw the others concurrently. */
+static void draw_decided_lines (void)
+{
+	struct vidbuf_description *vidinfo = &adisplays.gfxvidinfo;
+	int undecided = linestate_first_undecided;
+	int first = next_line_to_render;
+	int last;
+
+	for (last = first; last < max_ypos_thisframe; last++) {
+		if (amiga2aspect_line_map[last + min_ypos_for_screen] >= vidinfo->drawbuffer.outheight
+			|| last + thisframe_y_adjust_real >= undecided)
+			break;
+	}
+	if (last == first)
+		return;
+	frame_time_t render_start = read_processor_time ();
+
+	/* rows hold what was drawn into them only if the same surface comes back */
+	line_cache_on = currprefs.gfx_line_cache && line_cache != NULL && !vidinfo->drawbuffer.double_buffered;
+	if (line_cache_on) {
+		if (vidinfo->drawbuffer.bufmem != line_cache_bufmem) {
+			notice_screen_contents_lost ();
+			line_cache_bufmem = vidinfo->drawbuffer.bufmem;
+		}
+		uae_u64 h = line_hash (0xcbf29ce484222325ULL, visible_left_border);
+		h = line_hash (h, visible_right_border);
+		h = line_hash (h, linetoscr_x_adjust_pixbytes);
+		h = line_hash (h, lores_shift);
+		h = line_hash (h, sprite_buffer_res);
+		h = line_hash (h, currprefs.chipset_mask);
+		h = line_hash (h, currprefs.gfx_resolution);
+		h = line_hash (h, vidinfo->drawbuffer.pixbytes);
+		h = line_hash (h, vidinfo->drawbuffer.outwidth);
+		line_cache_frame_sig = h;
+	}
+
+	int bands = currprefs.gfx_render_threads;
+	if (bands > MAX_RENDER_WORKERS)
+		bands = MAX_RENDER_WORKERS;
+	if (bands > (last - first) / MIN_BAND_LINES)
+		bands = (last - first) / MIN_BAND_LINES;
+	if (bands > 1 && render_workers < bands - 1)
+		start_render_workers (bands - 1);
+	if (bands > render_workers + 1)
+		bands = render_workers + 1;
+	if (bands < 1)
+		bands = 1;
+
+	// With line doubling, every second drawn line is skipped. Work out
+	// where each band is within that sequence.
+	bool pairs = currprefs.gfx_vresolution && !interlace_seen;
+	int start = first;
+	for (int w = 0; w < bands; w++) {
+		struct render_band *band = &render_bands[w];
+		band->first = start;
+		band->last = w == bands - 1 ? last : first + (last - first) * (w + 1) / bands;
+		band->as_previous = nextline_as_previous;
+		if (pairs) {
+			for (int i = band->first; i < band->last; i++) {
+				if (amiga2aspect_line_map[i + min_ypos_for_screen] >= 0)
+					nextline_as_previous = !nextline_as_previous;
+			}
+		}
+		start = band->last;
+	}
+
+	for (int w = 1; w < bands; w++)
+		uae_sem_post (&render_worker_sem[w]);
+	draw_band (&render_bands[0]);
+	for (int w = 1; w < bands; w++)
+		uae_sem_wait (&render_band_done_sem);
+	for (int w = 0; w < bands; w++) {
+		frame_lines_drawn += render_bands[w].drawn;
+		frame_lines_skipped += render_bands[w].skipped;
+	}
+
+	next_line_to_render = last;
+	frame_render_time += read_processor_time () - render_start;
+}
+
 static void partial_draw_frame(void)
 {
   struct amigadisplay *ad = &adisplays;
 	if (ad->framecnt == 0) {
-	  struct vidbuf_description *vidinfo = &ad->gfxvidinfo;
-  	struct vidbuffer *vb = &vidinfo->drawbuffer;
-
     if(!screenlocked) {
     	if(!lockscr())
         return;
       screenlocked = true;
     }
   
-  	for (; next_line_to_render < max_ypos_thisframe; ++next_line_to_render) {
-		  int i1 = next_line_to_render + min_ypos_for_screen;
-  		int line = next_line_to_render + thisframe_y_adjust_real;
-		  int whereline = amiga2aspect_line_map[i1];
-		  int wherenext = amiga2aspect_line_map[i1 + 1];
-
-	    if (whereline >= vb->outheight || line >= linestate_first_undecided)
-  			break;
-	    if (whereline < 0)
-		    continue;
-
-		  hposblank = 0;
-  		pfield_draw_line (line, whereline, wherenext);
-  	}
+    draw_decided_lines ();
   }
 }
 
@@ -2216,25 +2511,14 @@ static void finish_drawing_frame (void)
     screenlocked = true;
   }
 
-	for (int i = next_line_to_render; i < max_ypos_thisframe; i++) {
-    int i1 = i + min_ypos_for_screen;
-		int line = i + thisframe_y_adjust_real;
-    int whereline = amiga2aspect_line_map[i1];
-    int wherenext = amiga2aspect_line_map[i1 + 1];
-
-    if (whereline >= vb->outheight || line >= linestate_first_undecided)
-			break;
-    if (whereline < 0)
-      continue;
-
-    hposblank = 0;
-		pfield_draw_line (line, whereline, wherenext);
-	}
+  draw_decided_lines ();
   
 	if (currprefs.leds_on_screen & STATUSLINE_CHIPSET) {
 		for (int i = 0; i < TD_TOTAL_HEIGHT; i++) {
 			int line = vidinfo->drawbuffer.outheight - TD_TOTAL_HEIGHT + i;
 			draw_status_line (line, i);
+			if (line_cache)
+				line_cache[line].gen = 0;
 		}
 	}
 
@@ -2242,11 +2526,29 @@ static void finish_drawing_frame (void)
 	if (currprefs.cs_cd32fmv) {
 		if (cd32_fmv_active) {
 			cd32_fmv_genlock(vb, &vidinfo->drawbuffer);
+			notice_screen_contents_lost ();
     }
   }
 
 	do_flush_screen ();
   next_line_to_render = 0;
+
+	total_lines_drawn += frame_lines_drawn;
+	total_lines_skipped += frame_lines_skipped;
+	total_line_frames++;
+	frame_lines_drawn = 0;
+	frame_lines_skipped = 0;
+
+	int threads = currprefs.gfx_render_threads;
+	if (threads < 0)
+		threads = 0;
+	if (threads > MAX_RENDER_WORKERS)
+		threads = MAX_RENDER_WORKERS;
+	total_render_time[threads] += frame_render_time;
+	if (frame_render_time > worst_render_time[threads])
+		worst_render_time[threads] = frame_render_time;
+	total_render_frames[threads]++;
+	frame_render_time = 0;
 }
 
 void check_prefs_picasso(void)
@@ -2270,6 +2572,7 @@ void check_prefs_picasso(void)
 
   gfx_set_picasso_state (ad->picasso_on);
   picasso_enablescreen (ad->picasso_requested_on);
+  notice_screen_contents_lost ();
 
   notice_new_xcolors ();
   count_frame ();
@@ -2319,6 +2622,16 @@ void vsync_handle_redraw (void)
       render_pipe = 0;
       uae_sem_destroy(&render_sem);
       render_sem = 0;
+      stop_render_workers();
+      if (total_line_frames)
+        write_log(_T("Native lines: %d frames, %llu drawn, %llu unchanged and skipped (%llu/%llu per frame)\n"),
+          total_line_frames, total_lines_drawn, total_lines_skipped,
+          total_lines_drawn / total_line_frames, total_lines_skipped / total_line_frames);
+      for (int i = 0; i <= MAX_RENDER_WORKERS; i++) {
+        if (total_render_frames[i])
+          write_log(_T("Render threads %d: %d frames, %llu us per frame, worst %u us\n"),
+            i, total_render_frames[i], total_render_time[i] / total_render_frames[i], worst_render_time[i]);
+      }
     }
 
 		quit_program = -quit_program;
@@ -2384,6 +2697,7 @@ void reset_drawing (void)
   init_aspect_maps ();
 
   init_row_map();
+  notice_screen_contents_lost ();
 
   memset(spixels, 0, sizeof spixels);
   memset(&spixstate, 0, sizeof spixstate);
@@ -111,6 +111,8 @@ void do_cycles_cpu_norm (uae_u32 cycles_to_add)
 
 do_cycles_func do_cycles = do_cycles_cpu_norm;
 
+static int misc_recursive;
+
 void MISC_handler(void)
 {
 	static bool dorecheck;
@@ -118,13 +120,12 @@ void MISC_handler(void)
 	int i;
   evt mintime;
   evt ct = get_cycles();
-  static int recursive;
 
-	if (recursive) {
+	if (misc_recursive) {
 		dorecheck = true;
 	  return;
 	}
-  recursive++;
+  misc_recursive++;
   eventtab[ev_misc].active = 0;
 	recheck = true;
 	while (recheck) {
@@ -152,7 +153,7 @@ void MISC_handler(void)
 	  eventtab[ev_misc].evtime = ct + mintime;
 	  events_schedule();
   }
-  recursive--;
+  misc_recursive--;
 }
 
 
@@ -184,6 +185,18 @@ void event2_newevent_xx (int no, evt t, uae_u32 data, evfunc2 func)
 	eventtab2[no].evtime = et;
 	eventtab2[no].handler = func;
 	eventtab2[no].data = data;
+
+	/* ev_misc always fires at or before the earliest active ev2 event.
+	 * If it is still in the future and the new event is not earlier,
+	 * a full MISC_handler() rescan would find nothing to do. */
+	if (!misc_recursive && eventtab[ev_misc].active) {
+		evt ct = get_cycles ();
+		evt misctime = eventtab[ev_misc].evtime - ct;
+		if (misctime != 0 && misctime <= et - ct) {
+			events_schedule ();
+			return;
+		}
+	}
 	MISC_handler ();
 }
 
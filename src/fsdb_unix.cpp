@@ -82,7 +82,7 @@ int fsdb_fill_file_attrs (a_inode *base, a_inode *aino)
 		  | (S_IWUSR & statbuf.st_mode ? 0 : A_FIBF_WRITE)
 		  | (S_IRUSR & statbuf.st_mode ? 0 : A_FIBF_READ));
 
-#if defined(WIN32) || defined(ANDROIDSDL) || defined(RASPBERRY)
+#if defined(WIN32) || defined(ANDROIDSDL) || defined(RASPBERRY) || defined(HEADLESS)
   // Always give execute & read permission
   // Temporary do this for raspberry...
   aino->amigaos_mode &= ~A_FIBF_EXECUTE;
@@ -31,6 +31,21 @@
 #define ASYNC_REQUEST_TEMP 1
 #define ASYNC_REQUEST_CHANGEINT 10
 
+/* Reads and writes are handed to a pool of I/O threads per unit so that
+ * several requests can be in flight, other commands wait for them. */
+#define HARDFILE_IO_THREADS 4
+#define HARDFILE_IO_QUEUE 16
+
+struct hardfile_iojob {
+	int state; /* 0 = free, 1 = queued, 2 = running */
+	unsigned int seq;
+	TrapContext *ctx;
+	uae_u8 *iobuf;
+	uaecptr request;
+	uae_u64 offset, len;
+	bool write;
+};
+
 struct hardfileprivdata {
 	uaecptr d_request[MAX_ASYNC_REQUESTS];
 	uae_u8 *d_request_iobuf[MAX_ASYNC_REQUESTS];
@@ -45,6 +60,13 @@ struct hardfileprivdata {
   uaecptr changeint;
 	struct scsi_data *sd;
 	bool directorydrive;
+	struct hardfile_iojob iojobs[HARDFILE_IO_QUEUE];
+	unsigned int ioseq;
+	int io_threads;
+	uae_thread_id io_tid[HARDFILE_IO_THREADS];
+	uae_sem_t io_lock;
+	uae_sem_t io_avail;
+	uae_sem_t io_done;
 };
 
 #define HFD_VHD_DYNAMIC 3
@@ -1586,6 +1608,7 @@ int scsi_hd_emulate (struct hardfiledata *hfd, struct hd_hardfiledata *hdhfd, ua
 	case 0x35: /* SYNCRONIZE CACHE (10) */
 		if (nodisk (hfd))
 			goto nodisk;
+		hdf_flush_target (hfd);
 		scsi_len = 0;
 		break;
 	case 0xa8: /* READ (12) */
@@ -2178,8 +2201,12 @@ static uae_u32 hardfile_do_io (TrapContext *ctx, struct hardfiledata *hfd, struc
     actual = hfd->drive_empty ? 1 :0;
   	break;
 
-	  /* Some commands that just do nothing and return zero */
 	case CMD_UPDATE:
+		if (!nodisk (hfd))
+			hdf_flush_target (hfd);
+		break;
+
+	  /* Some commands that just do nothing and return zero */
 	case CMD_CLEAR:
 	case CMD_MOTOR:
 	case CMD_SEEK:
@@ -2367,24 +2394,213 @@ static uae_u32 REGPARAM2 hardfile_beginio (TrapContext *ctx)
   }
 }
 
+static int hardfile_io_thread (void *devs)
+{
+	struct hardfileprivdata *hfpd = (struct hardfileprivdata *)devs;
+
+	for (;;) {
+		struct hardfile_iojob *job = NULL;
+		uae_sem_wait (&hfpd->io_avail);
+		uae_sem_wait (&hfpd->io_lock);
+		for (int i = 0; i < HARDFILE_IO_QUEUE; i++) {
+			struct hardfile_iojob *j = &hfpd->iojobs[i];
+			if (j->state == 1 && (!job || (int)(j->seq - job->seq) < 0))
+				job = j;
+		}
+		if (job)
+			job->state = 2;
+		uae_sem_post (&hfpd->io_lock);
+		if (!job)
+			continue;
+		if (!job->request) {
+			uae_sem_wait (&hfpd->io_lock);
+			job->state = 0;
+			uae_sem_post (&hfpd->io_lock);
+			uae_sem_post (&hfpd->io_done);
+			return 0;
+		}
+		/* the I/O itself runs outside change_sem */
+		if (hardfile_do_io(job->ctx, get_hardfile_data_controller(hfpd - &hardfpd[0]), hfpd, job->iobuf, job->request) == 0) {
+			put_byte_host(job->iobuf + 30, get_byte_host(job->iobuf + 30) & ~1);
+			trap_put_bytes(job->ctx, job->iobuf + 8, job->request + 8, 48 - 8);
+			uae_sem_wait (&change_sem);
+			release_async_request (hfpd, job->request);
+			uae_ReplyMsg (job->request);
+			uae_sem_post (&change_sem);
+		} else {
+			trap_put_bytes(job->ctx, job->iobuf + 8, job->request + 8, 48 - 8);
+		}
+		uae_sem_wait (&hfpd->io_lock);
+		job->state = 0;
+		uae_sem_post (&hfpd->io_lock);
+		uae_sem_post (&hfpd->io_done);
+	}
+}
+
+/* Block range of a read or write request, false for other commands */
+static bool hardfile_io_range (uae_u8 *iobuf, uae_u64 *offset, uae_u64 *len, bool *write)
+{
+	int cmd = get_word_host(iobuf + 28);
+
+	*len = get_long_host(iobuf + 36);
+	*offset = get_long_host(iobuf + 44);
+	switch (cmd)
+	{
+	case CMD_READ:
+		*write = false;
+		return true;
+	case CMD_WRITE:
+	case CMD_FORMAT:
+		*write = true;
+		return true;
+#if HDF_SUPPORT_TD64
+	case TD_READ64:
+#endif
+#if HDF_SUPPORT_NSD
+	case NSCMD_TD_READ64:
+#endif
+#if defined(HDF_SUPPORT_NSD) || defined(HDF_SUPPORT_TD64)
+		*offset |= (uae_u64)get_long_host(iobuf + 32) << 32;
+		*write = false;
+		return true;
+#endif
+#if HDF_SUPPORT_TD64
+	case TD_WRITE64:
+	case TD_FORMAT64:
+#endif
+#if HDF_SUPPORT_NSD
+	case NSCMD_TD_WRITE64:
+	case NSCMD_TD_FORMAT64:
+#endif
+#if defined(HDF_SUPPORT_NSD) || defined(HDF_SUPPORT_TD64)
+		*offset |= (uae_u64)get_long_host(iobuf + 32) << 32;
+		*write = true;
+		return true;
+#endif
+	}
+	return false;
+}
+
+/* Wait until no job is in flight */
+static void hardfile_io_drain (struct hardfileprivdata *hfpd)
+{
+	for (;;) {
+		bool busy = false;
+		uae_sem_wait (&hfpd->io_lock);
+		for (int i = 0; i < HARDFILE_IO_QUEUE; i++) {
+			if (hfpd->iojobs[i].state)
+				busy = true;
+		}
+		uae_sem_post (&hfpd->io_lock);
+		if (!busy)
+			return;
+		uae_sem_wait (&hfpd->io_done);
+	}
+}
+
+/* Queue a read or write for the I/O threads. A request that overlaps a
+ * write in flight, or a write that overlaps anything in flight, waits
+ * for it so the order of dependent requests is kept. */
+static bool hardfile_io_queue (struct hardfileprivdata *hfpd, TrapContext *ctx, uae_u8 *iobuf, uaecptr request)
+{
+	struct hardfiledata *hfd = get_hardfile_data_controller(hfpd - &hardfpd[0]);
+	uae_u64 offset, len;
+	bool write;
+
+	if (!hfpd->io_threads || !hfd || vdisk(hfpd) || hfd->hfd_type == HFD_VHD_DYNAMIC)
+		return false;
+	if (!hardfile_io_range (iobuf, &offset, &len, &write))
+		return false;
+	for (;;) {
+		struct hardfile_iojob *job = NULL;
+		bool conflict = false;
+		uae_sem_wait (&hfpd->io_lock);
+		for (int i = 0; i < HARDFILE_IO_QUEUE; i++) {
+			struct hardfile_iojob *j = &hfpd->iojobs[i];
+			if (!j->state) {
+				if (!job)
+					job = j;
+			} else if ((write || j->write) && offset < j->offset + j->len && j->offset < offset + len) {
+				conflict = true;
+			}
+		}
+		if (job && !conflict) {
+			job->ctx = ctx;
+			job->iobuf = iobuf;
+			job->request = request;
+			job->offset = offset;
+			job->len = len;
+			job->write = write;
+			job->seq = ++hfpd->ioseq;
+			job->state = 1;
+			uae_sem_post (&hfpd->io_lock);
+			uae_sem_post (&hfpd->io_avail);
+			return true;
+		}
+		uae_sem_post (&hfpd->io_lock);
+		uae_sem_wait (&hfpd->io_done);
+	}
+}
+
+static void hardfile_io_start (struct hardfileprivdata *hfpd)
+{
+	uae_sem_init (&hfpd->io_lock, 0, 1);
+	uae_sem_init (&hfpd->io_avail, 0, 0);
+	uae_sem_init (&hfpd->io_done, 0, 0);
+	hfpd->io_threads = 0;
+	for (int i = 0; i < HARDFILE_IO_THREADS; i++) {
+		if (!uae_start_thread (_T("hardfile_io"), hardfile_io_thread, hfpd, &hfpd->io_tid[i]))
+			break;
+		hfpd->io_threads++;
+	}
+}
+
+static void hardfile_io_stop (struct hardfileprivdata *hfpd)
+{
+	hardfile_io_drain (hfpd);
+	for (int i = 0; i < hfpd->io_threads; i++) {
+		uae_sem_wait (&hfpd->io_lock);
+		struct hardfile_iojob *job = &hfpd->iojobs[i];
+		memset (job, 0, sizeof (struct hardfile_iojob));
+		job->seq = ++hfpd->ioseq;
+		job->state = 1;
+		uae_sem_post (&hfpd->io_lock);
+		uae_sem_post (&hfpd->io_avail);
+	}
+	for (int i = 0; i < hfpd->io_threads; i++)
+		uae_wait_thread (hfpd->io_tid[i]);
+	hfpd->io_threads = 0;
+	uae_sem_destroy (&hfpd->io_lock);
+	uae_sem_destroy (&hfpd->io_avail);
+	uae_sem_destroy (&hfpd->io_done);
+}
+
 static int hardfile_thread (void *devs)
 {
   struct hardfileprivdata *hfpd = (struct hardfileprivdata *)devs;
 
   uae_set_thread_priority (NULL, 1);
+  hardfile_io_start (hfpd);
   hfpd->thread_running = 1;
   uae_sem_post (&hfpd->sync_sem);
   for (;;) {
 		TrapContext *ctx = (TrapContext*)read_comm_pipe_pvoid_blocking(&hfpd->requests);
 		uae_u8  *iobuf = (uae_u8*)read_comm_pipe_pvoid_blocking(&hfpd->requests);
   	uaecptr request = (uaecptr)read_comm_pipe_u32_blocking (&hfpd->requests);
-  	uae_sem_wait (&change_sem);
+		if (request && hardfile_io_queue (hfpd, ctx, iobuf, request))
+			continue;
+		/* other commands see all earlier reads and writes done */
+		hardfile_io_drain (hfpd);
     if (!request) {
+			hardfile_io_stop (hfpd);
+	  	uae_sem_wait (&change_sem);
 	    hfpd->thread_running = 0;
 	    uae_sem_post (&hfpd->sync_sem);
 	    uae_sem_post (&change_sem);
 	    return 0;
-		} else if (hardfile_do_io(ctx, get_hardfile_data_controller(hfpd - &hardfpd[0]), hfpd, iobuf, request) == 0) {
+		}
+  	uae_sem_wait (&change_sem);
+		if (hardfile_do_io(ctx, get_hardfile_data_controller(hfpd - &hardfpd[0]), hfpd, iobuf, request) == 0) {
 			put_byte_host(iobuf + 30, get_byte_host(iobuf + 30) & ~1);
 			trap_put_bytes(ctx, iobuf + 8, request + 8, 48 - 8);
 	    release_async_request (hfpd, request);
@@ -229,6 +229,7 @@ extern void drawing_init (void);
 extern bool notice_interlace_seen (bool);
 extern void redraw_frame(void);
 extern void check_prefs_picasso(void);
+extern void notice_screen_contents_lost (void);
 
 /* Finally, stuff that shouldn't really be shared.  */
 
@@ -88,6 +88,25 @@ STATIC_INLINE void cycles_do_special (void)
 	}
 }
 
+/* Inline fast path for the interpreter loops. Most instructions finish
+   before the next event is due, so only the counters need updating and
+   the call through do_cycles can be skipped. */
+STATIC_INLINE void do_cycles_fast (uae_u32 cycles_to_add)
+{
+	if (do_cycles == do_cycles_cpu_norm) {
+		if ((nextevent - currcycle) > cycles_to_add) {
+			currcycle += cycles_to_add;
+			return;
+		}
+	} else if (do_cycles == do_cycles_cpu_fastest) {
+		if (regs.pissoff > (uae_s32)cycles_to_add) {
+			regs.pissoff -= cycles_to_add;
+			return;
+		}
+	}
+	do_cycles (cycles_to_add);
+}
+
 STATIC_INLINE void do_extra_cycles (uae_u32 cycles_to_add)
 {
 	regs.pissoff -= cycles_to_add;
@@ -464,6 +464,7 @@ extern cpuop_func *cpufunctbl[65536] ASM_SYM_FOR_FUNC ("cpufunctbl");
 extern void flush_icache(int);
 extern void flush_icache_hard(int);
 extern void compemu_reset(void);
+extern void compemu_profile_report(void);
 #else
 #define flush_icache(int) do {} while (0)
 #define flush_icache_hard(int) do {} while (0)
@@ -275,6 +275,7 @@ struct uae_prefs {
   int sound_stereo_separation;
   int sound_mixed_stereo_delay;
   int sound_freq;
+  int sound_maxbsiz;
   int sound_interpol;
   int sound_filter;
   int sound_filter_type;
@@ -283,10 +284,14 @@ struct uae_prefs {
 
 	bool compfpu;
   int cachesize;
+	bool comp_persist;
+	bool comp_profile;
 	bool fpu_strict;
 
 	struct monconfig gfx_monitor;
   int gfx_framerate;
+	int gfx_render_threads;
+	bool gfx_line_cache;
 	struct apmode gfx_apmode[2];
   int gfx_resolution;
  	int gfx_vresolution;
@@ -312,8 +317,15 @@ struct uae_prefs {
 	int cd_speed;
 	int boot_rom;
 	int turbo_emulation;
+	bool statecapture;
+	int statecapturerate;
+	int statecapturebuffersize;
+	int statefile_compress;
+	bool statefile_incremental;
+	bool statefile_async;
 	int filesys_limit;
 	int filesys_max_name;
+	bool hardfile_mmap;
 
 	int cs_compatible;
 	int cs_ciaatod;
@@ -394,7 +406,7 @@ struct uae_prefs {
   int pandora_tapDelay;
 #endif
     
-#ifdef RASPBERRY
+#if defined(RASPBERRY) || defined(HEADLESS)
   int gfx_correct_aspect;
   int gfx_fullscreen_ratio;
   int kbd_led_num;
@@ -402,6 +414,13 @@ struct uae_prefs {
   int kbd_led_cap;
 #endif
 
+#ifdef HEADLESS
+  int headless_dump_interval;
+  bool headless_dump_crc;
+  int headless_max_frames;
+  TCHAR headless_dump_path[MAX_DPATH];
+#endif
+
   /* input */
 
 	struct jport jports[MAX_JPORTS];
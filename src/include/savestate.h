@@ -191,6 +191,9 @@ extern void savestate_restore_final(void);
 extern void custom_prepare_savestate (void);
 
 extern bool savestate_check (void);
+extern void savestate_capture (bool force);
+extern void savestate_rewind (void);
+extern void savestate_free_records (void);
 
 #define STATE_SAVE 1
 #define STATE_RESTORE 2
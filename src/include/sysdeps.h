@@ -288,7 +288,7 @@ struct direct
 
 #endif /* _WIN32 */
 
-#if defined(PANDORA) || defined(RASPBERRY)
+#if defined(PANDORA) || defined(RASPBERRY) || defined(HEADLESS)
 
 #include <ctype.h>
 
@@ -304,7 +304,7 @@ struct direct
 #define REGPARAM3 
 #define REGPARAM
 
-#endif /* defined(PANDORA) || defined(RASPBERRY) */
+#endif /* defined(PANDORA) || defined(RASPBERRY) || defined(HEADLESS) */
 
 #ifdef DONT_HAVE_POSIX
 
@@ -50,6 +50,8 @@ struct vidbuffer
 	/* size of max visible image */
   int outwidth;
   int outheight;
+	/* bufmem is one of several surfaces shown in turn */
+	bool double_buffered;
 };
 
 extern int max_uae_width, max_uae_height;
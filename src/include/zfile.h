@@ -73,6 +73,9 @@ extern TCHAR *zfile_getfilename (struct zfile *f);
 extern uae_u32 zfile_crc32 (struct zfile *f);
 extern struct zfile *zfile_dup (struct zfile *f);
 extern struct zfile *zfile_gunzip (struct zfile *z);
+typedef int (*zfile_zwrite_func) (void *ud, const uae_u8 *data, int len);
+extern int zfile_zcompress (zfile_zwrite_func write, void *ud, const uae_u8 *src, int size, int level);
+extern int zfile_zuncompress (uae_u8 *dst, int dstsize, struct zfile *src, int srcsize);
 extern int zfile_is_diskimage (const TCHAR *name);
 extern int iszip (struct zfile *z);
 extern struct zfile *zuncompress (struct znode*, struct zfile *z, int dodefault, int mask, int *retcode, int index);
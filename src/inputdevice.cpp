@@ -2434,6 +2434,14 @@ static bool inputdevice_handle_inputcode2(int code, int state, const TCHAR *s)
 	  changed_prefs.leds_on_screen = currprefs.leds_on_screen;
 	  set_config_changed ();
 	  break;
+#ifdef JIT
+	case AKS_JITPROFILE:
+		compemu_profile_report ();
+		break;
+#endif
+	case AKS_STATEREWIND:
+		savestate_rewind ();
+		break;
   }
 end:
 	if (tracer_enable) {
@@ -293,6 +293,15 @@ LOWFUNC(WRITE,RMW,1,compemu_raw_dec_m,(MEMRW d))
 }
 LENDFUNC(WRITE,RMW,1,compemu_raw_dec_m,(MEMRW ds))
 
+LOWFUNC(NONE,RMW,1,compemu_raw_inc_m,(MEMRW d))
+{
+  LOAD_U32(REG_WORK1, d);
+  LDR_rR(REG_WORK2, REG_WORK1);
+  ADD_rri(REG_WORK2, REG_WORK2, 1);
+  STR_rR(REG_WORK2, REG_WORK1);
+}
+LENDFUNC(NONE,RMW,1,compemu_raw_inc_m,(MEMRW d))
+
 STATIC_INLINE void compemu_raw_call(uintptr t)
 {
   LOAD_U32(REG_WORK1, t);
@@ -16,6 +16,8 @@ bool check_prefs_changed_comp (bool checkonly)
 
 	currprefs.compfpu = changed_prefs.compfpu;
 	currprefs.fpu_strict = changed_prefs.fpu_strict;
+	currprefs.comp_persist = changed_prefs.comp_persist;
+	currprefs.comp_profile = changed_prefs.comp_profile;
 
   if (currprefs.cachesize != changed_prefs.cachesize) {
 	  currprefs.cachesize = changed_prefs.cachesize;
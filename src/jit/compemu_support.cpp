@@ -36,11 +36,13 @@
 #if defined(JIT)
 
 #include "options.h"
+#include "uae.h"
 #include "include/memory.h"
 #include "newcpu.h"
 #include "custom.h"
 #include "comptbl.h"
 #include "compemu.h"
+#include "crc32.h"
 #include <SDL.h>
 
 #include "compemu_prefs.cpp"
@@ -129,6 +131,86 @@ static int branch_cc;
 uae_u8* current_compile_p = NULL;
 static uae_u8* max_compile_start;
 uae_u8* compiled_code = NULL;
+
+/* The translation cache is split into segments which are filled one after
+ * the other. When the last one is full, the oldest segment is recycled and
+ * only the blocks living in it are thrown away, instead of flushing the
+ * whole cache. Caches too small to split use a single segment and fall
+ * back to a hard flush.
+ */
+#define JIT_CACHE_SEGMENTS     4
+#define JIT_CACHE_SEGMENT_MIN  (128 * 1024)
+static int cache_segments = 1;
+static uae_u32 cache_segment_size = 0;
+static int current_segment = 0;
+
+/* hits and misses count the lookups of the dispatcher: a hit found a
+   valid translation, a miss went through execute_normal () and the
+   interpreter. Direct jumps between linked blocks are not counted. */
+static struct {
+  uae_u32 compiles;
+  uae_u64 hits;
+  uae_u64 misses;
+  uae_u32 evicted;
+  uae_u32 relinked;
+  uae_u32 recycles;
+  uae_u32 hard_flushes;
+} jit_cache_stats;
+
+/* Persistent trace cache. Traces compiled from Kickstart ROM are recorded
+ * and written to the data directory on exit, keyed by the ROM CRC, address
+ * and size. When the guest turns the cache on they are compiled again at
+ * full optimisation, before the first block is interpreted, instead of
+ * going through the interpreter and the optcount warm-up first. Replay
+ * stops after JIT_PERSIST_BUDGET of the cache, the rest is left for the
+ * running program. Host code itself is not stored, it is full of absolute
+ * addresses which are only valid in this process.
+ *
+ * Each record is: block length, cycles, then for each instruction the
+ * offset in ROM and (raw opcode word << 16 | specmem).
+ */
+#define JIT_PERSIST_MAGIC     0x4a495443 /* 'JITC' */
+#define JIT_PERSIST_VERSION   2
+#define JIT_PERSIST_MAXROM    (8 * 65536)
+#define JIT_PERSIST_MAXWORDS  (4 * 1024 * 1024)
+#define JIT_PERSIST_BUDGET    4 /* replay uses at most 1/4 of the cache */
+
+static bool persist_replay_pending = false;
+static bool persist_dirty = false;
+static uae_u32 persist_rom_crc = 0;
+static uae_u32 persist_rom_start = 0;
+static uae_u32 persist_rom_size = 0;
+static uae_u32* persist_data = NULL;
+static int persist_used = 0;
+static int persist_alloc = 0;
+static int persist_records = 0;
+static uae_u8 persist_seen[JIT_PERSIST_MAXROM / 16];
+
+/* Block profiler (option comp_profile). Statistics are kept per 68k block
+ * start in a table which survives cache flushes and evictions, compiled
+ * blocks bump the counters of their entry directly. The report lists the
+ * hottest blocks and is written on exit or by the "Dump JIT profile"
+ * input event.
+ */
+#define JIT_PROFILE_BITS     15
+#define JIT_PROFILE_ENTRIES  (1 << JIT_PROFILE_BITS)
+#define JIT_PROFILE_REPORT   40
+
+typedef struct {
+  uae_u8* pc_p;
+  uae_u32 pc;
+  uae_u32 exec_count;     /* Runs of translated code */
+  uae_u32 interp_count;   /* Runs while not yet optimised, i.e. interpreted */
+  uae_u32 compiles;
+  uae_u32 checksum_fails;
+  uae_u32 compile_time;   /* Microseconds, summed over all compiles */
+  uae_u32 host_bytes;     /* Size of the last translation */
+  uae_u32 m68k_bytes;     /* 68k address span of the last translation */
+  uae_u16 blocklen;       /* 68k instructions in the last translation */
+} jit_profile_entry;
+
+static jit_profile_entry* jit_profile = NULL;
+static int jit_profile_used = 0;
 uae_u8 *popallspace = NULL;
 
 void* pushall_call_handler = NULL;
@@ -403,6 +485,7 @@ STATIC_INLINE blockinfo* get_blockinfo_addr_new(void* addr)
 }
 
 static void prepare_block(blockinfo* bi);
+static void emit_block_stubs(blockinfo* bi);
 
 /* Management of blockinfos.
 
@@ -1185,10 +1268,132 @@ void sync_m68k_pc(void)
   }
 }
 
+/********************************************************************
+ * Block profiler                                                   *
+ ********************************************************************/
+
+static jit_profile_entry* jit_profile_get(uae_u8* pc_p, bool create)
+{
+  uae_u32 h;
+
+  if (!jit_profile) {
+    if (!create)
+      return NULL;
+    jit_profile = xcalloc(jit_profile_entry, JIT_PROFILE_ENTRIES);
+    if (!jit_profile)
+      return NULL;
+  }
+  h = (uae_u32)(((uintptr)pc_p >> 1) * 2654435761u) >> (32 - JIT_PROFILE_BITS);
+  for (;;) {
+    jit_profile_entry* e = &jit_profile[h];
+    if (e->pc_p == pc_p)
+      return e;
+    if (!e->pc_p) {
+      /* Keep some slack, so lookups of unknown blocks terminate quickly */
+      if (!create || jit_profile_used >= JIT_PROFILE_ENTRIES * 3 / 4)
+        return NULL;
+      e->pc_p = pc_p;
+      jit_profile_used++;
+      return e;
+    }
+    h = (h + 1) & (JIT_PROFILE_ENTRIES - 1);
+  }
+}
+
+/* Bytes of 68k code a trace covers, from its lowest to the end of its
+   highest instruction. An instruction that falls through ends where the
+   next one starts. For the last one the end is known if it was a
+   conditional branch, or if it fell through to where the interpreter
+   stopped. Bcc/BRA/BSR get their length from the displacement, any other
+   jump counts as its opcode word only. */
+static uae_u32 jit_profile_span(cpu_history* pc_hist, int blocklen)
+{
+  uintptr lo = (uintptr)pc_hist[0].location;
+  uintptr hi = lo;
+  int i;
+
+  for (i = 0; i < blocklen; i++) {
+    uintptr start = (uintptr)pc_hist[i].location;
+    uae_u32 op = DO_GET_OPCODE(pc_hist[i].location);
+    uintptr end = start + 2;
+
+    if (i < blocklen - 1 && !is_const_jump(op)) {
+      end = (uintptr)pc_hist[i + 1].location;
+    } else if (i == blocklen - 1 && next_pc_p) {
+      end = next_pc_p;
+    } else if (i == blocklen - 1 && prop[op].cflow == fl_normal) {
+      end = (uintptr)regs.pc_p;
+    } else if ((op & 0xf000) == 0x6000) {
+      end = start + ((op & 0xff) == 0 ? 4 : (op & 0xff) == 0xff ? 6 : 2);
+    }
+    if (end <= start || end > start + LONGEST_68K_INST)
+      end = start + 2;
+    if (start < lo)
+      lo = start;
+    if (end > hi)
+      hi = end;
+  }
+  return hi - lo;
+}
+
+static int jit_profile_compare(const void* a, const void* b)
+{
+  const jit_profile_entry* e1 = *(const jit_profile_entry**)a;
+  const jit_profile_entry* e2 = *(const jit_profile_entry**)b;
+  uae_u64 c1 = (uae_u64)e1->exec_count + e1->interp_count;
+  uae_u64 c2 = (uae_u64)e2->exec_count + e2->interp_count;
+
+  if (c1 != c2)
+    return c1 < c2 ? 1 : -1;
+  return e1->pc < e2->pc ? -1 : e1->pc > e2->pc;
+}
+
+void compemu_profile_report(void)
+{
+  jit_profile_entry** list;
+  uae_u64 translated = 0, interpreted = 0, compile_time = 0;
+  int i, n = 0, maxrun = 0, fails = 0;
+
+  if (!jit_profile || !jit_profile_used) {
+    jit_log("No profile data, set comp_profile=true to collect it");
+    return;
+  }
+  list = xmalloc(jit_profile_entry*, jit_profile_used);
+  if (!list)
+    return;
+  for (i = 0; i < JIT_PROFILE_ENTRIES; i++) {
+    jit_profile_entry* e = &jit_profile[i];
+    if (!e->pc_p)
+      continue;
+    list[n++] = e;
+    translated += e->exec_count;
+    interpreted += e->interp_count;
+    compile_time += e->compile_time;
+    fails += e->checksum_fails;
+    if (e->blocklen >= MAXRUN)
+      maxrun++;
+  }
+  qsort(list, n, sizeof(jit_profile_entry*), jit_profile_compare);
+
+  jit_log("### Block profile: %d blocks, %llu translated runs, %llu interpreted runs",
+    n, (unsigned long long)translated, (unsigned long long)interpreted);
+  jit_log("Compile time %.1f ms, %d checksum failures, %d blocks hit MAXRUN (%d)",
+    compile_time / 1000.0, fails, maxrun, MAXRUN);
+  jit_log("     PC       Runs     Interp Insns   68kB HostB Comp CSFail CompUs");
+  for (i = 0; i < n && i < JIT_PROFILE_REPORT; i++) {
+    jit_profile_entry* e = list[i];
+    jit_log("%08x %10u %10u %5u %6u %5u %4u %6u %6u", e->pc, e->exec_count, e->interp_count,
+      e->blocklen, e->m68k_bytes, e->host_bytes, e->compiles, e->checksum_fails, e->compile_time);
+  }
+  xfree(list);
+}
+
 /********************************************************************
  * Support functions exposed to newcpu                              *
  ********************************************************************/
 
+static void jit_persist_save(void);
+
 void compiler_exit(void)
 {
   //if(current_compile_p != 0 && compiled_code != 0 && current_compile_p > compiled_code)
@@ -1204,6 +1409,18 @@ void compiler_exit(void)
 #endif
 #endif
 
+  jit_persist_save();
+  if (jit_profile) {
+    compemu_profile_report();
+  }
+
+  if (jit_cache_stats.compiles) {
+    jit_log("Translation cache: %u compiles, %llu lookups hit %.1f%%, %u blocks evicted, %u relinked, %u segment recycles, %u full flushes",
+      jit_cache_stats.compiles, (unsigned long long)(jit_cache_stats.hits + jit_cache_stats.misses),
+      100.0 * jit_cache_stats.hits / (jit_cache_stats.hits + jit_cache_stats.misses),
+      jit_cache_stats.evicted, jit_cache_stats.relinked, jit_cache_stats.recycles, jit_cache_stats.hard_flushes);
+  }
+
   // Deallocate translation cache
   compiled_code = 0;
 
@@ -1212,6 +1429,9 @@ void compiler_exit(void)
     cache_free(popallspace, POPALLSPACE_SIZE + MAX_JIT_CACHE * 1024);
     popallspace = 0;
   }
+  xfree(jit_profile);
+  jit_profile = NULL;
+  jit_profile_used = 0;
 
 #ifdef PROFILE_COMPILE_TIME
   jit_log("### Compile Block statistics");
@@ -1719,11 +1939,26 @@ void calc_disp_ea_020(int base, uae_u32 dp, int target)
 
 void set_cache_state(int enabled)
 {
-  if (enabled != cache_enabled)
+  if (enabled != cache_enabled) {
     flush_icache_hard(3);
+    if (enabled)
+      persist_replay_pending = true;
+  }
   cache_enabled = enabled;
 }
 
+static void set_cache_segment(int seg)
+{
+  current_segment = seg;
+  current_compile_p = compiled_code + seg * cache_segment_size;
+#if defined(CPU_arm) && !defined(ARMV6T2) && !defined(CPU_AARCH64)
+  max_compile_start = current_compile_p + cache_segment_size - BYTES_PER_INST - DATA_BUFFER_SIZE;
+  reset_data_buffer();
+#else
+  max_compile_start = current_compile_p + cache_segment_size - BYTES_PER_INST;
+#endif
+}
+
 void alloc_cache(void)
 {
   if (compiled_code) {
@@ -1740,16 +1975,14 @@ void alloc_cache(void)
 
   if (compiled_code) {
     write_log("Actual translation cache size : %d KB at %p-%p\n", cache_size, compiled_code, compiled_code + cache_size*1024);
-#if defined(CPU_arm) && !defined(ARMV6T2) && !defined(CPU_AARCH64)
-    max_compile_start = compiled_code + cache_size*1024 - BYTES_PER_INST - DATA_BUFFER_SIZE;
-#else
-    max_compile_start = compiled_code + cache_size*1024 - BYTES_PER_INST;
-#endif
-    current_compile_p = compiled_code;
+    cache_segments = JIT_CACHE_SEGMENTS;
+    while (cache_segments > 1 && cache_size * 1024 / cache_segments < JIT_CACHE_SEGMENT_MIN)
+      cache_segments--;
+    cache_segment_size = (cache_size * 1024 / cache_segments) & ~15;
+    if (cache_segments > 1)
+      write_log("JIT: translation cache split into %d segments of %d KB\n", cache_segments, cache_segment_size / 1024);
+    set_cache_segment(0);
     current_cache_size = 0;
-#if defined(CPU_arm) && !defined(ARMV6T2) && !defined(CPU_AARCH64)
-    reset_data_buffer();
-#endif
   }
 }
 
@@ -1784,17 +2017,31 @@ static void calc_checksum(blockinfo* bi, uae_u32* c1, uae_u32* c2)
   *c2 = k2;
 }
 
+static void jit_persist_replay(void);
+
 int check_for_cache_miss(void)
 {
-  blockinfo* bi = get_blockinfo_addr(regs.pc_p);
+  blockinfo* bi;
+
+  if (persist_replay_pending) {
+    persist_replay_pending = false;
+    if (currprefs.comp_persist)
+      jit_persist_replay();
+  }
 
+  bi = get_blockinfo_addr(regs.pc_p);
   if (bi) {
     int cl = cacheline(regs.pc_p);
     if (bi != cache_tags[cl+1].bi) {
+      /* Invalid blocks come back here, checked ones are counted in
+         check_checksum () */
+      if (bi->status == BI_ACTIVE)
+        jit_cache_stats.hits++;
       raise_in_cl_list(bi);
       return 1;
     }
   }
+  jit_cache_stats.misses++;
   return 0;
 }
 
@@ -1818,6 +2065,8 @@ static void cache_miss(void)
     execute_normal(); /* Compile this block now */
     return;
   }
+  if (bi->status == BI_ACTIVE)
+    jit_cache_stats.hits++;
   raise_in_cl_list(bi);
 }
 
@@ -1854,6 +2103,9 @@ STATIC_INLINE int block_check_checksum(blockinfo* bi)
   } else {
     /* This block actually changed. We need to invalidate it,
        and set it up to be recompiled */
+    jit_profile_entry* prof = jit_profile_get(bi->pc_p, false);
+    if (prof)
+      prof->checksum_fails++;
     invalidate_block(bi);
     raise_in_cl_list(bi);
   }
@@ -1895,6 +2147,8 @@ static void check_checksum(void)
 
   if (!block_check_checksum(bi))
     execute_normal();
+  else
+    jit_cache_stats.hits++;
 }
 
 STATIC_INLINE void match_states(blockinfo* bi)
@@ -2010,10 +2264,8 @@ STATIC_INLINE void reset_lists(void)
   dormant = NULL;
 }
 
-static void prepare_block(blockinfo* bi)
+static void emit_block_stubs(blockinfo* bi)
 {
-  int i;
-
   set_target(current_compile_p);
   bi->direct_pen = (cpuop_func *)get_target();
   compemu_raw_execute_normal((uintptr)&(bi->pc_p));
@@ -2023,6 +2275,13 @@ static void prepare_block(blockinfo* bi)
   
   flush_cpu_icache((void *)current_compile_p, (void *)target);
   current_compile_p = get_target();
+}
+
+static void prepare_block(blockinfo* bi)
+{
+  int i;
+
+  emit_block_stubs(bi);
 
   bi->deplist = NULL;
   for (i = 0; i < 2; i++) {
@@ -2166,12 +2425,88 @@ void flush_icache_hard(int n)
   if (!compiled_code)
     return;
 
-#if defined(CPU_arm) && !defined(ARMV6T2) && !defined(CPU_AARCH64)
-  reset_data_buffer();
-#endif
+  jit_cache_stats.hard_flushes++;
+  set_cache_segment(0);
+  set_special(0); /* To get out of compiled code */
+}
 
-  current_compile_p = compiled_code;
+STATIC_INLINE bool block_in_range(blockinfo* bi, uae_u8* start, uae_u8* end)
+{
+  if ((uae_u8*)bi->direct_pen >= start && (uae_u8*)bi->direct_pen < end)
+    return true;
+  return bi->direct_handler && (uae_u8*)bi->direct_handler >= start && (uae_u8*)bi->direct_handler < end;
+}
+
+static blockinfo* unlink_blocks_in_range(blockinfo* bi, uae_u8* start, uae_u8* end, blockinfo* evicted)
+{
+  while (bi) {
+    blockinfo* next = bi->next;
+    if (block_in_range(bi, start, end)) {
+      remove_from_list(bi);
+      remove_deps(bi);
+      bi->next = evicted;
+      evicted = bi;
+    }
+    bi = next;
+  }
+  return evicted;
+}
+
+/* Reuse the oldest cache segment. Blocks whose code or stubs live in it
+   are thrown away. If code in other segments still jumps directly to one
+   of them, the blockinfo is kept as an invalid block with fresh stubs, so
+   those jumps can be redirected to its execute_normal stub. If the
+   stubs alone fill the new segment, everything is flushed instead. */
+static void recycle_cache_segment(void)
+{
+  int seg = (current_segment + 1) % cache_segments;
+  uae_u8* start = compiled_code + seg * cache_segment_size;
+  uae_u8* end = start + cache_segment_size;
+  blockinfo* evicted = NULL;
+  blockinfo* bi;
+  bool full = false;
+  int i;
+
+  /* First unlink everything, so deps between two evicted blocks are
+     gone before we look at who still depends on whom */
+  evicted = unlink_blocks_in_range(active, start, end, evicted);
+  evicted = unlink_blocks_in_range(dormant, start, end, evicted);
+
+  set_cache_segment(seg);
+
+  while (evicted) {
+    bi = evicted;
+    evicted = bi->next;
+    if (current_compile_p >= MAX_COMPILE_PTR)
+      full = true;
+    if (bi->deplist && !full) {
+      emit_block_stubs(bi);
+      invalidate_block(bi);
+      add_to_active(bi);
+      raise_in_cl_list(bi);
+      jit_cache_stats.relinked++;
+    } else {
+      remove_from_cl_list(bi);
+      free_blockinfo(bi);
+    }
+    jit_cache_stats.evicted++;
+  }
+  for (i = 0; i < MAX_HOLD_BI && !full; i++) {
+    if (hold_bi[i] && (uae_u8*)hold_bi[i]->direct_pen >= start && (uae_u8*)hold_bi[i]->direct_pen < end) {
+      if (current_compile_p >= MAX_COMPILE_PTR)
+        full = true;
+      else
+        emit_block_stubs(hold_bi[i]);
+    }
+  }
+  set_target(current_compile_p);
+
+  jit_cache_stats.recycles++;
   set_special(0); /* To get out of compiled code */
+
+  /* Freed blocks may still be jump targets, only a full flush is safe */
+  if (full || current_compile_p >= MAX_COMPILE_PTR)
+    flush_icache_hard(3);
 }
 
 
@@ -2216,6 +2551,211 @@ void flush_icache(int n)
   active = NULL;
 }
 
+static void jit_persist_filename(TCHAR* out, int size, uae_u32 crc)
+{
+  TCHAR name[32];
+
+  fetch_datapath(out, size);
+  _stprintf(name, _T("jit_%08x.cache"), crc);
+  _tcsncat(out, name, size - _tcslen(out) - 1);
+}
+
+static void jit_persist_clear(void)
+{
+  xfree(persist_data);
+  persist_data = NULL;
+  persist_used = persist_alloc = 0;
+  persist_records = 0;
+  persist_dirty = false;
+  memset(persist_seen, 0, sizeof persist_seen);
+}
+
+STATIC_INLINE bool jit_persist_test_and_set(uae_u32 offset)
+{
+  uae_u32 idx = offset >> 1;
+  bool seen = (persist_seen[idx >> 3] & (1 << (idx & 7))) != 0;
+
+  persist_seen[idx >> 3] |= 1 << (idx & 7);
+  return seen;
+}
+
+static void jit_persist_save(void)
+{
+  TCHAR path[MAX_DPATH];
+  uae_u32 header[8];
+  FILE* f;
+
+  if (!persist_dirty || !persist_records)
+    return;
+  persist_dirty = false;
+
+  jit_persist_filename(path, MAX_DPATH, persist_rom_crc);
+  f = fopen(path, "wb");
+  if (!f) {
+    jit_log("Could not write trace cache %s", path);
+    return;
+  }
+  header[0] = JIT_PERSIST_MAGIC;
+  header[1] = JIT_PERSIST_VERSION;
+  header[2] = persist_rom_crc;
+  header[3] = persist_rom_start;
+  header[4] = persist_rom_size;
+  header[5] = currprefs.cpu_model;
+  header[6] = currprefs.compfpu;
+  header[7] = persist_used;
+  if (fwrite(header, sizeof header, 1, f) != 1 || fwrite(persist_data, sizeof(uae_u32), persist_used, f) != (size_t)persist_used) {
+    jit_log("Error writing trace cache %s", path);
+  } else {
+    jit_log("Saved %d ROM traces to %s", persist_records, path);
+  }
+  fclose(f);
+}
+
+static void jit_persist_load(void)
+{
+  TCHAR path[MAX_DPATH];
+  uae_u32 header[8];
+  FILE* f;
+  int pos;
+
+  jit_persist_filename(path, MAX_DPATH, persist_rom_crc);
+  f = fopen(path, "rb");
+  if (!f)
+    return;
+  if (fread(header, sizeof header, 1, f) != 1
+    || header[0] != JIT_PERSIST_MAGIC || header[1] != JIT_PERSIST_VERSION
+    || header[2] != persist_rom_crc || header[3] != persist_rom_start || header[4] != persist_rom_size
+    || header[5] != (uae_u32)currprefs.cpu_model || header[6] != (uae_u32)currprefs.compfpu
+    || header[7] > JIT_PERSIST_MAXWORDS) {
+    fclose(f);
+    return;
+  }
+  persist_data = xmalloc(uae_u32, header[7]);
+  persist_alloc = header[7];
+  if (fread(persist_data, sizeof(uae_u32), header[7], f) != header[7]) {
+    fclose(f);
+    jit_persist_clear();
+    return;
+  }
+  fclose(f);
+
+  /* Walk the records once, drop everything from the first damaged one */
+  for (pos = 0; pos + 2 <= (int)header[7]; ) {
+    uae_u32 len = persist_data[pos];
+    if (len == 0 || len > MAXRUN || pos + 2 + 2 * (int)len > (int)header[7] || persist_data[pos + 2] >= persist_rom_size)
+      break;
+    jit_persist_test_and_set(persist_data[pos + 2]);
+    persist_records++;
+    pos += 2 + 2 * len;
+  }
+  persist_used = pos;
+  jit_log("Loaded %d ROM traces from %s", persist_records, path);
+}
+
+static void jit_persist_record(cpu_history* pc_hist, int blocklen, int totcycles)
+{
+  uae_u32 offset = (uae_u8*)pc_hist[0].location - kickmem_bank.baseaddr;
+  int i;
+
+  if (offset >= persist_rom_size || jit_persist_test_and_set(offset))
+    return;
+  if (persist_used + 2 + 2 * blocklen > persist_alloc) {
+    int newsize = persist_alloc ? persist_alloc * 2 : 16384;
+    if (newsize > JIT_PERSIST_MAXWORDS)
+      return;
+    persist_data = xrealloc(uae_u32, persist_data, newsize);
+    persist_alloc = newsize;
+  }
+  persist_data[persist_used++] = blocklen;
+  persist_data[persist_used++] = totcycles;
+  for (i = 0; i < blocklen; i++) {
+    persist_data[persist_used++] = (uae_u8*)pc_hist[i].location - kickmem_bank.baseaddr;
+    persist_data[persist_used++] = ((uae_u32)*pc_hist[i].location << 16) | pc_hist[i].specmem;
+  }
+  persist_records++;
+  persist_dirty = true;
+}
+
+/* Compile all known ROM traces into the current cache segment. Called
+   from check_for_cache_miss () once the guest has turned the cache on, so
+   it runs outside of compiled code and compile_block (). Stops after
+   1/JIT_PERSIST_BUDGET of the cache or half of the segment, whichever is
+   smaller, so there is room left for the running program. */
+static void jit_persist_replay(void)
+{
+  cpu_history pc_hist[MAXRUN];
+  uae_s32 pissoff = regs.pissoff;
+  uae_u8* saved_start_pc_p = start_pc_p;
+  uae_u32 saved_start_pc = start_pc;
+  uae_u8* replay_start = current_compile_p;
+  uae_u32 budget = cache_size * 1024 / JIT_PERSIST_BUDGET;
+  uae_u32 crc, romstart, romsize;
+  int pos, replayed = 0;
+
+  if (!kickmem_bank.baseaddr || !compiled_code)
+    return;
+  romstart = kickmem_bank.start;
+  romsize = kickmem_bank.reserved_size;
+  if (romsize > JIT_PERSIST_MAXROM)
+    romsize = JIT_PERSIST_MAXROM;
+  crc = get_crc32(kickmem_bank.baseaddr, romsize);
+  if (crc != persist_rom_crc || romstart != persist_rom_start || romsize != persist_rom_size || !persist_data) {
+    jit_persist_save();
+    jit_persist_clear();
+    persist_rom_crc = crc;
+    persist_rom_start = romstart;
+    persist_rom_size = romsize;
+    jit_persist_load();
+  }
+  if (budget > cache_segment_size / 2)
+    budget = cache_segment_size / 2;
+
+  for (pos = 0; pos < persist_used; ) {
+    int len = persist_data[pos];
+    int totcycles = persist_data[pos + 1];
+    uae_u32* insn = &persist_data[pos + 2];
+    bool valid = true;
+    blockinfo* bi;
+    int i;
+
+    pos += 2 + 2 * len;
+    if ((uae_u32)(current_compile_p - replay_start) >= budget || current_compile_p >= MAX_COMPILE_PTR)
+      break;
+
+    for (i = 0; i < len && valid; i++) {
+      uae_u32 offset = insn[2 * i];
+      if (offset >= persist_rom_size - 2) {
+        valid = false;
+        break;
+      }
+      pc_hist[i].location = (uae_u16*)(kickmem_bank.baseaddr + offset);
+      pc_hist[i].specmem = insn[2 * i + 1] & 0xff;
+      valid = *pc_hist[i].location == (insn[2 * i + 1] >> 16);
+    }
+    if (!valid)
+      continue;
+
+    bi = get_blockinfo_addr(pc_hist[0].location);
+    if (bi && bi->status != BI_INVALID)
+      continue;
+    alloc_blockinfos();
+    bi = get_blockinfo_addr_new(pc_hist[0].location);
+    bi->count = -1; /* Go straight to full optimisation */
+
+    start_pc_p = (uae_u8*)pc_hist[0].location;
+    start_pc = persist_rom_start + insn[0];
+    compile_block(pc_hist, len, totcycles);
+    replayed++;
+  }
+
+  regs.pissoff = pissoff;
+  start_pc_p = saved_start_pc_p;
+  start_pc = saved_start_pc;
+  if (replayed)
+    jit_log("Precompiled %d ROM traces at %08x, %d of %d KB budget", replayed, persist_rom_start,
+      (int)(current_compile_p - replay_start) / 1024, budget / 1024);
+}
+
 int failure;
 
 STATIC_INLINE unsigned int get_opcode_cft_map(unsigned int f)
@@ -2244,8 +2784,13 @@ void compile_block(cpu_history* pc_hist, int blocklen, int totcycles)
     blockinfo* bi = NULL;
     blockinfo* bi2;
 
-    if (current_compile_p >= MAX_COMPILE_PTR)
-      flush_icache_hard(3);
+    if (current_compile_p >= MAX_COMPILE_PTR) {
+      if (cache_segments > 1)
+        recycle_cache_segment();
+      else
+        flush_icache_hard(3);
+    }
+    jit_cache_stats.compiles++;
 
     alloc_blockinfos();
 
@@ -2261,6 +2806,13 @@ void compile_block(cpu_history* pc_hist, int blocklen, int totcycles)
     remove_deps(bi); /* We are about to create new code */
     bi->optlevel = optlev;
     bi->pc_p = (uae_u8*)pc_hist[0].location;
+
+    jit_profile_entry* prof = NULL;
+    frame_time_t prof_start = 0;
+    if (currprefs.comp_profile) {
+      prof = jit_profile_get(bi->pc_p, true);
+      prof_start = read_processor_time();
+    }
     free_checksum_info_chain(bi->csi);
     bi->csi = NULL;
 
@@ -2302,6 +2854,9 @@ void compile_block(cpu_history* pc_hist, int blocklen, int totcycles)
     bi->status = BI_COMPILING;
     current_block_start_target = (uintptr)get_target();
 
+    if (prof) {
+      compemu_raw_inc_m((uintptr)(optlev ? &prof->exec_count : &prof->interp_count));
+    }
     if (bi->count >= 0) { /* Need to generate countdown code */
       compemu_raw_set_pc_i((uintptr)pc_hist[0].location);
       compemu_raw_dec_m((uintptr)&(bi->count));
@@ -2468,6 +3023,9 @@ void compile_block(cpu_history* pc_hist, int blocklen, int totcycles)
       }
     }
 
+    if (trace_in_rom && optlev == 2 && currprefs.comp_persist)
+      jit_persist_record(pc_hist, blocklen, totcycles);
+
     remove_from_list(bi);
     if (trace_in_rom) {
       // No need to checksum that block trace on cache invalidation
@@ -2499,8 +3057,18 @@ void compile_block(cpu_history* pc_hist, int blocklen, int totcycles)
     raise_in_cl_list(bi);
     bi->nexthandler=current_compile_p;
 
-    /* We will flush soon, anyway, so let's do it now */
-    if (current_compile_p >= MAX_COMPILE_PTR)
+    if (prof) {
+      prof->pc = start_pc + ((uae_u8*)pc_hist[0].location - start_pc_p);
+      prof->compiles++;
+      prof->compile_time += read_processor_time() - prof_start;
+      prof->host_bytes = current_compile_p - (uae_u8*)bi->direct_handler;
+      prof->blocklen = blocklen;
+      prof->m68k_bytes = jit_profile_span(pc_hist, blocklen);
+    }
+
+    /* We will flush soon, anyway, so let's do it now. A segmented
+       cache recycles its next segment when the next block is compiled. */
+    if (current_compile_p >= MAX_COMPILE_PTR && cache_segments == 1)
       flush_icache_hard(3);
 
     bi->status = BI_ACTIVE;
@@ -2377,7 +2377,7 @@ static void m68k_run_1 (void)
 		    r->instruction_pc = m68k_getpc ();
       	cpu_cycles = (*cpufunctbl[r->opcode])(r->opcode);
       	cpu_cycles = adjust_cycles(cpu_cycles);
-				do_cycles(cpu_cycles);
+				do_cycles_fast(cpu_cycles);
 		    if (r->spcflags) {
 					if (do_specialties (cpu_cycles))
 						exit = true;
@@ -2646,7 +2646,7 @@ static void m68k_run_2_000(void)
 
 	      cpu_cycles = (*cpufunctbl[r->opcode])(r->opcode);
 	      cpu_cycles = adjust_cycles(cpu_cycles);
-				do_cycles(cpu_cycles);
+				do_cycles_fast(cpu_cycles);
 
 		    if (r->spcflags) {
 					if (do_specialties (cpu_cycles))
@@ -2677,7 +2677,7 @@ static void m68k_run_2_020(void)
 
 	      cpu_cycles = (*cpufunctbl[r->opcode])(r->opcode);
 	      cpu_cycles = adjust_cycles(cpu_cycles);
-				do_cycles(cpu_cycles);
+				do_cycles_fast(cpu_cycles);
 
 		    if (r->spcflags) {
 					if (do_specialties (cpu_cycles))
@@ -1,6 +1,9 @@
 #include "sysconfig.h"
 #include "sysdeps.h"
 
+#include <sys/mman.h>
+#include <unistd.h>
+
 #include "threaddep/thread.h"
 #include "options.h"
 #include "filesys.h"
@@ -8,11 +11,57 @@
 #include "uae.h"
 
 
+#define CACHE_SIZE 16384
+/* seconds collected writes may wait before the flush thread writes them */
+#define CACHE_FLUSH_TIME 5
+/* N-way block cache: CACHE_SLOTS blocks of CACHE_SIZE bytes, replaced LRU */
+#define CACHE_SLOTS 32
+/* blocks read in one go when reads are sequential */
+#define CACHE_READAHEAD 8
+/* contiguous writes are collected up to this size before hitting the file */
+#define WRITE_RUN_SIZE (8 * CACHE_SIZE)
+
+struct hardfilecache
+{
+	uae_u64 offset;
+	int len;
+	unsigned int lru;
+	uae_u8 *data;
+};
+
 struct hardfilehandle
 {
 	int zfile;
 	struct zfile *zf;
 	FILE *f;
+
+	struct hardfilecache cache[CACHE_SLOTS];
+	uae_u8 *cachemem;
+	unsigned int lru;
+	uae_u8 *rabuf;
+	uae_u64 nextmiss;
+	uae_u8 *wbuf;
+	uae_u64 woffset;
+	int wlen;
+	unsigned int wruns;
+	/* a collected write failed after its request was done: the next
+	 * request fails, and writes are no longer collected */
+	bool werror;
+	bool writethrough;
+
+	uae_thread_id flush_tid;
+	uae_sem_t flush_sem;
+	volatile bool flush_quit;
+
+	uae_u8 *map;
+	uae_u64 mapsize;
+	bool pio;
+
+	/* the hardfile I/O threads share the file and the cache */
+	uae_sem_t lock;
+
+	unsigned int hits, misses, reads;
+	unsigned int writes, flushes;
 };
 
 struct uae_driveinfo {
@@ -33,11 +82,83 @@ struct uae_driveinfo {
 #define HDF_HANDLE_ZFILE 2
 #define HDF_HANDLE_UNKNOWN 3
 
-#define CACHE_SIZE 16384
-#define CACHE_FLUSH_TIME 5
-
 static const TCHAR *hdz[] = { _T("hdz"), _T("zip"), NULL };
 
+/* mmap mode: the image is mapped once and reads and writes are plain copies
+ * between the mapping and Amiga memory. When it can't be mapped, e.g. it is
+ * too big for the address space, the block cache uses pread/pwrite and skips
+ * the seeks instead. */
+static void hdf_map (struct hardfiledata *hfd)
+{
+	struct hardfilehandle *h = hfd->handle;
+	void *map = MAP_FAILED;
+
+	fflush (h->f);
+	if ((uae_u64)(size_t)hfd->physsize == hfd->physsize)
+		map = mmap (NULL, (size_t)hfd->physsize, PROT_READ | (hfd->ci.readonly ? 0 : PROT_WRITE), MAP_SHARED, fileno (h->f), 0);
+	if (map != MAP_FAILED) {
+		h->map = (uae_u8*)map;
+		h->mapsize = hfd->physsize;
+		write_log (_T("HDF mapped, size=%lld\n"), h->mapsize / 1024);
+	} else {
+		h->pio = true;
+		write_log (_T("HDF mmap failed (%d), using pread/pwrite\n"), errno);
+	}
+}
+
+static void hdf_unmap (struct hardfiledata *hfd)
+{
+	struct hardfilehandle *h = hfd->handle;
+
+	if (h->map) {
+		msync (h->map, (size_t)h->mapsize, MS_SYNC);
+		munmap (h->map, (size_t)h->mapsize);
+	}
+	h->map = NULL;
+	h->mapsize = 0;
+	h->pio = false;
+}
+
+static int hdf_map_rw (struct hardfiledata *hfd, void *buffer, uae_u64 offset, int len, bool write)
+{
+	struct hardfilehandle *h = hfd->handle;
+
+	if (len <= 0)
+		return 0;
+	if (offset + len > hfd->physsize - hfd->virtual_size || offset + hfd->offset + len > h->mapsize) {
+		if (!hfd->virtual_rdb)
+			write_log (_T("hd: tried to access out of bounds! (%I64X + %d >= %I64X)\n"), offset, len, hfd->physsize);
+		return 0;
+	}
+	offset += hfd->offset;
+	if (write)
+		memcpy (h->map + offset, buffer, len);
+	else
+		memcpy (buffer, h->map + offset, len);
+	return len;
+}
+
+static int hdf_pio (struct hardfiledata *hfd, void *buffer, uae_u64 offset, int len, bool write)
+{
+	int fd = fileno (hfd->handle->f);
+	int done = 0;
+
+	offset += hfd->offset;
+	while (done < len) {
+		ssize_t ret;
+		if (write)
+			ret = pwrite (fd, (uae_u8*)buffer + done, len - done, (off_t)(offset + done));
+		else
+			ret = pread (fd, (uae_u8*)buffer + done, len - done, (off_t)(offset + done));
+		if (ret <= 0)
+			break;
+		done += ret;
+	}
+	return done;
+}
+
+static int hdf_flush_thread (void *v);
+
 int hdf_open_target (struct hardfiledata *hfd, const TCHAR *pname)
 {
 	FILE *f = 0;
@@ -59,6 +180,12 @@ int hdf_open_target (struct hardfiledata *hfd, const TCHAR *pname)
 	}
 	hfd->handle = xcalloc (struct hardfilehandle, 1);
 	hfd->handle->f = 0;
+	hfd->handle->cachemem = xmalloc (uae_u8, CACHE_SLOTS * CACHE_SIZE);
+	for (i = 0; i < CACHE_SLOTS; i++)
+		hfd->handle->cache[i].data = hfd->handle->cachemem + i * CACHE_SIZE;
+	hfd->handle->rabuf = xmalloc (uae_u8, CACHE_READAHEAD * CACHE_SIZE);
+	hfd->handle->wbuf = xmalloc (uae_u8, WRITE_RUN_SIZE);
+	uae_sem_init (&hfd->handle->lock, 0, 1);
 	write_log (_T("hfd attempting to open: '%s'\n"), name);
 
 	ext = _tcsrchr (name, '.');
@@ -115,6 +242,13 @@ int hdf_open_target (struct hardfiledata *hfd, const TCHAR *pname)
 	} else {
 		write_log (_T("HDF '%s' failed to open.\n"), name);
 	}
+	if (hfd->handle_valid == HDF_HANDLE_FILE && currprefs.hardfile_mmap)
+		hdf_map (hfd);
+	if (hfd->handle_valid && !hfd->handle->map && !hfd->ci.readonly) {
+		uae_sem_init (&hfd->handle->flush_sem, 0, 0);
+		if (!uae_start_thread (_T("hardfile_flush"), hdf_flush_thread, hfd, &hfd->handle->flush_tid))
+			hfd->handle->flush_tid = BAD_THREAD;
+	}
 	if (hfd->handle_valid || hfd->drive_empty) {
 		write_log (_T("HDF '%s' opened, size=%lld mode=%d empty=%d\n"), name, hfd->physsize / 1024, hfd->handle_valid, hfd->drive_empty);
 		return 1;
@@ -139,8 +273,33 @@ static void freehandle (struct hardfilehandle *h)
 	h->zfile = 0;
 }
 
+static int hdf_flush_write (struct hardfiledata *hfd);
+
 void hdf_close_target (struct hardfiledata *hfd)
 {
+	struct hardfilehandle *h = hfd->handle;
+
+	if (h) {
+		if (h->flush_tid) {
+			h->flush_quit = true;
+			uae_sem_post (&h->flush_sem);
+			uae_wait_thread (h->flush_tid);
+			h->flush_tid = BAD_THREAD;
+		}
+		if (h->flush_sem)
+			uae_sem_destroy (&h->flush_sem);
+		if (hfd->handle_valid)
+			hdf_flush_write (hfd);
+		hdf_unmap (hfd);
+		if (h->hits || h->misses || h->writes)
+			write_log (_T("HDF cache: %u hits, %u misses, %u reads, %u writes in %u flushes\n"),
+				h->hits, h->misses, h->reads, h->writes, h->flushes);
+		xfree (h->cachemem);
+		xfree (h->rabuf);
+		xfree (h->wbuf);
+		if (h->lock)
+			uae_sem_destroy (&h->lock);
+	}
 	freehandle (hfd->handle);
 	xfree (hfd->handle);
 	xfree (hfd->emptyname);
@@ -235,65 +394,200 @@ static void poscheck (struct hardfiledata *hfd, int len)
 	}
 }
 
-static int isincache (struct hardfiledata *hfd, uae_u64 offset, int len)
+static struct hardfilecache *cache_find (struct hardfilehandle *h, uae_u64 offset)
 {
-	if (!hfd->cache_valid)
-		return -1;
-	if (offset >= hfd->cache_offset && offset + len <= hfd->cache_offset + CACHE_SIZE)
-		return (int)(offset - hfd->cache_offset);
-	return -1;
+	for (int i = 0; i < CACHE_SLOTS; i++) {
+		if (h->cache[i].len && h->cache[i].offset == offset)
+			return &h->cache[i];
+	}
+	return NULL;
 }
 
-static int hdf_read_2 (struct hardfiledata *hfd, void *buffer, uae_u64 offset, int len)
+static struct hardfilecache *cache_victim (struct hardfilehandle *h)
 {
-	int outlen = 0;
-	int coffset;
+	struct hardfilecache *c = &h->cache[0];
 
-	if (offset == 0)
-		hfd->cache_valid = 0;
-	coffset = isincache (hfd, offset, len);
-	if (coffset >= 0) {
-		memcpy (buffer, hfd->cache + coffset, len);
-		return len;
+	for (int i = 0; i < CACHE_SLOTS; i++) {
+		if (!h->cache[i].len)
+			return &h->cache[i];
+		if (h->cache[i].lru < c->lru)
+			c = &h->cache[i];
 	}
-	hfd->cache_offset = offset;
-	if (offset + CACHE_SIZE > hfd->offset + (hfd->physsize - hfd->virtual_size))
-		hfd->cache_offset = hfd->offset + (hfd->physsize - hfd->virtual_size) - CACHE_SIZE;
-	if (hdf_seek (hfd, hfd->cache_offset))
-	  return 0;
-	poscheck (hfd, CACHE_SIZE);
-	if (hfd->handle_valid == HDF_HANDLE_FILE) {
-		outlen = fread(hfd->cache, 1, CACHE_SIZE, hfd->handle->f);
-	} else if (hfd->handle_valid == HDF_HANDLE_ZFILE) {
-		outlen = zfile_fread (hfd->cache, 1, CACHE_SIZE, hfd->handle->zf);
+	return c;
+}
+
+/* Write out collected writes */
+static int hdf_flush_write (struct hardfiledata *hfd)
+{
+	struct hardfilehandle *h = hfd->handle;
+	int len = h->wlen;
+	int outlen = 0;
+
+	if (!len)
+		return 1;
+	h->wlen = 0;
+	if (h->pio || hfd->handle_valid == HDF_HANDLE_FILE) {
+		outlen = hdf_pio (hfd, h->wbuf, h->woffset, len, true);
+	} else {
+		if (hdf_seek (hfd, h->woffset))
+			return 0;
+		poscheck (hfd, len);
+		if (hfd->handle_valid == HDF_HANDLE_FILE) {
+			outlen = fwrite (h->wbuf, 1, len, h->f);
+		} else if (hfd->handle_valid == HDF_HANDLE_ZFILE) {
+			outlen = zfile_fwrite (h->wbuf, 1, len, h->zf);
+		}
 	}
-	hfd->cache_valid = 0;
-	if (outlen != CACHE_SIZE)
+	h->flushes++;
+	if (outlen != len) {
+		write_log (_T("hd: write of %d bytes at %llX failed (%d)\n"), len, h->woffset, outlen);
+		h->writethrough = true;
 		return 0;
-	hfd->cache_valid = 1;
-	coffset = isincache (hfd, offset, len);
-	if (coffset >= 0) {
-		memcpy (buffer, hfd->cache + coffset, len);
-		return len;
 	}
-	write_log (_T("hdf_read: cache bug! offset=%I64d len=%d\n"), offset, len);
-	hfd->cache_valid = 0;
+	return 1;
+}
+
+/* Flush outside of any request, a failure is reported by the next one */
+static void hdf_flush_deferred (struct hardfiledata *hfd)
+{
+	if (!hdf_flush_write (hfd))
+		hfd->handle->werror = true;
+}
+
+static bool hdf_check_werror (struct hardfilehandle *h)
+{
+	bool err;
+
+	if (!h->werror)
+		return false;
+	uae_sem_wait (&h->lock);
+	err = h->werror;
+	h->werror = false;
+	uae_sem_post (&h->lock);
+	return err;
+}
+
+/* Writes out collected writes once nothing was added to them for a whole
+ * CACHE_FLUSH_TIME period */
+static int hdf_flush_thread (void *v)
+{
+	struct hardfiledata *hfd = (struct hardfiledata*)v;
+	struct hardfilehandle *h = hfd->handle;
+	unsigned int seen = 0;
+
+	while (!h->flush_quit) {
+		uae_sem_trywait_delay (&h->flush_sem, CACHE_FLUSH_TIME * 1000);
+		if (h->flush_quit)
+			break;
+		uae_sem_wait (&h->lock);
+		if (h->wlen && h->wruns == seen)
+			hdf_flush_deferred (hfd);
+		seen = h->wruns;
+		uae_sem_post (&h->lock);
+	}
 	return 0;
 }
 
-int hdf_read_target (struct hardfiledata *hfd, void *buffer, uae_u64 offset, int len)
+/* Put what was read from the file into the cache */
+static void cache_insert (struct hardfilehandle *h, uae_u64 offset, uae_u8 *buf, int outlen)
 {
-	int got = 0;
-	uae_u8 *p = (uae_u8*)buffer;
+	h->reads++;
+	for (int pos = 0; pos < outlen; pos += CACHE_SIZE) {
+		struct hardfilecache *c = cache_find (h, offset + pos);
+		if (!c)
+			c = cache_victim (h);
+		c->offset = offset + pos;
+		c->len = outlen - pos < CACHE_SIZE ? outlen - pos : CACHE_SIZE;
+		c->lru = ++h->lru;
+		memcpy (c->data, buf + pos, c->len);
+	}
+	if (outlen > 0)
+		h->nextmiss = offset + outlen;
+}
 
-	if (hfd->drive_empty)
+/* Number of blocks to read on a miss at block */
+static int cache_readahead (struct hardfilehandle *h, uae_u64 block, int coffset, int want)
+{
+	int blocks = (coffset + want + CACHE_SIZE - 1) / CACHE_SIZE;
+	if (block == h->nextmiss || blocks > CACHE_READAHEAD)
+		blocks = CACHE_READAHEAD;
+	return blocks;
+}
+
+/* Read up to 'blocks' cache blocks starting at offset with one seek and read */
+static int cache_fill (struct hardfiledata *hfd, uae_u64 offset, int blocks)
+{
+	struct hardfilehandle *h = hfd->handle;
+	uae_u64 end = hfd->physsize - hfd->virtual_size;
+	int len = blocks * CACHE_SIZE;
+	int outlen = 0;
+
+	/* the file must not be older than what was written */
+	if (!hdf_flush_write (hfd))
 		return 0;
+	if (offset < end && offset + len > end)
+		len = (int)(end - offset);
+	if (h->pio) {
+		if (offset >= end)
+			return 0;
+		outlen = hdf_pio (hfd, h->rabuf, offset, len, false);
+	} else {
+		if (hdf_seek (hfd, offset))
+			return 0;
+		poscheck (hfd, len);
+		if (hfd->handle_valid == HDF_HANDLE_FILE) {
+			outlen = fread (h->rabuf, 1, len, h->f);
+		} else if (hfd->handle_valid == HDF_HANDLE_ZFILE) {
+			outlen = zfile_fread (h->rabuf, 1, len, h->zf);
+		}
+	}
+	cache_insert (h, offset, h->rabuf, outlen);
+	return outlen;
+}
+
+/* Read len bytes within one cache block, want is what the whole request
+ * still needs from offset on */
+static int hdf_read_2 (struct hardfiledata *hfd, void *buffer, uae_u64 offset, int len, int want)
+{
+	struct hardfilehandle *h = hfd->handle;
+	uae_u64 block = offset & ~(uae_u64)(CACHE_SIZE - 1);
+	int coffset = (int)(offset - block);
+	struct hardfilecache *c;
+
+	/* block zero (RDB) always comes from the file */
+	if (offset == 0 && (c = cache_find (h, 0)))
+		c->len = 0;
+	c = cache_find (h, block);
+	if (c && coffset + len <= c->len) {
+		h->hits++;
+	} else {
+		int blocks = cache_readahead (h, block, coffset, want);
+		h->misses++;
+		if (cache_fill (hfd, block, blocks) <= 0)
+			return 0;
+		c = cache_find (h, block);
+		if (!c || coffset + len > c->len) {
+			write_log (_T("hdf_read: short read! offset=%I64d len=%d\n"), offset, len);
+			return 0;
+		}
+	}
+	c->lru = ++h->lru;
+	memcpy (buffer, c->data + coffset, len);
+	return len;
+}
+
+static int hdf_read_cached (struct hardfiledata *hfd, void *buffer, uae_u64 offset, int len)
+{
+	int got = 0;
+	uae_u8 *p = (uae_u8*)buffer;
 
 	while (len > 0) {
 		int maxlen;
 		int ret;
 		if (hfd->physsize < CACHE_SIZE) {
 			hfd->cache_valid = 0;
+			if (!hdf_flush_write (hfd))
+				return got;
 			if (hdf_seek (hfd, offset))
         return got;
 			if (hfd->physsize)
@@ -306,8 +600,10 @@ int hdf_read_target (struct hardfiledata *hfd, void *buffer, uae_u64 offset, int
 			}
 			maxlen = len;
 		} else {
-			maxlen = len > CACHE_SIZE ? CACHE_SIZE : len;
-			ret = hdf_read_2 (hfd, p, offset, maxlen);
+			maxlen = CACHE_SIZE - (int)(offset & (CACHE_SIZE - 1));
+			if (maxlen > len)
+				maxlen = len;
+			ret = hdf_read_2 (hfd, p, offset, maxlen, len);
 		}
 		got += ret;
 		if (ret != maxlen)
@@ -319,8 +615,103 @@ int hdf_read_target (struct hardfiledata *hfd, void *buffer, uae_u64 offset, int
 	return got;
 }
 
+/* Plain files are read with pread outside the lock, so a slow read does
+ * not hold up the other I/O threads. The lock covers the cache lookup and
+ * the insert afterwards. A block written while the read was running is
+ * not cached from it. */
+static int hdf_read_unlocked (struct hardfiledata *hfd, void *buffer, uae_u64 offset, int len)
+{
+	struct hardfilehandle *h = hfd->handle;
+	uae_u64 end = hfd->physsize - hfd->virtual_size;
+	uae_u8 *p = (uae_u8*)buffer;
+	int got = 0;
+
+	while (len > 0) {
+		uae_u64 block = offset & ~(uae_u64)(CACHE_SIZE - 1);
+		int coffset = (int)(offset - block);
+		int maxlen = CACHE_SIZE - coffset;
+		struct hardfilecache *c;
+
+		if (maxlen > len)
+			maxlen = len;
+		uae_sem_wait (&h->lock);
+		/* block zero (RDB) always comes from the file */
+		if (offset == 0 && (c = cache_find (h, 0)))
+			c->len = 0;
+		c = cache_find (h, block);
+		if (c && coffset + maxlen <= c->len) {
+			h->hits++;
+			c->lru = ++h->lru;
+			memcpy (p, c->data + coffset, maxlen);
+			uae_sem_post (&h->lock);
+		} else {
+			int blocks = cache_readahead (h, block, coffset, len);
+			int rlen = blocks * CACHE_SIZE;
+			unsigned int writes;
+			uae_u8 *tmp;
+			int outlen;
+
+			h->misses++;
+			/* the file must not be older than what was written */
+			if (h->wlen && h->woffset < block + rlen && block < h->woffset + h->wlen) {
+				if (!hdf_flush_write (hfd)) {
+					uae_sem_post (&h->lock);
+					return got;
+				}
+			}
+			writes = h->writes;
+			uae_sem_post (&h->lock);
+			if (block >= end)
+				return got;
+			if (block + rlen > end)
+				rlen = (int)(end - block);
+			tmp = xmalloc (uae_u8, rlen);
+			outlen = hdf_pio (hfd, tmp, block, rlen, false);
+			uae_sem_wait (&h->lock);
+			if (writes == h->writes)
+				cache_insert (h, block, tmp, outlen);
+			uae_sem_post (&h->lock);
+			if (outlen < coffset + maxlen) {
+				write_log (_T("hdf_read: short read! offset=%I64d len=%d\n"), offset, maxlen);
+				xfree (tmp);
+				return got;
+			}
+			memcpy (p, tmp + coffset, maxlen);
+			xfree (tmp);
+		}
+		got += maxlen;
+		offset += maxlen;
+		p += maxlen;
+		len -= maxlen;
+	}
+	return got;
+}
+
+int hdf_read_target (struct hardfiledata *hfd, void *buffer, uae_u64 offset, int len)
+{
+	int got;
+
+	if (hfd->drive_empty)
+		return 0;
+	if (hfd->handle->map)
+		return hdf_map_rw (hfd, buffer, offset, len, false);
+	if (hdf_check_werror (hfd->handle))
+		return 0;
+	if (hfd->handle_valid == HDF_HANDLE_FILE && hfd->physsize >= CACHE_SIZE)
+		return hdf_read_unlocked (hfd, buffer, offset, len);
+	uae_sem_wait (&hfd->handle->lock);
+	got = hdf_read_cached (hfd, buffer, offset, len);
+	uae_sem_post (&hfd->handle->lock);
+	return got;
+}
+
+/* Write len bytes within one cache block. Contiguous writes are collected
+ * and written out together, cached blocks are updated in place. */
 static int hdf_write_2 (struct hardfiledata *hfd, void *buffer, uae_u64 offset, int len)
 {
+	struct hardfilehandle *h = hfd->handle;
+	uae_u64 block = offset & ~(uae_u64)(CACHE_SIZE - 1);
+	struct hardfilecache *c;
 	int outlen = 0;
 
 	if (hfd->ci.readonly)
@@ -328,6 +719,33 @@ static int hdf_write_2 (struct hardfiledata *hfd, void *buffer, uae_u64 offset,
 	if (len == 0)
 		return 0;
 
+	c = cache_find (h, block);
+	if (c) {
+		int coffset = (int)(offset - block);
+		if (coffset + len <= c->len)
+			memcpy (c->data + coffset, buffer, len);
+		else
+			c->len = 0;
+	}
+	h->writes++;
+	/* block zero is verified, out of bounds writes fail, both right away */
+	if (!h->writethrough && offset != 0 && offset + len <= hfd->physsize - hfd->virtual_size) {
+		if (h->wlen && (offset != h->woffset + h->wlen || h->wlen + len > WRITE_RUN_SIZE)) {
+			if (!hdf_flush_write (hfd))
+				return 0;
+		}
+		if (!h->wlen) {
+			h->woffset = offset;
+			h->wruns++;
+		}
+		memcpy (h->wbuf + h->wlen, buffer, len);
+		h->wlen += len;
+		return len;
+	}
+
+	if (!hdf_flush_write (hfd))
+		return 0;
+	h->flushes++;
 	hfd->cache_valid = 0;
 	if (hdf_seek (hfd, offset))
 		return 0;
@@ -354,19 +772,21 @@ static int hdf_write_2 (struct hardfiledata *hfd, void *buffer, uae_u64 offset,
 	} else if (hfd->handle_valid == HDF_HANDLE_ZFILE) {
 		outlen = zfile_fwrite (hfd->cache, 1, len, hfd->handle->zf);
 	}
+	/* pread must see it */
+	if (hfd->handle_valid == HDF_HANDLE_FILE)
+		fflush (h->f);
 	return outlen;
 }
 
-int hdf_write_target (struct hardfiledata *hfd, void *buffer, uae_u64 offset, int len)
+static int hdf_write_cached (struct hardfiledata *hfd, void *buffer, uae_u64 offset, int len)
 {
 	int got = 0;
 	uae_u8 *p = (uae_u8*)buffer;
 
-	if (hfd->drive_empty || hfd->physsize == 0)
-		return 0;
-
 	while (len > 0) {
-		int maxlen = len > CACHE_SIZE ? CACHE_SIZE : len;
+		int maxlen = CACHE_SIZE - (int)(offset & (CACHE_SIZE - 1));
+		if (maxlen > len)
+			maxlen = len;
 		int ret = hdf_write_2 (hfd, p, offset, maxlen);
 		if (ret < 0)
 			return ret;
@@ -380,8 +800,39 @@ int hdf_write_target (struct hardfiledata *hfd, void *buffer, uae_u64 offset, in
 	return got;
 }
 
+int hdf_write_target (struct hardfiledata *hfd, void *buffer, uae_u64 offset, int len)
+{
+	int got;
+
+	if (hfd->drive_empty || hfd->physsize == 0)
+		return 0;
+	if (hfd->handle->map) {
+		if (hfd->ci.readonly)
+			return 0;
+		return hdf_map_rw (hfd, buffer, offset, len, true);
+	}
+	if (hdf_check_werror (hfd->handle))
+		return 0;
+	uae_sem_wait (&hfd->handle->lock);
+	got = hdf_write_cached (hfd, buffer, offset, len);
+	uae_sem_post (&hfd->handle->lock);
+	return got;
+}
+
+void hdf_flush_target (struct hardfiledata *hfd)
+{
+	if (!hfd->handle || !hfd->handle_valid)
+		return;
+	uae_sem_wait (&hfd->handle->lock);
+	hdf_flush_deferred (hfd);
+	uae_sem_post (&hfd->handle->lock);
+	if (hfd->handle->map)
+		msync (hfd->handle->map, (size_t)hfd->handle->mapsize, MS_SYNC);
+}
+
 int hdf_resize_target(struct hardfiledata *hfd, uae_u64 newsize)
 {
+  hdf_flush_target (hfd);
   if (newsize < hfd->physsize) {
     write_log("hdf_resize_target: truncation not implemented\n");
     return 0;
@@ -401,6 +852,10 @@ int hdf_resize_target(struct hardfiledata *hfd, uae_u64 newsize)
   }
   write_log("hdf_resize_target: %lld -> %lld\n", hfd->physsize, newsize);
   hfd->physsize = newsize;
+  if (hfd->handle->map || hfd->handle->pio) {
+    hdf_unmap (hfd);
+    hdf_map (hfd);
+  }
   return 1;
 }
 
@@ -722,6 +722,8 @@ int generic_main (int argc, char *argv[])
 
 #ifdef USE_SDL2
   ret = SDL_Init(SDL_INIT_EVERYTHING);
+#elif defined(HEADLESS)
+  ret = SDL_Init(SDL_INIT_NOPARACHUTE);
 #else
 #ifdef PANDORA
   ret = SDL_Init(SDL_INIT_NOPARACHUTE | SDL_INIT_VIDEO);
@@ -741,7 +743,7 @@ int generic_main (int argc, char *argv[])
   
   input_closeall();
 
-#if defined(RASPBERRY) && !defined(USE_SDL2)
+#if (defined(RASPBERRY) || defined(HEADLESS)) && !defined(USE_SDL2)
   graphics_thread_leave();
 #else
 	SDL_VideoQuit();
@@ -0,0 +1,591 @@
+/*
+ * Display-less graphics layer for benchmarking and CI.
+ *
+ * Frames are rendered into a plain memory buffer and never paced, so
+ * emulation runs as fast as the host allows. Every Nth frame can be
+ * dumped as PPM image or as CRC32 line, and throughput is logged when
+ * the emulation ends.
+ */
+#include "sysconfig.h"
+#include "sysdeps.h"
+#include "config.h"
+#include "uae.h"
+#include "options.h"
+#include "gui.h"
+#include "memory.h"
+#include "newcpu.h"
+#include "custom.h"
+#include "events.h"
+#include "xwin.h"
+#include "drawing.h"
+#include "inputdevice.h"
+#include "savestate.h"
+#include "picasso96.h"
+#include "statusline.h"
+#include "crc32.h"
+
+bool volatile flip_in_progess = false;
+
+/* Memory buffer for output of emulation, always R5G6B5 */
+static uae_u8 *screen_buffer = NULL;
+static int screen_width = 0;
+static int screen_height = 0;
+static int screen_pitch = 0;
+
+static const int nativeScreenDepth = 16;
+static const int red_bits = 5, green_bits = 6, blue_bits = 5;
+static const int red_shift = 11, green_shift = 5, blue_shift = 0;
+
+uae_u32 time_per_frame = 20000; // Default for PAL (50 Hz): 20000 microsecs
+static uae_u32 last_synctime;
+static int currVSyncRate = 0;
+
+/* Possible screen modes (x and y resolutions) */
+#define MAX_SCREEN_MODES 14
+static int x_size_table[MAX_SCREEN_MODES] = {640, 640, 720, 800, 800, 960, 1024, 1280, 1280, 1280, 1360, 1366, 1680, 1920};
+static int y_size_table[MAX_SCREEN_MODES] = {400, 480, 400, 480, 600, 540,  768,  720,  800, 1024,  768,  768, 1050, 1080};
+
+struct PicassoResolution *DisplayModes;
+struct MultiDisplay Displays[MAX_DISPLAYS];
+
+int screen_is_picasso = 0;
+
+static char screenshot_filename_default[MAX_DPATH] =  {
+	'/', 't', 'm', 'p', '/', 'n', 'u', 'l', 'l', '.', 'p', 'n', 'g', '\0'
+};
+char *screenshot_filename = (char *)&screenshot_filename_default[0];
+FILE *screenshot_file = NULL;
+int delay_savestate_frame = 0;
+
+/* Benchmark counters */
+static int frames_shown = 0;
+static uae_u64 emulated_cycles = 0;
+static uae_u32 last_cycles = 0;
+static uae_u32 bench_start = 0;
+static FILE *crc_file = NULL;
+
+
+static void dump_frame_ppm(int frame)
+{
+	TCHAR name[MAX_DPATH];
+
+	snprintf(name, MAX_DPATH, "%s/frame_%06d.ppm", currprefs.headless_dump_path[0] ? currprefs.headless_dump_path : ".", frame);
+	FILE *f = fopen(name, "wb");
+	if (!f) {
+		write_log("headless: can't write %s\n", name);
+		return;
+	}
+	fprintf(f, "P6\n%d %d\n255\n", screen_width, screen_height);
+	uae_u8 *row = xmalloc(uae_u8, screen_width * 3);
+	for (int y = 0; y < screen_height; y++) {
+		uae_u16 *p = (uae_u16 *)(screen_buffer + y * screen_pitch);
+		uae_u8 *b = row;
+		for (int x = 0; x < screen_width; x++) {
+			uae_u16 v = p[x];
+			*b++ = ((v >> red_shift) & 0x1f) << 3;
+			*b++ = ((v >> green_shift) & 0x3f) << 2;
+			*b++ = ((v >> blue_shift) & 0x1f) << 3;
+		}
+		fwrite(row, screen_width * 3, 1, f);
+	}
+	xfree(row);
+	fclose(f);
+}
+
+static void dump_frame_crc(int frame)
+{
+	if (crc_file == NULL) {
+		if (currprefs.headless_dump_path[0]) {
+			TCHAR name[MAX_DPATH];
+			snprintf(name, MAX_DPATH, "%s/frames.crc", currprefs.headless_dump_path);
+			crc_file = fopen(name, "w");
+		}
+		if (crc_file == NULL)
+			crc_file = stdout;
+	}
+	uae_u32 crc = get_crc32(screen_buffer, screen_pitch * screen_height);
+	fprintf(crc_file, "%06d %08x\n", frame, crc);
+}
+
+static void bench_report(void)
+{
+	if (frames_shown == 0)
+		return;
+	double secs = (double)(read_processor_time() - bench_start) / (double)syncbase;
+	if (secs <= 0.0)
+		secs = 1.0 / syncbase;
+	write_log("headless: %d frames in %.2f s, %.2f frames/s, %.0f cycles/s\n",
+		frames_shown, secs, frames_shown / secs, (double)emulated_cycles / CYCLE_UNIT / secs);
+	if (crc_file != NULL && crc_file != stdout)
+		fclose(crc_file);
+	crc_file = NULL;
+}
+
+
+void wait_for_vsync(void)
+{
+}
+
+void reset_sync(void)
+{
+}
+
+
+int graphics_setup(void)
+{
+#ifdef PICASSO96
+	picasso_InitResolutions();
+	InitPicasso96();
+#endif
+	return 1;
+}
+
+
+void statusline_updated(void)
+{
+}
+
+
+static void InitAmigaVidMode(struct uae_prefs *p)
+{
+  /* Initialize structure for Amiga video modes */
+	struct amigadisplay *ad = &adisplays;
+	ad->gfxvidinfo.drawbuffer.pixbytes = nativeScreenDepth / 8;
+	p->color_mode = 2;
+	ad->gfxvidinfo.drawbuffer.bufmem = screen_buffer;
+	ad->gfxvidinfo.drawbuffer.outwidth = p->gfx_monitor.gfx_size.width;
+	ad->gfxvidinfo.drawbuffer.outheight = p->gfx_monitor.gfx_size.height << p->gfx_vresolution;
+	ad->gfxvidinfo.drawbuffer.rowbytes = screen_pitch;
+}
+
+
+void graphics_subshutdown(void)
+{
+	xfree(screen_buffer);
+	screen_buffer = NULL;
+}
+
+void graphics_thread_leave(void)
+{
+	bench_report();
+	graphics_subshutdown();
+}
+
+
+static void open_screen(struct uae_prefs *p)
+{
+  graphics_subshutdown();
+
+	currprefs.gfx_correct_aspect = changed_prefs.gfx_correct_aspect;
+	currprefs.gfx_fullscreen_ratio = changed_prefs.gfx_fullscreen_ratio;
+
+#ifdef PICASSO96
+	if (screen_is_picasso) {
+		screen_width = picasso_vidinfo.width ? picasso_vidinfo.width : 640;
+		screen_height = picasso_vidinfo.height ? picasso_vidinfo.height : 256;
+	} else
+#endif
+	{
+		p->gfx_resolution = p->gfx_monitor.gfx_size.width ? (p->gfx_monitor.gfx_size.width > 600 ? 1 : 0) : 1;
+		screen_width = p->gfx_monitor.gfx_size.width ? p->gfx_monitor.gfx_size.width : 640;
+		screen_height = (p->gfx_monitor.gfx_size.height ? p->gfx_monitor.gfx_size.height : 256) << p->gfx_vresolution;
+	}
+
+	screen_pitch = screen_width * (nativeScreenDepth / 8);
+	screen_buffer = xcalloc(uae_u8, screen_pitch * screen_height);
+
+	InitAmigaVidMode(p);
+	init_row_map();
+}
+
+
+void update_display(struct uae_prefs *p)
+{
+	struct amigadisplay *ad = &adisplays;
+
+	open_screen(p);
+
+	ad->framecnt = 1; // Don't draw frame before reset done
+}
+
+
+int check_prefs_changed_gfx(void)
+{
+	int changed = 0;
+
+	if (currprefs.gfx_monitor.gfx_size.height != changed_prefs.gfx_monitor.gfx_size.height ||
+	   currprefs.gfx_monitor.gfx_size.width != changed_prefs.gfx_monitor.gfx_size.width ||
+	   currprefs.gfx_resolution != changed_prefs.gfx_resolution ||
+		 currprefs.gfx_vresolution != changed_prefs.gfx_vresolution)
+	{
+		currprefs.gfx_monitor.gfx_size.height = changed_prefs.gfx_monitor.gfx_size.height;
+		currprefs.gfx_monitor.gfx_size.width = changed_prefs.gfx_monitor.gfx_size.width;
+		currprefs.gfx_resolution = changed_prefs.gfx_resolution;
+		currprefs.gfx_vresolution = changed_prefs.gfx_vresolution;
+		update_display(&currprefs);
+		changed = 1;
+	}
+	if (currprefs.leds_on_screen != changed_prefs.leds_on_screen ||
+	    currprefs.leds_on_screen_mask[0] != changed_prefs.leds_on_screen_mask[0] ||
+	    currprefs.leds_on_screen_mask[1] != changed_prefs.leds_on_screen_mask[1] ||
+	    currprefs.gfx_monitor.gfx_size.y != changed_prefs.gfx_monitor.gfx_size.y)
+	{
+		currprefs.leds_on_screen = changed_prefs.leds_on_screen;
+		currprefs.leds_on_screen_mask[0] = changed_prefs.leds_on_screen_mask[0];
+		currprefs.leds_on_screen_mask[1] = changed_prefs.leds_on_screen_mask[1];
+		currprefs.gfx_monitor.gfx_size.y = changed_prefs.gfx_monitor.gfx_size.y;
+		changed = 1;
+	}
+	if (currprefs.chipset_refreshrate != changed_prefs.chipset_refreshrate) {
+		currprefs.chipset_refreshrate = changed_prefs.chipset_refreshrate;
+		init_hz_normal();
+		changed = 1;
+	}
+
+	// Not the correct place for this...
+	currprefs.filesys_limit = changed_prefs.filesys_limit;
+	currprefs.harddrive_read_only = changed_prefs.harddrive_read_only;
+
+  if(changed) {
+    inputdevice_unacquire();
+		init_custom ();
+		inputdevice_acquire(TRUE);
+  }
+
+	return changed;
+}
+
+
+int lockscr(void)
+{
+  if(screen_buffer == NULL)
+    return 0;
+  init_row_map();
+	return 1;
+}
+
+
+void unlockscr(void)
+{
+}
+
+bool render_screen (void)
+{
+	if (savestate_state == STATE_DOSAVE) {
+		if (delay_savestate_frame > 0)
+			--delay_savestate_frame;
+		else
+			savestate_state = 0; // No thumbnail without display
+	}
+
+	return true;
+}
+
+void show_screen(int mode)
+{
+  uae_u32 now = read_processor_time();
+  uae_u32 cycles = get_cycles();
+
+  if(frames_shown == 0) {
+    bench_start = now;
+  } else {
+    emulated_cycles += cycles - last_cycles;
+  }
+  last_cycles = cycles;
+  last_synctime = now;
+
+  if(screen_buffer != NULL && currprefs.headless_dump_interval > 0 && (frames_shown % currprefs.headless_dump_interval) == 0) {
+    if(currprefs.headless_dump_crc)
+      dump_frame_crc(frames_shown);
+    else
+      dump_frame_ppm(frames_shown);
+  }
+
+  frames_shown++;
+  if(currprefs.headless_max_frames > 0 && frames_shown == currprefs.headless_max_frames)
+    uae_quit();
+}
+
+
+uae_u32 target_lastsynctime(void)
+{
+  return last_synctime;
+}
+
+void black_screen_now(void)
+{
+  if(screen_buffer != NULL) {
+    memset(screen_buffer, 0, screen_pitch * screen_height);
+    notice_screen_contents_lost();
+    render_screen();
+	  show_screen(0);
+  }
+}
+
+int sleep_millis_main (int ms)
+{
+	uae_u32 start = read_processor_time ();
+	usleep(ms * 1000);
+  idletime += read_processor_time () - start;
+  return 0;
+}
+
+
+static int init_colors(void)
+{
+	/* Truecolor: */
+	alloc_colors64k(red_bits, green_bits, blue_bits, red_shift, green_shift, blue_shift);
+	notice_new_xcolors();
+
+	return 1;
+}
+
+int GetSurfacePixelFormat(void)
+{
+	return RGBFB_R5G6B5;
+}
+
+
+int graphics_init(bool mousecapture)
+{
+	inputdevice_unacquire();
+
+	if (screen_buffer != NULL)
+		InitAmigaVidMode(&currprefs);
+
+	if (!init_colors())
+		return 0;
+
+	inputdevice_acquire(TRUE);
+
+	return 1;
+}
+
+void graphics_leave(void)
+{
+	graphics_subshutdown();
+}
+
+
+bool vsync_switchmode(int hz)
+{
+	int changed_height = changed_prefs.gfx_monitor.gfx_size.height;
+	struct amigadisplay *ad = &adisplays;
+
+	if (hz >= 55)
+		hz = 60;
+	else
+		hz = 50;
+
+	if (hz == 50 && currVSyncRate == 60) {
+	  // Switch from NTSC -> PAL
+		switch (changed_height) {
+		case 200: changed_height = 240; break;
+		case 216: changed_height = 262; break;
+		case 240: changed_height = 270; break;
+		case 256: changed_height = 270; break;
+		case 262: changed_height = 270; break;
+		case 270: changed_height = 270; break;
+		}
+	}	else if (hz == 60 && currVSyncRate == 50)	{
+	  // Switch from PAL -> NTSC
+		switch (changed_height) {
+		case 200: changed_height = 200; break;
+		case 216: changed_height = 200; break;
+		case 240: changed_height = 200; break;
+		case 256: changed_height = 216; break;
+		case 262: changed_height = 216; break;
+		case 270: changed_height = 240; break;
+		}
+	}
+
+  if(hz != currVSyncRate) {
+    currVSyncRate = hz;
+    fpscounter_reset();
+    time_per_frame = 1000000 / hz;
+  }
+
+  if(!ad->picasso_on && !ad->picasso_requested_on)
+  	changed_prefs.gfx_monitor.gfx_size.height = changed_height;
+
+	return true;
+}
+
+bool target_graphics_buffer_update(void)
+{
+	if (currprefs.gfx_monitor.gfx_size.height != changed_prefs.gfx_monitor.gfx_size.height) {
+		update_display(&changed_prefs);
+		fpscounter_reset();
+		time_per_frame = 1000000 / (currprefs.chipset_refreshrate);
+	}
+
+	return true;
+}
+
+
+void target_detect_displaysize(void)
+{
+}
+
+
+#ifdef PICASSO96
+
+
+int picasso_palette(struct MyCLUTEntry *CLUT, uae_u32 *clut)
+{
+	int changed = 0;
+
+	for (int i = 0; i < 256; i++) {
+    int r = CLUT[i].Red;
+    int g = CLUT[i].Green;
+    int b = CLUT[i].Blue;
+		int value = (r << 16 | g << 8 | b);
+		uae_u32 v = CONVERT_RGB(value);
+		if (v !=  clut[i]) {
+			clut[i] = v;
+			changed = 1;
+		}
+	}
+	return changed;
+}
+
+static int resolution_compare(const void *a, const void *b)
+{
+	struct PicassoResolution *ma = (struct PicassoResolution *)a;
+	struct PicassoResolution *mb = (struct PicassoResolution *)b;
+	if (ma->res.width < mb->res.width)
+		return -1;
+	if (ma->res.width > mb->res.width)
+		return 1;
+	if (ma->res.height < mb->res.height)
+		return -1;
+	if (ma->res.height > mb->res.height)
+		return 1;
+	return ma->depth - mb->depth;
+}
+static void sortmodes(void)
+{
+	int	i = 0, idx = -1;
+	int pw = -1, ph = -1;
+	while (DisplayModes[i].depth >= 0)
+		i++;
+	qsort(DisplayModes, i, sizeof(struct PicassoResolution), resolution_compare);
+	for (i = 0; DisplayModes[i].depth >= 0; i++) {
+		if (DisplayModes[i].res.height != ph || DisplayModes[i].res.width != pw) {
+			ph = DisplayModes[i].res.height;
+			pw = DisplayModes[i].res.width;
+			idx++;
+		}
+		DisplayModes[i].residx = idx;
+	}
+}
+
+void picasso_InitResolutions(void)
+{
+	struct MultiDisplay *md1;
+	int i, count = 0;
+	char tmp[200];
+	int bit_idx;
+	int bits[] = { 8, 16, 32 };
+
+	Displays[0].primary = 1;
+	Displays[0].disabled = 0;
+	Displays[0].rect.left = 0;
+	Displays[0].rect.top = 0;
+	Displays[0].rect.right = 800;
+	Displays[0].rect.bottom = 640;
+	sprintf(tmp, "%s (%d*%d)", "Display", Displays[0].rect.right, Displays[0].rect.bottom);
+	Displays[0].name = my_strdup(tmp);
+	Displays[0].name2 = my_strdup("Display");
+
+	md1 = Displays;
+	DisplayModes = md1->DisplayModes = xmalloc(struct PicassoResolution, MAX_PICASSO_MODES);
+	for (i = 0; i < MAX_SCREEN_MODES && count < MAX_PICASSO_MODES; i++) {
+		for (bit_idx = 0; bit_idx < 3; ++bit_idx) {
+			int bitdepth = bits[bit_idx];
+			int bit_unit = (bitdepth + 1) & 0xF8;
+			int rgbFormat = (bitdepth == 8 ? RGBFB_CLUT : (bitdepth == 16 ? RGBFB_R5G6B5PC : RGBFB_B8G8R8A8));
+			int pixelFormat = 1 << rgbFormat;
+			pixelFormat |= RGBFF_CHUNKY;
+
+			// Any size fits into a memory buffer
+			DisplayModes[count].res.width = x_size_table[i];
+			DisplayModes[count].res.height = y_size_table[i];
+			DisplayModes[count].depth = bit_unit >> 3;
+			DisplayModes[count].refresh[0] = 50;
+			DisplayModes[count].refresh[1] = 60;
+			DisplayModes[count].refresh[2] = 0;
+			DisplayModes[count].colormodes = pixelFormat;
+			sprintf(DisplayModes[count].name,	"%dx%d, %d-bit",
+        DisplayModes[count].res.width, DisplayModes[count].res.height, DisplayModes[count].depth * 8);
+
+			count++;
+		}
+	}
+	DisplayModes[count].depth = -1;
+	sortmodes();
+	DisplayModes = Displays[0].DisplayModes;
+}
+
+
+void gfx_set_picasso_state(int on)
+{
+	if (on == screen_is_picasso)
+		return;
+
+	screen_is_picasso = on;
+	open_screen(&currprefs);
+	picasso_vidinfo.rowbytes = screen_pitch;
+}
+
+void gfx_set_picasso_modeinfo(uae_u32 w, uae_u32 h, uae_u32 depth, RGBFTYPE rgbfmt)
+{
+	depth >>= 3;
+	if (((unsigned)picasso_vidinfo.width == w) &&
+	  ((unsigned)picasso_vidinfo.height == h) &&
+	  ((unsigned)picasso_vidinfo.depth == depth) &&
+	  (picasso_vidinfo.selected_rgbformat == rgbfmt))
+		return;
+
+	picasso_vidinfo.selected_rgbformat = rgbfmt;
+	picasso_vidinfo.width = w;
+	picasso_vidinfo.height = h;
+	picasso_vidinfo.depth = nativeScreenDepth;
+	picasso_vidinfo.extra_mem = 1;
+
+	picasso_vidinfo.pixbytes = nativeScreenDepth / 8;
+	if (screen_is_picasso) {
+		open_screen(&currprefs);
+ 		picasso_vidinfo.rowbytes	= screen_pitch;
+	  picasso_vidinfo.rgbformat = RGBFB_R5G6B5;
+	}
+}
+
+uae_u8 *gfx_lock_picasso(void)
+{
+  if(screen_buffer == NULL || screen_is_picasso == 0)
+    return NULL;
+	picasso_vidinfo.rowbytes = screen_pitch;
+	return screen_buffer;
+}
+
+void gfx_unlock_picasso(bool dorender)
+{
+  if(dorender) {
+    render_screen();
+    show_screen(0);
+  }
+}
+
+bool gfx_picasso_direct(uae_u8 *src, int pitch)
+{
+  // Frames are dumped from screen_buffer
+  return false;
+}
+
+void gfx_set_picasso_colors(RGBFTYPE rgbfmt)
+{
+	alloc_colors_picasso(red_bits, green_bits, blue_bits, red_shift, green_shift, blue_shift, rgbfmt, p96_rgbx16);
+}
+
+#endif // PICASSO96
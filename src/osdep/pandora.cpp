@@ -80,7 +80,7 @@ void target_default_options (struct uae_prefs *p, int type)
   
   p->pandora_tapDelay = 10;
 
-	p->picasso96_modeflags = RGBFF_CLUT | RGBFF_R5G6B5 | RGBFF_R8G8B8A8;
+	p->picasso96_modeflags = RGBFF_CLUT | RGBFF_R5G6B5PC | RGBFF_B8G8R8A8;
 	
 	p->cr[0].index = 0;
 	p->cr[0].rate = 60.0;
@@ -112,7 +112,11 @@ void target_fixup_options (struct uae_prefs *p)
     p->cs_cd32fmv = 1;
   }
   
-	p->picasso96_modeflags = RGBFF_CLUT | RGBFF_R5G6B5 | RGBFF_R8G8B8A8;
+	// Older versions saved their big-endian default in every config, move
+	// those to the formats the host can show without a swap. A mask set by
+	// hand is kept.
+	if (p->picasso96_modeflags == (RGBFF_CLUT | RGBFF_R5G6B5 | RGBFF_R8G8B8A8))
+		p->picasso96_modeflags = RGBFF_CLUT | RGBFF_R5G6B5PC | RGBFF_B8G8R8A8;
   p->gfx_resolution = p->gfx_monitor.gfx_size.width > 600 ? 1 : 0;
   
   if(p->cachesize > 0)
@@ -144,6 +144,7 @@ void InitAmigaVidMode(struct uae_prefs *p)
   ad->gfxvidinfo.drawbuffer.outwidth = p->gfx_monitor.gfx_size.width;
   ad->gfxvidinfo.drawbuffer.outheight = p->gfx_monitor.gfx_size.height << p->gfx_vresolution;
 	ad->gfxvidinfo.drawbuffer.rowbytes = prSDLScreen->pitch;
+	ad->gfxvidinfo.drawbuffer.double_buffered = (prSDLScreen->flags & SDL_DOUBLEBUF) != 0;
 }
 
 
@@ -431,6 +432,7 @@ uae_u32 target_lastsynctime(void)
 void black_screen_now(void)
 {
 	SDL_FillRect(prSDLScreen,NULL,0);
+	notice_screen_contents_lost();
 	SDL_Flip(prSDLScreen);
 }
 
@@ -801,7 +803,7 @@ void picasso_InitResolutions (void)
     for(bit_idx = 0; bit_idx < 3; ++bit_idx) {
       int bitdepth = bits[bit_idx];
       int bit_unit = (bitdepth + 1) & 0xF8;
-      int rgbFormat = (bitdepth == 8 ? RGBFB_CLUT : (bitdepth == 16 ? RGBFB_R5G6B5 : RGBFB_R8G8B8A8));
+      int rgbFormat = (bitdepth == 8 ? RGBFB_CLUT : (bitdepth == 16 ? RGBFB_R5G6B5PC : RGBFB_B8G8R8A8));
       int pixelFormat = 1 << rgbFormat;
   	  pixelFormat |= RGBFF_CHUNKY;
       
@@ -883,4 +885,10 @@ void gfx_unlock_picasso (bool dorender)
   }
 }
 
+bool gfx_picasso_direct (uae_u8 *src, int pitch)
+{
+  // Screen is always updated from prSDLScreen
+  return false;
+}
+
 #endif // PICASSO96
@@ -66,6 +66,27 @@ static int picasso96_PCT = PCT_Unknown;
 
 static bool picasso_flushpixels (uae_u8 *src, int offset);
 
+/* RTG memory write tracking. One byte per page of gfxmem, set by the gfxmem
+ * put functions and the blitter traps, consumed by picasso_flushpixels(). */
+#define P96_DIRTY_SHIFT 12
+static uae_u8 *p96_dirty;
+static uae_u32 p96_dirty_pages;
+static bool p96_full_refresh = true;
+static uae_u64 p96_bytes_copied, p96_bytes_full;
+
+STATIC_INLINE void p96_mark_dirty (uae_u32 offset, uae_u32 size)
+{
+	uae_u32 page = offset >> P96_DIRTY_SHIFT;
+	uae_u32 last = (offset + size - 1) >> P96_DIRTY_SHIFT;
+
+	if (page >= p96_dirty_pages)
+		return;
+	if (last >= p96_dirty_pages)
+		last = p96_dirty_pages - 1;
+	for (; page <= last; page++)
+		p96_dirty[page] = 1;
+}
+
 #define PICASSO_STATE_SETDISPLAY 1
 #define PICASSO_STATE_SETPANNING 2
 #define PICASSO_STATE_SETGC 4
@@ -220,6 +241,16 @@ static bool validatecoords(TrapContext *ctx, struct RenderInfo *ri, uae_u32 *X,
 	return false;
 }
 
+/* Record a rectangle written by one of the blitter traps */
+static void p96_mark_dirty_rect (struct RenderInfo *ri, uae_u32 X, uae_u32 Y, uae_u32 Width, uae_u32 Height, int Bpp)
+{
+	uaecptr start = ri->AMemory + Y * ri->BytesPerRow + X * Bpp;
+
+	if (!Width || !Height || start < gfxmem_bank.start)
+		return;
+	p96_mark_dirty (start - gfxmem_bank.start, (Height - 1) * ri->BytesPerRow + Width * Bpp);
+}
+
 /*
  * Amiga <-> native structure conversion functions
  */
@@ -600,6 +631,7 @@ static void setconvert(void)
 		alloc_colors_rgb(5, 6, 5, 11, 5, 0, p96rc, p96gc, p96bc);
 	gfx_set_picasso_colors(state->RGBFormat);
 	picasso_palette (state->CLUT, vidinfo->clut);
+	p96_full_refresh = true;
 	if (vidinfo->host_mode != vidinfo->ohost_mode || state->RGBFormat != vidinfo->orgbformat
 	|| picasso_vidinfo.pixbytes != opixbytes) {
     write_log (_T("RTG conversion: Depth=%d HostRGBF=%d P96RGBF=%d Mode=%d\n"), 
@@ -625,6 +657,7 @@ void picasso_refresh (void)
   if (!ad->picasso_on)
   	return;
   setconvert ();
+  p96_full_refresh = true;
 
   /* Make sure that the first time we show a Picasso video mode, we don't blit any crap.
    * We can do this by checking if we have an Address yet. 
@@ -1715,6 +1748,8 @@ static int updateclut(TrapContext *ctx, uaecptr clut, int start, int count)
   }
   
 	changed |= picasso_palette (state->CLUT, vidinfo->clut);
+	if (changed)
+		p96_full_refresh = true;
   return changed;
 }
 static uae_u32 REGPARAM2 picasso_SetColorArray (TrapContext *ctx)
@@ -1946,6 +1981,7 @@ static uae_u32 REGPARAM2 picasso_InvertRect (TrapContext *ctx)
 
   	for (lines = 0; lines < Height; lines++, uae_mem += ri.BytesPerRow)
       do_xor8 (uae_mem, width_in_bytes, xorval);
+		p96_mark_dirty_rect (&ri, X, Y, Width, Height, Bpp);
   	result = 1;
   }
 
@@ -1985,6 +2021,7 @@ static uae_u32 REGPARAM2 picasso_FillRect (TrapContext *ctx)
 			return 1;
 
     Bpp = GetBytesPerPixel (RGBFormat);
+		p96_mark_dirty_rect (&ri, X, Y, Width, Height, Bpp);
 
 	  if (Bpp > 1)
 	    Mask = 0xFF;
@@ -2099,6 +2136,10 @@ STATIC_INLINE int BlitRectHelper(TrapContext *ctx)
 	    mask = 0xFF;
   	dstri = ri;
   }
+	p96_mark_dirty_rect (dstri, dstx, dsty, width, height, Bpp);
+	if (opcode == BLIT_SWAP)
+		p96_mark_dirty_rect (ri, srcx, srcy, width, height, Bpp);
+
   /* Do our virtual frame-buffer memory first */
   return do_blitrect_frame_buffer (ri, dstri, srcx, srcy, dstx, dsty, width, height, mask, opcode);
 }
@@ -2266,6 +2307,7 @@ static uae_u32 REGPARAM2 picasso_BlitPattern (TrapContext *ctx)
 
   	Bpp = GetBytesPerPixel (ri.RGBFormat);
   	uae_mem = ri.Memory + Y*ri.BytesPerRow + X*Bpp; /* offset with address */
+		p96_mark_dirty_rect (&ri, X, Y, W, H, Bpp);
 
   	if (pattern.DrawMode & INVERS)
 	    inversion = 1;
@@ -2426,6 +2468,7 @@ static uae_u32 REGPARAM2 picasso_BlitTemplate (TrapContext *ctx)
 
 	  Bpp = GetBytesPerPixel (ri.RGBFormat);
 	  uae_mem = ri.Memory + Y*ri.BytesPerRow + X*Bpp; /* offset into address */
+		p96_mark_dirty_rect (&ri, X, Y, W, H, Bpp);
 
 	  if (tmp.DrawMode & INVERS)
 	    inversion = 1;
@@ -2692,6 +2735,7 @@ static uae_u32 REGPARAM2 picasso_BlitPlanar2Chunky (TrapContext *ctx)
       minterm);
 	} else if (CopyRenderInfoStructureA2U(ctx, ri, &local_ri) && CopyBitMapStructureA2U(ctx, bm, &local_bm)) {
 		PlanarToChunky (ctx, &local_ri, &local_bm, srcx, srcy, dstx, dsty, width, height, mask);
+		p96_mark_dirty_rect (&local_ri, dstx, dsty, width, height, GetBytesPerPixel (local_ri.RGBFormat));
 	  result = 1;
   }
   return result;
@@ -2854,6 +2898,7 @@ static uae_u32 REGPARAM2 picasso_BlitPlanar2Direct (TrapContext *ctx)
 	if (CopyRenderInfoStructureA2U(ctx, ri, &local_ri) && CopyBitMapStructureA2U(ctx, bm, &local_bm)) {
 	  Mask = 0xFF;
 		PlanarToDirect(ctx, &local_ri, &local_bm, srcx, srcy, dstx, dsty, width, height, Mask, cim);
+		p96_mark_dirty_rect (&local_ri, dstx, dsty, width, height, GetBytesPerPixel (local_ri.RGBFormat));
 	  result = 1;
   }
   return result;
@@ -2877,36 +2922,131 @@ static void picasso_statusline (uae_u8 *dst)
   }
 }
 
-static void copyall (uae_u8 *src, uae_u8 *dst)
+/* True if the Amiga pixels are already in the layout of the host surface */
+static bool picasso_native_format (void)
 {
 	struct picasso_vidbuf_description *vidinfo = &picasso_vidinfo;
 	struct picasso96_state_struct *state = &picasso96_state;
-  if (state->RGBFormat == RGBFB_R5G6B5) {
+  return (state->RGBFormat == RGBFB_R5G6B5PC && vidinfo->pixbytes == 2)
+    || (state->RGBFormat == RGBFB_B8G8R8A8 && vidinfo->pixbytes == 4);
+}
+
+static void copy_screen_16bitpc_to_32bit (uae_u32 *dst, uae_u16 *src, int pixels)
+{
+  while (pixels--) {
+    uae_u32 v = *src++;
+    *dst++ = ((v & 0xf800) << 8) | ((v & 0x07e0) << 5) | ((v & 0x001f) << 3);
+  }
+}
+
+static void copy_screen_32bitpc_to_16bit (uae_u16 *dst, uae_u32 *src, int pixels)
+{
+  while (pixels--) {
+    uae_u32 v = *src++;
+    *dst++ = ((v >> 8) & 0xf800) | ((v >> 5) & 0x07e0) | ((v >> 3) & 0x001f);
+  }
+}
+
+/* Bytes between two source lines as the conversion reads them. The rows
+ * are converted as one block, so this is the packed width, and the dirty
+ * page lookup must use the same pitch. */
+STATIC_INLINE int p96_src_pitch (void)
+{
+	struct picasso96_state_struct *state = &picasso96_state;
+  return state->Width * GetBytesPerPixel (state->RGBFormat);
+}
+
+/* Convert lines y to y + lines - 1 of the displayed screen */
+static void copyrows (uae_u8 *src, uae_u8 *dst, int y, int lines)
+{
+	struct picasso_vidbuf_description *vidinfo = &picasso_vidinfo;
+	struct picasso96_state_struct *state = &picasso96_state;
+  int pixels = state->Width * lines;
+
+  dst += y * state->Width * vidinfo->pixbytes;
+  src += y * p96_src_pitch ();
+  if (picasso_native_format ()) {
+    memcpy (dst, src, pixels * vidinfo->pixbytes);
+  } else if (state->RGBFormat == RGBFB_R5G6B5PC) {
+    copy_screen_16bitpc_to_32bit ((uae_u32 *)dst, (uae_u16 *)src, pixels);
+  } else if (state->RGBFormat == RGBFB_B8G8R8A8) {
+    copy_screen_32bitpc_to_16bit ((uae_u16 *)dst, (uae_u32 *)src, pixels);
+  } else if (state->RGBFormat == RGBFB_R5G6B5) {
     if(vidinfo->pixbytes == 2)
-      copy_screen_16bit_swap(dst, src, state->Width * state->Height * 2);
+      copy_screen_16bit_swap(dst, src, pixels * 2);
     else
-      copy_screen_16bit_to_32bit(dst, src, state->Width * state->Height * 2);
+      copy_screen_16bit_to_32bit(dst, src, pixels * 2);
   } else if(state->RGBFormat == RGBFB_CLUT) {
-    int pixels = state->Width * state->Height;
     if(vidinfo->pixbytes == 2)
       copy_screen_8bit_to_16bit(dst, src, pixels, vidinfo->clut);
     else
       copy_screen_8bit_to_32bit(dst, src, pixels, vidinfo->clut);
   } else {
     if(vidinfo->pixbytes == 2)
-      copy_screen_32bit_to_16bit(dst, src, state->Width * state->Height * 4);
+      copy_screen_32bit_to_16bit(dst, src, pixels * 4);
     else
-      copy_screen_32bit_to_32bit(dst, src, state->Width * state->Height * 4);
+      copy_screen_32bit_to_32bit(dst, src, pixels * 4);
+  }
+}
+
+static void copyall (uae_u8 *src, uae_u8 *dst)
+{
+	copyrows (src, dst, 0, picasso96_state.Height);
+}
+
+STATIC_INLINE bool p96_rows_dirty (int off, int y, int rows, int bpr)
+{
+  uae_u32 page = (off + y * bpr) >> P96_DIRTY_SHIFT;
+  uae_u32 last = (off + (y + rows) * bpr - 1) >> P96_DIRTY_SHIFT;
+  if (last >= p96_dirty_pages)
+    last = p96_dirty_pages - 1;
+  for (; page <= last; page++) {
+    if (p96_dirty[page])
+      return true;
+  }
+  return false;
+}
+
+/* Convert only the rows touching pages written since the last flush.
+ * Runs start and end on even lines, the copy helpers work on blocks
+ * of two lines. Returns the number of lines converted. */
+static int copydirty (uae_u8 *src, uae_u8 *dst, int off)
+{
+	struct picasso96_state_struct *state = &picasso96_state;
+  int bpr = p96_src_pitch ();
+  int height = state->Height & ~1;
+  int y, first = -1, copied = 0;
+
+  for (y = 0; y <= height; y += 2) {
+    if (y < height && p96_rows_dirty (off, y, 2, bpr)) {
+      if (first < 0)
+        first = y;
+    } else if (first >= 0) {
+      copyrows (src, dst, first, y - first);
+      copied += y - first;
+      first = -1;
+    }
   }
+  if (height < state->Height && p96_rows_dirty (off, height, 1, bpr)) {
+    /* odd height, redo the last pair of lines */
+    copyrows (src, dst, height - 1, 2);
+    copied += 2;
+  }
+  return copied;
 }
 
 static bool picasso_flushpixels (uae_u8 *src, int off)
 {
 	struct picasso_vidbuf_description *vidinfo = &picasso_vidinfo;
 	struct picasso96_state_struct *state = &picasso96_state;
+  static uae_u8 *odst, *osrc;
+  static int ooff, owidth, oheight, oformat, opixbytes;
+  static bool ostatusline;
   uae_u8 *src_start;
   uae_u8 *src_end;
   uae_u8 *dst = NULL;
+  bool statusline = (currprefs.leds_on_screen & STATUSLINE_RTG) != 0;
+  int lines;
 	int pwidth = state->Width > state->VirtualWidth ? state->VirtualWidth : state->Width;
 	int pheight = state->Height > state->VirtualHeight ? state->VirtualHeight : state->Height;
 
@@ -2922,13 +3062,61 @@ static bool picasso_flushpixels (uae_u8 *src, int off)
 	  return false;
   }
 
+  /* Same layout as the host: let the host show Amiga memory as it is */
+  if (picasso_native_format () && !statusline && savestate_state != STATE_DOSAVE
+    && state->Width == vidinfo->width && state->Width == pwidth && state->Height == pheight) {
+    if (gfx_picasso_direct (src_start, state->BytesPerRow)) {
+      odst = NULL;
+      if (p96_dirty)
+        memset (p96_dirty, 0, p96_dirty_pages);
+      p96_bytes_full += (uae_u64)state->Height * state->Width * vidinfo->pixbytes;
+      return true;
+    }
+  }
+
   dst = gfx_lock_picasso ();
   if (dst == NULL)
     return false;
 
-  copyall (src + off, dst);
+  if (p96_dirty_pages != (gfxmem_bank.allocated_size >> P96_DIRTY_SHIFT)) {
+    xfree (p96_dirty);
+    p96_dirty_pages = gfxmem_bank.allocated_size >> P96_DIRTY_SHIFT;
+    p96_dirty = xcalloc (uae_u8, p96_dirty_pages);
+    p96_full_refresh = true;
+  }
+  if (dst != odst || src != osrc || off != ooff || state->Width != owidth || state->Height != oheight
+    || state->RGBFormat != oformat || vidinfo->pixbytes != opixbytes || statusline != ostatusline) {
+    odst = dst;
+    osrc = src;
+    ooff = off;
+    owidth = state->Width;
+    oheight = state->Height;
+    oformat = state->RGBFormat;
+    opixbytes = vidinfo->pixbytes;
+    ostatusline = statusline;
+    p96_full_refresh = true;
+  }
+  /* Compiled code that was translated while it did not touch gfx memory
+   * writes there directly, so under JIT nothing reliably marks the pages
+   * dirty. Copy everything then and let the JIT access gfx memory directly,
+   * going through the put functions would only slow it down. */
+  if (gfxmem_bank.jit_write_flag != (currprefs.cachesize ? 0 : S_WRITE)) {
+    gfxmem_bank.jit_write_flag = currprefs.cachesize ? 0 : S_WRITE;
+    p96_full_refresh = true;
+  }
+  if (p96_full_refresh || !p96_dirty || currprefs.cachesize) {
+    copyall (src + off, dst);
+    lines = state->Height;
+    p96_full_refresh = false;
+  } else {
+    lines = copydirty (src + off, dst, off);
+  }
+  if (p96_dirty)
+    memset (p96_dirty, 0, p96_dirty_pages);
+  p96_bytes_copied += (uae_u64)lines * state->Width * vidinfo->pixbytes;
+  p96_bytes_full += (uae_u64)state->Height * state->Width * vidinfo->pixbytes;
 
-  if(currprefs.leds_on_screen & STATUSLINE_RTG)
+  if(statusline)
 		picasso_statusline (dst);
 
   gfx_unlock_picasso (true);
@@ -2936,13 +3124,50 @@ static bool picasso_flushpixels (uae_u8 *src, int off)
 }
 
 extern addrbank gfxmem_bank;
-MEMORY_FUNCTIONS(gfxmem);
+MEMORY_LGET(gfxmem);
+MEMORY_WGET(gfxmem);
+MEMORY_BGET(gfxmem);
+MEMORY_CHECK(gfxmem);
+MEMORY_XLATE(gfxmem);
+
+/* Same as MEMORY_xPUT, but remember which pages were written */
+static void REGPARAM3 gfxmem_lput (uaecptr, uae_u32) REGPARAM;
+static void REGPARAM2 gfxmem_lput (uaecptr addr, uae_u32 l)
+{
+	uae_u8 *m;
+	addr -= gfxmem_bank.startaccessmask;
+	addr &= gfxmem_bank.mask;
+	p96_mark_dirty (addr, 4);
+	m = gfxmem_bank.baseaddr + addr;
+	do_put_mem_long ((uae_u32 *)m, l);
+}
+static void REGPARAM3 gfxmem_wput (uaecptr, uae_u32) REGPARAM;
+static void REGPARAM2 gfxmem_wput (uaecptr addr, uae_u32 w)
+{
+	uae_u8 *m;
+	addr -= gfxmem_bank.startaccessmask;
+	addr &= gfxmem_bank.mask;
+	p96_mark_dirty (addr, 2);
+	m = gfxmem_bank.baseaddr + addr;
+	do_put_mem_word ((uae_u16 *)m, w);
+}
+static void REGPARAM3 gfxmem_bput (uaecptr, uae_u32) REGPARAM;
+static void REGPARAM2 gfxmem_bput (uaecptr addr, uae_u32 b)
+{
+	addr -= gfxmem_bank.startaccessmask;
+	addr &= gfxmem_bank.mask;
+	if ((addr >> P96_DIRTY_SHIFT) < p96_dirty_pages)
+		p96_dirty[addr >> P96_DIRTY_SHIFT] = 1;
+	gfxmem_bank.baseaddr[addr] = b;
+}
+
+/* S_WRITE while the JIT is off, see picasso_flushpixels () */
 addrbank gfxmem_bank = {
 	gfxmem_lget, gfxmem_wget, gfxmem_bget,
 	gfxmem_lput, gfxmem_wput, gfxmem_bput,
 	gfxmem_xlate, gfxmem_check, NULL, NULL, _T("RTG RAM"),
 	dummy_lgeti, dummy_wgeti,
-	ABFLAG_RAM | ABFLAG_RTG, 0, 0
+	ABFLAG_RAM | ABFLAG_RTG, 0, S_WRITE
 };
 addrbank *gfxmem_banks[MAX_RTG_BOARDS];
 
@@ -3184,6 +3409,10 @@ static void picasso_reset2 (void)
     interrupt_enabled = 0;
   	reserved_gfxmem = 0;
   	resetpalette(state);
+		if (p96_bytes_full)
+			write_log (_T("RTG: converted %llu of %llu bytes (%d%%)\n"), p96_bytes_copied, p96_bytes_full,
+				(int)(p96_bytes_copied * 100 / p96_bytes_full));
+		p96_bytes_copied = p96_bytes_full = 0;
 		InitPicasso96 ();
 		picasso_rendered = false;
 	}
@@ -3361,6 +3590,7 @@ void restore_p96_finish (void)
 		inituaegfxfuncs(NULL, uaegfx_rom, boardinfo);
 		ad->picasso_requested_on = !!(p96_restored_flags & 1);
 		vidinfo->picasso_active = ad->picasso_requested_on;
+		p96_full_refresh = true;
 		set_config_changed();
   }
 }
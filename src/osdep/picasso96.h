@@ -611,6 +611,7 @@ extern void gfx_set_picasso_colors(RGBFTYPE rgbfmt);
 extern void gfx_set_picasso_state (int on);
 extern uae_u8 *gfx_lock_picasso (void);
 extern void gfx_unlock_picasso (bool);
+extern bool gfx_picasso_direct (uae_u8 *src, int pitch);
 
 #define LIB_SIZE 34
 #define CARD_FLAGS LIB_SIZE
@@ -15,7 +15,7 @@ void target_default_options (struct uae_prefs *p, int type)
 {
   p->gfx_monitor.gfx_size.y = OFFSET_Y_ADJUST;
   
-	p->picasso96_modeflags = RGBFF_CLUT | RGBFF_R5G6B5 | RGBFF_A8R8G8B8;
+	p->picasso96_modeflags = RGBFF_CLUT | RGBFF_R5G6B5PC | RGBFF_B8G8R8A8;
 	
 	p->cr[0].index = 0;
 	p->cr[0].rate = 60.0;
@@ -31,6 +31,13 @@ void target_default_options (struct uae_prefs *p, int type)
 	p->kbd_led_num = -1; // No status on numlock
 	p->kbd_led_scr = -1; // No status on scrollock
 	p->kbd_led_cap = -1; // No status on capslock
+
+#ifdef HEADLESS
+	p->headless_dump_interval = 0; // No frame dump
+	p->headless_dump_crc = false;
+	p->headless_max_frames = 0; // Run until quit
+	p->headless_dump_path[0] = 0;
+#endif
 }
 
 
@@ -58,9 +65,18 @@ void target_fixup_options (struct uae_prefs *p)
     p->cs_cd32fmv = 1;
   }
   
-	p->picasso96_modeflags = RGBFF_CLUT | RGBFF_R5G6B5 | RGBFF_A8R8G8B8;
+	// Older versions saved their big-endian default in every config, move
+	// those to the formats the host can show without a swap. A mask set by
+	// hand is kept.
+	if (p->picasso96_modeflags == (RGBFF_CLUT | RGBFF_R5G6B5 | RGBFF_A8R8G8B8))
+		p->picasso96_modeflags = RGBFF_CLUT | RGBFF_R5G6B5PC | RGBFF_B8G8R8A8;
   p->gfx_resolution = p->gfx_monitor.gfx_size.width > 600 ? 1 : 0;
   
+#ifdef HEADLESS
+  // No display for the gui
+  p->start_gui = false;
+#endif
+
   if(p->cachesize > 0)
     p->fpu_no_unimplemented = 0;
   else
@@ -82,6 +98,12 @@ void target_save_options (struct zfile *f, struct uae_prefs *p)
 	cfgfile_write(f, _T("kbd_led_num"), _T("%d"), p->kbd_led_num);
 	cfgfile_write(f, _T("kbd_led_scr"), _T("%d"), p->kbd_led_scr);
 	cfgfile_write(f, _T("kbd_led_cap"), _T("%d"), p->kbd_led_cap);
+#ifdef HEADLESS
+	cfgfile_write(f, _T("headless_dump_interval"), _T("%d"), p->headless_dump_interval);
+	cfgfile_write(f, _T("headless_dump_crc"), _T("%s"), p->headless_dump_crc ? _T("yes") : _T("no"));
+	cfgfile_write(f, _T("headless_max_frames"), _T("%d"), p->headless_max_frames);
+	cfgfile_write(f, _T("headless_dump_path"), _T("%s"), p->headless_dump_path);
+#endif
 }
 
 
@@ -92,6 +114,12 @@ int target_parse_option (struct uae_prefs *p, const char *option, const char *va
     || cfgfile_intval (option, value, "kbd_led_num", &p->kbd_led_num, 1)
     || cfgfile_intval (option, value, "kbd_led_scr", &p->kbd_led_scr, 1)
     || cfgfile_intval (option, value, "kbd_led_cap", &p->kbd_led_cap, 1)
+#ifdef HEADLESS
+    || cfgfile_intval (option, value, "headless_dump_interval", &p->headless_dump_interval, 1)
+    || cfgfile_yesno (option, value, "headless_dump_crc", &p->headless_dump_crc)
+    || cfgfile_intval (option, value, "headless_max_frames", &p->headless_max_frames, 1)
+    || cfgfile_string (option, value, "headless_dump_path", p->headless_dump_path, sizeof p->headless_dump_path / sizeof (TCHAR))
+#endif
     );
   if(!result) {
     result = cfgfile_intval (option, value, "move_y", &p->gfx_monitor.gfx_size.y, 1); // for compatibility only
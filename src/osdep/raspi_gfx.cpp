@@ -638,6 +638,7 @@ void black_screen_now(void)
 {
   if(prSDLScreen != NULL) {	
     SDL_FillRect(prSDLScreen, NULL, 0);
+    notice_screen_contents_lost();
     render_screen();
 	  show_screen(0);
   }
@@ -1024,7 +1025,7 @@ void picasso_InitResolutions(void)
 		for (bit_idx = 0; bit_idx < 3; ++bit_idx) {
 			int bitdepth = bits[bit_idx];
 			int bit_unit = (bitdepth + 1) & 0xF8;
-			int rgbFormat = (bitdepth == 8 ? RGBFB_CLUT : (bitdepth == 16 ? RGBFB_R5G6B5 : RGBFB_A8R8G8B8));
+			int rgbFormat = (bitdepth == 8 ? RGBFB_CLUT : (bitdepth == 16 ? RGBFB_R5G6B5PC : RGBFB_B8G8R8A8));
 			int pixelFormat = 1 << rgbFormat;
 			pixelFormat |= RGBFF_CHUNKY;
       
@@ -1092,10 +1093,15 @@ void gfx_set_picasso_modeinfo(uae_u32 w, uae_u32 h, uae_u32 depth, RGBFTYPE rgbf
 
 uae_u8 *gfx_lock_picasso(void)
 {
+	struct amigadisplay *ad = &adisplays;
+
   if(prSDLScreen == NULL || screen_is_picasso == 0)
     return NULL;
   SDL_LockSurface(prSDLScreen);
 	picasso_vidinfo.rowbytes = prSDLScreen->pitch;
+	// Back from gfx_picasso_direct()
+	ad->gfxvidinfo.drawbuffer.bufmem = (uae_u8 *)prSDLScreen->pixels;
+	ad->gfxvidinfo.drawbuffer.rowbytes = prSDLScreen->pitch;
 	return (uae_u8 *)prSDLScreen->pixels;
 }
 
@@ -1108,6 +1114,31 @@ void gfx_unlock_picasso(bool dorender)
   }
 }
 
+static void wait_for_flip(void)
+{
+	while(flip_in_progess)
+		usleep(10);
+}
+
+// Let the display thread write the resource straight from Amiga memory.
+// The Amiga keeps drawing into that memory, so the frame is only handed
+// over when no other flip is pending, and we wait until the display thread
+// has written it before the emulation goes on.
+bool gfx_picasso_direct(uae_u8 *src, int pitch)
+{
+	struct amigadisplay *ad = &adisplays;
+
+  if(prSDLScreen == NULL || screen_is_picasso == 0)
+    return false;
+  wait_for_flip();
+	ad->gfxvidinfo.drawbuffer.bufmem = src;
+	ad->gfxvidinfo.drawbuffer.rowbytes = pitch;
+  render_screen();
+  show_screen(0);
+  wait_for_flip();
+  return true;
+}
+
 void gfx_set_picasso_colors(RGBFTYPE rgbfmt)
 {
 	alloc_colors_picasso(red_bits, green_bits, blue_bits, red_shift, green_shift, blue_shift, rgbfmt, p96_rgbx16);
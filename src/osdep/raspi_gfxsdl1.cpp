@@ -22,6 +22,8 @@
 #include "threaddep/thread.h"
 #include <sys/ioctl.h>
 #include <linux/fb.h>
+#include <time.h>
+#include <math.h>
 
 #define DISPLAY_SIGNAL_SETUP 				1
 #define DISPLAY_SIGNAL_SUBSHUTDOWN 	2
@@ -88,6 +90,56 @@ static const int sync_epsilon = 1000;
 static uae_u32 next_amiga_frame_ends = 0;
 extern void sound_adjust(float factor);
 
+/* vsync_sem is only posted while someone waits for the next host frame */
+static uae_sem_t vsync_sem = 0;
+static bool volatile vsync_waiting = false;
+
+/* Frame pacing: sleep until shortly before the deadline, spin the rest */
+static const int pacing_spin_window = 250; // microsecs
+static int pacing_frames = 0;
+static uae_s32 pacing_late_max = 0;
+static uae_s64 pacing_late_sum = 0;
+static uae_s64 pacing_late_sqsum = 0;
+
+static void wait_until(uae_u32 deadline)
+{
+  uae_s32 remaining = deadline - read_processor_time();
+  if(remaining > pacing_spin_window) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    uae_s64 ns = (uae_s64)ts.tv_nsec + (uae_s64)(remaining - pacing_spin_window) * 1000;
+    ts.tv_sec += ns / 1000000000;
+    ts.tv_nsec = ns % 1000000000;
+    while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+      ;
+  }
+  while((uae_s32)(deadline - read_processor_time()) > 0)
+    ;
+}
+
+static void pacing_record(uae_s32 late)
+{
+  pacing_frames++;
+  pacing_late_sum += late;
+  pacing_late_sqsum += (uae_s64)late * late;
+  if(late > pacing_late_max)
+    pacing_late_max = late;
+}
+
+static void pacing_report(void)
+{
+  if(pacing_frames == 0)
+    return;
+  double avg = (double)pacing_late_sum / pacing_frames;
+  double var = (double)pacing_late_sqsum / pacing_frames - avg * avg;
+  write_log("Frame pacing: late avg %.1f us, max %d us, jitter %.1f us\n",
+    avg, pacing_late_max, var > 0 ? sqrt(var) : 0.0);
+  pacing_frames = 0;
+  pacing_late_max = 0;
+  pacing_late_sum = 0;
+  pacing_late_sqsum = 0;
+}
+
 
 static void vsync_callback(void)
 {
@@ -140,13 +192,32 @@ static void vsync_callback(void)
 }
 
 
+// A waiter can time out just as the vsync thread posts. Drop such a stale
+// post, or the next wait would return before the next frame.
+static void vsync_wait_begin(void)
+{
+  if(vsync_sem != 0) {
+    while(uae_sem_trywait(&vsync_sem) == 0)
+      ;
+  }
+  vsync_waiting = true;
+}
+
 void wait_for_vsync(void)
 {
   uae_u32 start = read_processor_time();
+  vsync_wait_begin();
   int wait_till = host_frame;
-  do {
-    usleep(10);
-  } while (wait_till >= host_frame && read_processor_time() - start < 500000); // wait max. 0.5 sec
+  while (wait_till >= host_frame) {
+    int left = 500 - (int)(read_processor_time() - start) / 1000; // wait max. 0.5 sec
+    if(left <= 0)
+      break;
+    if(vsync_sem != 0)
+      uae_sem_trywait_delay(&vsync_sem, left);
+    else
+      usleep(1000);
+  }
+  vsync_waiting = false;
 }
 
 void reset_sync(void)
@@ -182,6 +253,8 @@ static int vsync_thread (void *unused)
       break;
     }
     vsync_callback();
+    if(vsync_waiting)
+      uae_sem_post(&vsync_sem);
     usleep(1000);
   }
   close(fbdev_sync);
@@ -251,6 +324,9 @@ int graphics_setup(void)
   if(display_sem == 0) {
     uae_sem_init (&display_sem, 0, 0);
   }
+  if(vsync_sem == 0) {
+    uae_sem_init (&vsync_sem, 0, 0);
+  }
   if(display_tid == 0 && display_pipe != 0 && display_sem != 0) {
     uae_start_thread(_T("render"), display_thread, NULL, &display_tid);
     uae_start_thread(_T("vsync"), vsync_thread, NULL, &vsync_tid);
@@ -329,6 +405,7 @@ static void InitAmigaVidMode(struct uae_prefs *p)
 	ad->gfxvidinfo.drawbuffer.outwidth = p->gfx_monitor.gfx_size.width;
 	ad->gfxvidinfo.drawbuffer.outheight = p->gfx_monitor.gfx_size.height << p->gfx_vresolution;
 	ad->gfxvidinfo.drawbuffer.rowbytes = prSDLScreen->pitch;
+	ad->gfxvidinfo.drawbuffer.double_buffered = (prSDLScreen->flags & SDL_DOUBLEBUF) != 0;
 }
 
 
@@ -357,6 +434,8 @@ void graphics_thread_leave(void)
 	  display_pipe = 0;
 	  uae_sem_destroy(&display_sem);
 	  display_sem = 0;
+	  uae_sem_destroy(&vsync_sem);
+	  vsync_sem = 0;
 	}
 }
 
@@ -491,10 +570,15 @@ void show_screen(int mode)
     if (config_changed)
       reset_sync();
       
-    last_synctime = start;
-    while(last_synctime < next_amiga_frame_ends && last_synctime < start + time_per_frame) {
-      usleep(10);
+    uae_u32 deadline = next_amiga_frame_ends;
+    if(deadline > start + time_per_frame)
+      deadline = start + time_per_frame;
+    if(start < deadline) {
+      wait_until(deadline);
       last_synctime = read_processor_time();
+      pacing_record(last_synctime - deadline);
+    } else {
+      last_synctime = start;
     }
     amiga_frame = amiga_frame + 1;
 
@@ -531,6 +615,7 @@ void show_screen(int mode)
         }
         write_log("Diff Amiga frame to host: %6d, time_per_frame = %6d\n", diff, time_per_frame);
       }
+      pacing_report();
       host_frame = 0;
       amiga_frame = 0;
     }
@@ -558,6 +643,7 @@ void black_screen_now(void)
 {
   if(prSDLScreen != NULL) {	
     SDL_FillRect(prSDLScreen, NULL, 0);
+    notice_screen_contents_lost();
     render_screen();
 	  show_screen(0);
   }
@@ -567,16 +653,21 @@ int sleep_millis_main (int ms)
 {
 	int ret = 0;
 	uae_u32 start = read_processor_time ();
+	// Sleep until timeout or next host vsync
+	vsync_wait_begin();
 	uae_u32 frame = total_host_frames;
-	int wait = ms * 1000;
-	while (wait > 0) {
-    usleep(50);
-    if (frame != total_host_frames) {
-      ret = -1;
-      break;
-    }
-    wait -= 50;
+	while (frame == total_host_frames) {
+	  int left = ms - (int)(read_processor_time () - start) / 1000;
+	  if (left <= 0)
+	    break;
+	  if (vsync_sem != 0)
+	    uae_sem_trywait_delay(&vsync_sem, left);
+	  else
+	    usleep(left * 1000);
   }
+	vsync_waiting = false;
+	if (frame != total_host_frames)
+	  ret = -1;
   idletime += read_processor_time () - start;
   return ret;
 }
@@ -944,7 +1035,7 @@ void picasso_InitResolutions(void)
 		for (bit_idx = 0; bit_idx < 3; ++bit_idx) {
 			int bitdepth = bits[bit_idx];
 			int bit_unit = (bitdepth + 1) & 0xF8;
-			int rgbFormat = (bitdepth == 8 ? RGBFB_CLUT : (bitdepth == 16 ? RGBFB_R5G6B5 : RGBFB_A8R8G8B8));
+			int rgbFormat = (bitdepth == 8 ? RGBFB_CLUT : (bitdepth == 16 ? RGBFB_R5G6B5PC : RGBFB_B8G8R8A8));
 			int pixelFormat = 1 << rgbFormat;
 			pixelFormat |= RGBFF_CHUNKY;
       
@@ -1028,6 +1119,12 @@ void gfx_unlock_picasso(bool dorender)
   }
 }
 
+bool gfx_picasso_direct(uae_u8 *src, int pitch)
+{
+  // Screen is always updated from prSDLScreen
+  return false;
+}
+
 void gfx_set_picasso_colors(RGBFTYPE rgbfmt)
 {
 	alloc_colors_picasso(red_bits, green_bits, blue_bits, red_shift, green_shift, blue_shift, rgbfmt, p96_rgbx16);
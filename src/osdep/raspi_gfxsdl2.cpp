@@ -62,6 +62,10 @@ SDL_Texture* texture;
 SDL_DisplayMode sdlMode;
 
 static volatile uae_atomic vsync_counter = 0;
+
+// RTG frame in Amiga memory, uploaded to the texture without going through prSDLScreen
+static uae_u8 *picasso_direct_src = NULL;
+static int picasso_direct_pitch;
 void vsync_callback(unsigned int a, void* b)
 {
   atomic_inc(&vsync_counter);
@@ -391,8 +395,11 @@ bool render_screen (void)
 
   RefreshLiveInfo();
   
-	// Update the texture from the surface
-	SDL_UpdateTexture(texture, NULL, prSDLScreen->pixels, prSDLScreen->pitch);
+	// Update the texture from the surface, or from Amiga memory for a direct RTG frame
+	if (picasso_direct_src != NULL)
+		SDL_UpdateTexture(texture, NULL, picasso_direct_src, picasso_direct_pitch);
+	else
+		SDL_UpdateTexture(texture, NULL, prSDLScreen->pixels, prSDLScreen->pitch);
 	SDL_RenderClear(renderer);
 	// Copy the texture on the renderer
 	SDL_RenderCopy(renderer, texture, NULL, NULL);
@@ -467,6 +474,7 @@ void black_screen_now(void)
 {
   if(prSDLScreen != NULL) {	
     SDL_FillRect(prSDLScreen, NULL, 0);
+    notice_screen_contents_lost();
     render_screen();
 	  show_screen(0);
   }
@@ -838,7 +846,7 @@ void picasso_InitResolutions(void)
 		for (bit_idx = 0; bit_idx < 3; ++bit_idx) {
 			int bitdepth = bits[bit_idx];
 			int bit_unit = (bitdepth + 1) & 0xF8;
-			int rgbFormat = (bitdepth == 8 ? RGBFB_CLUT : (bitdepth == 16 ? RGBFB_R5G6B5 : RGBFB_A8R8G8B8));
+			int rgbFormat = (bitdepth == 8 ? RGBFB_CLUT : (bitdepth == 16 ? RGBFB_R5G6B5PC : RGBFB_B8G8R8A8));
 			int pixelFormat = 1 << rgbFormat;
 			pixelFormat |= RGBFF_CHUNKY;
       
@@ -917,4 +925,16 @@ void gfx_unlock_picasso(bool dorender)
   }
 }
 
+bool gfx_picasso_direct(uae_u8 *src, int pitch)
+{
+  if(prSDLScreen == NULL || screen_is_picasso == 0)
+    return false;
+  picasso_direct_src = src;
+  picasso_direct_pitch = pitch;
+  render_screen();
+  show_screen(0);
+  picasso_direct_src = NULL;
+  return true;
+}
+
 #endif // PICASSO96
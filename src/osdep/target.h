@@ -82,7 +82,7 @@ extern void input_closeall(void);
 extern int get_sdlkbd (void);
 extern int get_sdlmouse (void);
 
-#if defined(RASPBERRY) && !defined(USE_SDL2)
+#if (defined(RASPBERRY) || defined(HEADLESS)) && !defined(USE_SDL2)
 extern void graphics_thread_leave(void);
 #endif
 
@@ -57,10 +57,42 @@
 #include "filesys.h"
 #include "devices.h"
 #include "fsdb.h"
+#include "threaddep/thread.h"
 
 int savestate_state = 0;
 
 static struct zfile *savestate_file;
+static bool savestate_capturing;
+static bool savestate_writer_capturing;
+static struct zfile *staterecord_restore_file;
+static frame_time_t savestate_restore_start;
+
+/* Incremental statefiles only hold the RAM pages that differ from the last
+ * full statefile saved in this session, the base. */
+#define MAX_BASE_RAMS 16
+struct statefile_base_ram {
+	TCHAR name[5];
+	int len;
+	uae_u64 *hashes;
+};
+/* What save_ram () works from, so the statefile writer thread does not
+ * touch the globals or currprefs. For a new base it collects the hashes
+ * here, statefile_ramsave_done () takes them over. */
+struct statefile_ramsave {
+	bool new_base;
+	bool incremental;
+	int compress;
+	struct statefile_base_ram rams[MAX_BASE_RAMS];
+	int ramcnt;
+};
+static TCHAR statefile_base[MAX_DPATH];
+static struct statefile_base_ram statefile_base_rams[MAX_BASE_RAMS];
+static int statefile_base_ramcnt;
+static bool statefile_new_base;
+static uae_u32 statefile_base_id;
+static TCHAR statefile_base_restore[MAX_DPATH];
+
+static bool savestate_writer_finish (bool wait);
 
 TCHAR savestate_fname[MAX_DPATH];
 
@@ -294,41 +326,147 @@ TCHAR *restore_path_full_func(uae_u8 **dstp)
 
 /* read and write IFF-style hunks */
 
-static void save_chunk (struct zfile *f, uae_u8 *chunk, unsigned int len, const TCHAR *name)
+static bool is_ram_chunk (const TCHAR *name)
 {
-  uae_u8 tmp[8], *dst;
-  uae_u8 zero[4]= { 0, 0, 0, 0 };
-  uae_u32 flags;
-	unsigned int pos;
-	unsigned int chunklen, len2;
-	char *s;
+  return !_tcscmp (name, _T("CRAM"))
+  	|| !_tcscmp (name, _T("BRAM"))
+  	|| !_tcscmp (name, _T("FRAM"))
+  	|| !_tcscmp (name, _T("ZRAM"))
+  	|| !_tcscmp (name, _T("PRAM"))
+  	|| !_tcscmp (name, _T("A3K1"))
+		|| !_tcscmp (name, _T("A3K2"))
+		|| !_tcscmp (name, _T("BORO"));
+}
 
-  if (!chunk)
-  	return;
+/* chunk flags */
+#define CHUNK_COMPRESSED 1	/* zlib stream, preceded by the uncompressed size */
+#define CHUNK_DELTA 2		/* RAM pages changed since the BASE statefile */
+
+#define DELTA_PAGE_SHIFT 12
+#define DELTA_PAGE_SIZE (1 << DELTA_PAGE_SHIFT)
+
+/* Where chunks are written to: a zfile, or a plain FILE in the statefile
+ * writer thread. The zfile list is not locked, so that thread must not
+ * open or close zfiles. */
+struct statefile_sink {
+	struct zfile *zf;
+	FILE *fp;
+};
+
+static int sink_write (void *ud, const uae_u8 *data, int len)
+{
+	struct statefile_sink *sk = (struct statefile_sink*)ud;
+	if (sk->fp)
+		return (int)fwrite (data, 1, len, sk->fp);
+	return (int)zfile_fwrite (data, 1, len, sk->zf);
+}
+
+static uae_s64 sink_tell (struct statefile_sink *sk)
+{
+	if (sk->fp)
+		return ftello (sk->fp);
+	return zfile_ftell (sk->zf);
+}
+
+static void sink_seek (struct statefile_sink *sk, uae_s64 pos)
+{
+	if (sk->fp)
+		fseeko (sk->fp, pos, SEEK_SET);
+	else
+		zfile_fseek (sk->zf, pos, SEEK_SET);
+}
+
+static void save_chunk_head (struct statefile_sink *sk, unsigned int len, const TCHAR *name, uae_u32 flags)
+{
+  uae_u8 tmp[12], *dst;
+	unsigned int chunklen;
+	char *s;
 
   /* chunk name */
 	s = ua (name);
-	zfile_fwrite (s, 1, 4, f);
+	memcpy (tmp, s, 4);
 	xfree (s);
-  pos = zfile_ftell (f);
   /* chunk size */
-  dst = &tmp[0];
+  dst = &tmp[4];
   chunklen = len + 4 + 4 + 4;
   save_u32 (chunklen);
-  zfile_fwrite (&tmp[0], 1, 4, f);
   /* chunk flags */
-  flags = 0;
-  dst = &tmp[0];
   save_u32 (flags);
-  zfile_fwrite (&tmp[0], 1, 4, f);
-  /* chunk data */
-  zfile_fwrite (chunk, 1, len, f);
+  sink_write (sk, tmp, 12);
+}
+
+static void save_chunk_tail (struct statefile_sink *sk, unsigned int len)
+{
+  uae_u8 zero[4]= { 0, 0, 0, 0 };
+	unsigned int len2;
+
   /* alignment */
   len2 = 4 - (len & 3);
   if (len2)
-  	zfile_fwrite (zero, 1, len2, f);
+  	sink_write (sk, zero, len2);
+}
+
+static void save_chunk (struct zfile *f, uae_u8 *chunk, unsigned int len, const TCHAR *name)
+{
+  struct statefile_sink sk = { f, NULL };
+
+  if (!chunk)
+  	return;
+
+  save_chunk_head (&sk, len, name, 0);
+  /* chunk data */
+  zfile_fwrite (chunk, 1, len, f);
+  save_chunk_tail (&sk, len);
+
+	if (!savestate_capturing)
+		write_log (_T("Chunk '%s' chunk size %u (%u)\n"), name, len + 4 + 4 + 4, len);
+}
 
-	write_log (_T("Chunk '%s' chunk size %u (%u)\n"), name, chunklen, len);
+/* Write a RAM chunk. With CHUNK_DELTA the data is preceded by the size of
+ * the RAM, with CHUNK_COMPRESSED by the size of the uncompressed data. */
+static void save_chunk_data (struct statefile_sink *sk, uae_u8 *chunk, unsigned int len, const TCHAR *name, uae_u32 flags, unsigned int ramlen, int compress)
+{
+  uae_u8 tmp[8], *dst;
+  uae_s64 headpos, datapos;
+  int clen = -1;
+  bool compressed = false;
+
+  if (!chunk)
+  	return;
+
+  headpos = sink_tell (sk);
+  dst = &tmp[0];
+  if (flags & CHUNK_DELTA)
+  	save_u32 (ramlen);
+  if (compress > 0) {
+  	save_u32 (len);
+	  save_chunk_head (sk, 0, name, flags | CHUNK_COMPRESSED);
+	  sink_write (sk, &tmp[0], dst - tmp);
+  	datapos = sink_tell (sk);
+  	clen = zfile_zcompress (sink_write, sk, chunk, len, compress);
+  }
+  if (clen < 0) {
+  	/* plain */
+  	sink_seek (sk, headpos);
+  	dst = &tmp[0];
+	  if (flags & CHUNK_DELTA)
+	  	save_u32 (ramlen);
+  	clen = (dst - tmp) + len;
+	  save_chunk_head (sk, clen, name, flags);
+	  sink_write (sk, &tmp[0], dst - tmp);
+  	sink_write (sk, chunk, len);
+  } else {
+  	/* now we know the chunk size */
+  	compressed = true;
+  	clen += dst - tmp;
+  	sink_seek (sk, headpos);
+  	save_chunk_head (sk, clen, name, flags | CHUNK_COMPRESSED);
+  	sink_seek (sk, datapos + clen - (dst - tmp));
+  }
+  save_chunk_tail (sk, clen);
+
+	write_log (_T("Chunk '%s' chunk size %u (%u%s%s)\n"), name, clen + 4 + 4 + 4, len,
+		(flags & CHUNK_DELTA) ? _T(", changed pages") : _T(""), compressed ? _T(", compressed") : _T(""));
 }
 
 static uae_u8 *restore_chunk (struct zfile *f, TCHAR *name, unsigned int *len, unsigned int *totallen, size_t *filepos)
@@ -336,6 +474,7 @@ static uae_u8 *restore_chunk (struct zfile *f, TCHAR *name, unsigned int *len, u
   uae_u8 tmp[6], dummy[4], *mem, *src;
   uae_u32 flags;
   int len2;
+  size_t datapos;
 
   *totallen = 0;
 	*filepos = 0;
@@ -368,28 +507,37 @@ static uae_u8 *restore_chunk (struct zfile *f, TCHAR *name, unsigned int *len, u
   src = tmp;
   flags = restore_u32 ();
   *totallen = *len;
-  *filepos = zfile_ftell (f) - 4 - 4;
+  datapos = zfile_ftell (f);
+  *filepos = datapos - 4 - 4;
   /* chunk data.  RAM contents will be loaded during the reset phase,
      no need to malloc multiple megabytes here.  */
-  if (_tcscmp (name, _T("CRAM")) != 0
-  	&& _tcscmp (name, _T("BRAM")) != 0
-  	&& _tcscmp (name, _T("FRAM")) != 0
-  	&& _tcscmp (name, _T("ZRAM")) != 0
-  	&& _tcscmp (name, _T("PRAM")) != 0
-  	&& _tcscmp (name, _T("A3K1")) != 0
-		&& _tcscmp (name, _T("A3K2")) != 0
-		&& _tcscmp (name, _T("BORO")) != 0
-	)
-  {
+  if (!is_ram_chunk (name)) {
+  	if (flags & CHUNK_COMPRESSED) {
+	    if (zfile_fread (tmp, 1, 4, f) != 4) {
+	    	*name = 0;
+	    	return NULL;
+	    }
+	    src = tmp;
+	    *len = *totallen = restore_u32 ();
+	  }
   	/* extra bytes at the end needed to handle old statefiles that now have new fields */
 	  mem = xcalloc (uae_u8, *totallen + 100); 
 	  if (!mem)
 	  	return NULL;
-    zfile_fread (mem, 1, len2, f);
+  	if (flags & CHUNK_COMPRESSED)
+	    zfile_zuncompress (mem, *totallen, f, len2 - 4);
+  	else
+      zfile_fread (mem, 1, len2, f);
   } else {
 	  mem = 0;
-	  zfile_fseek (f, len2, SEEK_CUR);
+  	if (flags & (CHUNK_COMPRESSED | CHUNK_DELTA)) {
+	    /* size of the RAM comes first */
+	    zfile_fread (tmp, 1, 4, f);
+	    src = tmp;
+	    *totallen = restore_u32 ();
+  	}
   }
+  zfile_fseek (f, datapos + len2, SEEK_SET);
 
   /* alignment */
   len2 = 4 - (len2 & 3);
@@ -398,21 +546,145 @@ static uae_u8 *restore_chunk (struct zfile *f, TCHAR *name, unsigned int *len, u
   return mem;
 }
 
-void restore_ram (size_t filepos, uae_u8 *memory)
+static bool restore_ram_file (struct zfile *f, size_t filepos, uae_u8 *memory, bool isbase);
+
+/* The base must be the statefile the delta was saved against, not just
+ * any file that happens to sit at the same path. */
+static bool statefile_check_base (const TCHAR *path, uae_u32 id)
+{
+  struct zfile *f;
+  TCHAR cname[5];
+  unsigned int len, totallen;
+  size_t filepos;
+  uae_u8 *chunk;
+  uae_u32 baseid = 0;
+
+	f = zfile_fopen (path, _T("rb"), ZFD_NORMAL);
+  if (!f) {
+		write_log (_T("Base statefile '%s' missing or unreadable\n"), path);
+  	return false;
+  }
+  for (;;) {
+  	chunk = restore_chunk (f, cname, &len, &totallen, &filepos);
+  	if (cname[0] == 0 || !_tcscmp (cname, _T("END "))) {
+	    xfree (chunk);
+	    break;
+  	}
+  	if (!_tcscmp (cname, _T("BSID")) && chunk && len >= 4) {
+	    uae_u8 *src = chunk;
+	    baseid = restore_u32 ();
+	    xfree (chunk);
+	    break;
+  	}
+  	xfree (chunk);
+  }
+  zfile_fclose (f);
+  if (!id || baseid != id) {
+		write_log (_T("Base statefile '%s' does not match (%08x, expected %08x)\n"), path, baseid, id);
+  	return false;
+  }
+  return true;
+}
+
+/* Load a RAM chunk from the base of an incremental statefile */
+static bool restore_ram_base (const TCHAR *name, uae_u8 *memory, unsigned int ramlen)
+{
+  struct zfile *f;
+  TCHAR cname[5];
+  unsigned int len, totallen;
+  size_t filepos;
+  uae_u8 *chunk;
+  bool ok = false;
+
+	f = zfile_fopen (statefile_base_restore, _T("rb"), ZFD_NORMAL);
+  if (!f) {
+		write_log (_T("Base statefile '%s' missing, %s not restored\n"), statefile_base_restore, name);
+  	return false;
+  }
+  for (;;) {
+  	chunk = restore_chunk (f, cname, &len, &totallen, &filepos);
+  	xfree (chunk);
+  	if (cname[0] == 0 || !_tcscmp (cname, _T("END ")))
+	    break;
+  	if (!_tcscmp (cname, name)) {
+	    if (totallen == ramlen)
+	    	ok = restore_ram_file (f, filepos, memory, true);
+	    break;
+  	}
+  }
+  zfile_fclose (f);
+  if (!ok)
+		write_log (_T("Base statefile '%s' has no matching %s\n"), statefile_base_restore, name);
+  return ok;
+}
+
+static bool restore_ram_file (struct zfile *f, size_t filepos, uae_u8 *memory, bool isbase)
 {
   uae_u8 tmp[8];
   uae_u8 *src = tmp;
-  int size;
-  uae_u32 flags;
+  uae_u8 *delta = NULL;
+  int size, dlen = 0;
+  uae_u32 flags, ramlen = 0;
+  TCHAR name[5];
     
-  if (filepos == 0 || memory == NULL)
-  	return;
-  zfile_fseek (savestate_file, filepos, SEEK_SET);
-  zfile_fread (tmp, 1, sizeof tmp, savestate_file);
+  zfile_fseek (f, filepos - 4, SEEK_SET);
+	zfile_fread (tmp, 1, 4, f);
+	tmp[4] = 0;
+	au_copy (name, 5, (char*)tmp);
+  zfile_fread (tmp, 1, sizeof tmp, f);
+  src = tmp;
   size = restore_u32();
   flags = restore_u32();
   size -= 4 + 4 + 4;
-  zfile_fread (memory, 1, size, savestate_file);
+  if (flags & CHUNK_DELTA) {
+  	if (isbase)
+	    return false;
+  	zfile_fread (tmp, 1, 4, f);
+  	src = tmp;
+  	ramlen = restore_u32 ();
+  	size -= 4;
+  	if (!restore_ram_base (name, memory, ramlen))
+	    return false;
+  }
+  if (flags & CHUNK_COMPRESSED) {
+  	zfile_fread (tmp, 1, 4, f);
+  	src = tmp;
+  	int ulen = restore_u32 ();
+  	size -= 4;
+  	if (!(flags & CHUNK_DELTA))
+	    return zfile_zuncompress (memory, ulen, f, size) == ulen;
+  	delta = xmalloc (uae_u8, ulen);
+  	dlen = zfile_zuncompress (delta, ulen, f, size);
+  } else if (flags & CHUNK_DELTA) {
+  	delta = xmalloc (uae_u8, size);
+  	dlen = zfile_fread (delta, 1, size, f);
+  } else {
+    return zfile_fread (memory, 1, size, f) == (size_t)size;
+  }
+
+  /* bitmap of changed pages, then the changed pages */
+  int pages = (ramlen + DELTA_PAGE_SIZE - 1) >> DELTA_PAGE_SHIFT;
+  uae_u8 *p = delta + (pages + 7) / 8;
+  for (int i = 0; i < pages && dlen > 0; i++) {
+  	if (!(delta[i >> 3] & (1 << (i & 7))))
+	    continue;
+  	int offset = i << DELTA_PAGE_SHIFT;
+  	int plen = ramlen - offset < DELTA_PAGE_SIZE ? ramlen - offset : DELTA_PAGE_SIZE;
+  	if (p + plen > delta + dlen)
+	    break;
+  	memcpy (memory + offset, p, plen);
+  	p += plen;
+  }
+  xfree (delta);
+  return true;
+}
+
+void restore_ram (size_t filepos, uae_u8 *memory)
+{
+  if (filepos == 0 || memory == NULL)
+  	return;
+  if (!restore_ram_file (savestate_file, filepos, memory, false))
+		write_log (_T("RAM chunk at %u could not be restored\n"), (unsigned int)filepos);
 }
 
 static void restore_header (uae_u8 *src)
@@ -440,9 +712,22 @@ void restore_state (const TCHAR *filename)
 	unsigned int len, totallen;
   size_t filepos, filesize;
 	int z3num, z2num;
+	bool rewinding = staterecord_restore_file != NULL;
+
+	/* the file may still be being written */
+	savestate_writer_finish (true);
+	savestate_restore_start = read_processor_time ();
+	statefile_base_restore[0] = 0;
 
   chunk = 0;
-	f = zfile_fopen (filename, _T("rb"), ZFD_NORMAL);
+	if (rewinding) {
+		/* see savestate_rewind() */
+		f = staterecord_restore_file;
+		staterecord_restore_file = NULL;
+		filename = zfile_getname (f);
+	} else {
+	  f = zfile_fopen (filename, _T("rb"), ZFD_NORMAL);
+	}
   if (!f)
   	goto error;
   zfile_fseek (f, 0, SEEK_END);
@@ -497,6 +782,21 @@ void restore_state (const TCHAR *filename)
 	    restore_pram (totallen, filepos);
 	    continue;
 #endif
+		} else if (!_tcscmp (name, _T("BASE"))) {
+			TCHAR *s;
+			uae_u8 *src = chunk;
+			s = restore_string ();
+			_tcsncpy (statefile_base_restore, s, MAX_DPATH - 1);
+			xfree (s);
+			uae_u32 id = restore_u32 ();
+			end = src;
+			if (!statefile_check_base (statefile_base_restore, id)) {
+				gui_message (_T("Base statefile '%s' is missing or does not match '%s'."), statefile_base_restore, filename);
+				statefile_base_restore[0] = 0;
+				goto error;
+			}
+		} else if (!_tcscmp (name, _T("BSID"))) {
+			end = chunk + len;
 		} else if (!_tcscmp (name, _T("CYCS"))) {
 			end = restore_cycles (chunk);
 		} else if (!_tcscmp (name, _T("CPU "))) {
@@ -624,7 +924,8 @@ void restore_state (const TCHAR *filename)
 		if (name[0] == 0)
 			break;
   }
-	target_addtorecent (filename, 0);
+	if (!rewinding)
+		target_addtorecent (filename, 0);
   return;
 
 error:
@@ -663,6 +964,7 @@ bool savestate_restore_finish (void)
 	savestate_state = 0;
 	init_hz_normal();
 	audio_activate ();
+	write_log (_T("STATERESTORE: done in %d ms\n"), (int)(read_processor_time () - savestate_restore_start) / 1000);
 	return true;
 }
 
@@ -676,33 +978,159 @@ void savestate_initsave (const TCHAR *filename)
   _tcscpy (savestate_fname, filename);
 }
 
-static void save_rams (struct zfile *f)
+static uae_u64 delta_page_hash (const uae_u8 *p, int len)
+{
+	uae_u64 h = 0xcbf29ce484222325ULL;
+	int i;
+
+	for (i = 0; i + 4 <= len; i += 4) {
+		h ^= *(uae_u32*)(p + i);
+		h *= 0x100000001b3ULL;
+	}
+	for (; i < len; i++) {
+		h ^= p[i];
+		h *= 0x100000001b3ULL;
+	}
+	return h;
+}
+
+static void statefile_base_free (void)
+{
+	for (int i = 0; i < statefile_base_ramcnt; i++)
+		xfree (statefile_base_rams[i].hashes);
+	statefile_base_ramcnt = 0;
+	statefile_base[0] = 0;
+}
+
+static void statefile_ramsave_init (struct statefile_ramsave *rs)
+{
+	rs->new_base = statefile_new_base;
+	rs->incremental = currprefs.statefile_incremental;
+	rs->compress = currprefs.statefile_compress;
+	rs->ramcnt = 0;
+	if (!rs->new_base) {
+		/* the hashes stay owned by the base, save_state () waits for the
+		 * writer before it frees them */
+		for (int i = 0; i < statefile_base_ramcnt; i++)
+			rs->rams[i] = statefile_base_rams[i];
+		rs->ramcnt = statefile_base_ramcnt;
+	}
+}
+
+/* Makes the hashes collected for a new base current if the save worked */
+static void statefile_ramsave_done (struct statefile_ramsave *rs, bool ok)
+{
+	if (!rs->new_base)
+		return;
+	if (ok && rs->incremental) {
+		for (int i = 0; i < rs->ramcnt; i++)
+			statefile_base_rams[i] = rs->rams[i];
+		statefile_base_ramcnt = rs->ramcnt;
+	} else {
+		for (int i = 0; i < rs->ramcnt; i++)
+			xfree (rs->rams[i].hashes);
+	}
+	rs->ramcnt = 0;
+}
+
+/* Full RAM chunk, or only the pages changed since the base statefile */
+static void save_ram (struct statefile_sink *sk, uae_u8 *mem, int len, const TCHAR *name, struct statefile_ramsave *rs)
+{
+	struct statefile_base_ram *br = NULL;
+	int pages = (len + DELTA_PAGE_SIZE - 1) >> DELTA_PAGE_SHIFT;
+
+	if (!mem || !len)
+		return;
+	if (rs->new_base) {
+		if (rs->incremental && rs->ramcnt < MAX_BASE_RAMS) {
+			br = &rs->rams[rs->ramcnt++];
+			_tcscpy (br->name, name);
+			br->len = len;
+			br->hashes = xmalloc (uae_u64, pages);
+			for (int i = 0; i < pages; i++) {
+				int offset = i << DELTA_PAGE_SHIFT;
+				br->hashes[i] = delta_page_hash (mem + offset, len - offset < DELTA_PAGE_SIZE ? len - offset : DELTA_PAGE_SIZE);
+			}
+		}
+		save_chunk_data (sk, mem, len, name, 0, len, rs->compress);
+		return;
+	}
+
+	for (int i = 0; i < rs->ramcnt; i++) {
+		if (!_tcscmp (rs->rams[i].name, name) && rs->rams[i].len == len)
+			br = &rs->rams[i];
+	}
+	if (!br) {
+		save_chunk_data (sk, mem, len, name, 0, len, rs->compress);
+		return;
+	}
+
+	int bitmaplen = (pages + 7) / 8;
+	uae_u8 *delta = xcalloc (uae_u8, bitmaplen + len);
+	uae_u8 *p = delta + bitmaplen;
+	for (int i = 0; i < pages; i++) {
+		int offset = i << DELTA_PAGE_SHIFT;
+		int plen = len - offset < DELTA_PAGE_SIZE ? len - offset : DELTA_PAGE_SIZE;
+		if (delta_page_hash (mem + offset, plen) != br->hashes[i]) {
+			delta[i >> 3] |= 1 << (i & 7);
+			memcpy (p, mem + offset, plen);
+			p += plen;
+		}
+	}
+	save_chunk_data (sk, delta, p - delta, name, CHUNK_DELTA, len, rs->compress);
+	xfree (delta);
+}
+
+/* Calls func for every RAM region that goes into a statefile */
+static void savestate_rams (void (*func)(void *ud, uae_u8 *mem, int len, const TCHAR *name), void *ud)
 {
   uae_u8 *dst;
   int len;
 
   dst = save_cram (&len);
-	save_chunk (f, dst, len, _T("CRAM"));
+	func (ud, dst, len, _T("CRAM"));
   dst = save_bram (&len);
-  save_chunk (f, dst, len, _T("BRAM"));
+  func (ud, dst, len, _T("BRAM"));
 	dst = save_a3000lram (&len);
-	save_chunk (f, dst, len, _T("A3K1"));
+	func (ud, dst, len, _T("A3K1"));
 	dst = save_a3000hram (&len);
-	save_chunk (f, dst, len, _T("A3K2"));
+	func (ud, dst, len, _T("A3K2"));
 #ifdef AUTOCONFIG
   dst = save_fram (&len, 0);
-  save_chunk (f, dst, len, _T("FRAM"));
+  func (ud, dst, len, _T("FRAM"));
   dst = save_zram (&len, 0);
-  save_chunk (f, dst, len, _T("ZRAM"));
+  func (ud, dst, len, _T("ZRAM"));
   dst = save_bootrom (&len);
-	save_chunk (f, dst, len, _T("BORO"));
+	func (ud, dst, len, _T("BORO"));
 #endif
 #ifdef PICASSO96
   dst = save_pram (&len);
-	save_chunk (f, dst, len, _T("PRAM"));
+	func (ud, dst, len, _T("PRAM"));
 #endif
 }
 
+struct save_rams_data {
+	struct statefile_sink sk;
+	struct statefile_ramsave rs;
+};
+
+static void save_rams_func (void *ud, uae_u8 *mem, int len, const TCHAR *name)
+{
+	struct save_rams_data *sd = (struct save_rams_data*)ud;
+	save_ram (&sd->sk, mem, len, name, &sd->rs);
+}
+
+static void save_rams (struct zfile *f)
+{
+	struct save_rams_data sd;
+
+	sd.sk.zf = f;
+	sd.sk.fp = NULL;
+	statefile_ramsave_init (&sd.rs);
+	savestate_rams (save_rams_func, &sd);
+	statefile_ramsave_done (&sd.rs, true);
+}
+
 /* Save all subsystems  */
 
 static int save_state_internal (struct zfile *f, const TCHAR *description, bool savepath)
@@ -714,7 +1142,8 @@ static int save_state_internal (struct zfile *f, const TCHAR *description, bool
   TCHAR name[5];
 	int i, len;
 
-	write_log (_T("STATESAVE (%s):\n"), f ? zfile_getname (f) : _T("<internal>"));
+	if (!savestate_capturing)
+	  write_log (_T("STATESAVE (%s):\n"), f ? zfile_getname (f) : _T("<internal>"));
   dst = header;
   save_u32 (0);
   save_string(_T("UAE"));
@@ -723,6 +1152,20 @@ static int save_state_internal (struct zfile *f, const TCHAR *description, bool
   save_string (description);
 	save_chunk (f, header, dst-header, _T("ASF "));
 
+	if (!savestate_capturing && currprefs.statefile_incremental) {
+		uae_u8 *base = xmalloc (uae_u8, MAX_DPATH + 1 + 4);
+		dst = base;
+		if (statefile_new_base) {
+			save_u32 (statefile_base_id);
+			save_chunk (f, base, dst - base, _T("BSID"));
+		} else {
+			save_string (statefile_base);
+			save_u32 (statefile_base_id);
+			save_chunk (f, base, dst - base, _T("BASE"));
+		}
+		xfree (base);
+	}
+
 	dst = save_cycles (&len, 0);
 	save_chunk (f, dst, len, _T("CYCS"));
 	xfree (dst);
@@ -844,7 +1287,8 @@ static int save_state_internal (struct zfile *f, const TCHAR *description, bool
 	dst = save_p96 (&len, 0);
 	save_chunk (f, dst, len, _T("P96 "));
 #endif
-  save_rams (f);
+	if (!savestate_capturing && !savestate_writer_capturing)
+    save_rams (f);
 
   dst = save_rom (1, &len, 0);
   do {
@@ -914,29 +1358,424 @@ static int save_state_internal (struct zfile *f, const TCHAR *description, bool
   return 1;
 }
 
+/* Asynchronous statefile writing.
+ *
+ * The emulation thread saves the small chunks into memory and copies RAM,
+ * compressing and writing the file is left to a worker thread. Only one
+ * save is in flight, savestate_check () picks up the result. */
+
+struct savestate_writer_ram {
+	TCHAR name[5];
+	uae_u8 *mem;
+	int len;
+};
+
+struct savestate_writer_job {
+	TCHAR filename[MAX_DPATH];
+	uae_u8 *data;
+	int len;
+	struct savestate_writer_ram rams[MAX_BASE_RAMS];
+	int ramcnt;
+	struct statefile_ramsave rs;
+	frame_time_t start;
+	unsigned int written;
+	volatile int done;
+};
+
+static struct savestate_writer_job *savestate_writer_job;
+static uae_thread_id savestate_writer_tid;
+
+static void savestate_writer_ram (void *ud, uae_u8 *mem, int len, const TCHAR *name)
+{
+	struct savestate_writer_job *job = (struct savestate_writer_job*)ud;
+	struct savestate_writer_ram *wr;
+
+	if (!mem || !len || job->ramcnt >= MAX_BASE_RAMS)
+		return;
+	wr = &job->rams[job->ramcnt++];
+	_tcscpy (wr->name, name);
+	wr->mem = xmalloc (uae_u8, len);
+	memcpy (wr->mem, mem, len);
+	wr->len = len;
+}
+
+static int savestate_writer_thread (void *data)
+{
+	uae_u8 endhunk[] = { 'E', 'N', 'D', ' ', 0, 0, 0, 8 };
+	struct savestate_writer_job *job = (struct savestate_writer_job*)data;
+	struct statefile_sink sk;
+	int done = -1;
+
+	/* plain stdio, see struct statefile_sink */
+	sk.zf = NULL;
+	sk.fp = fopen (job->filename, _T("w+b"));
+	if (sk.fp) {
+		if (fwrite (job->data, 1, job->len, sk.fp) == (size_t)job->len) {
+			for (int i = 0; i < job->ramcnt; i++)
+				save_ram (&sk, job->rams[i].mem, job->rams[i].len, job->rams[i].name, &job->rs);
+			if (fwrite (endhunk, 1, 8, sk.fp) == 8 && !ferror (sk.fp))
+				done = 1;
+		}
+		job->written = (unsigned int)ftello (sk.fp);
+		if (fclose (sk.fp))
+			done = -1;
+	}
+	job->done = done;
+	return 0;
+}
+
+/* Wait for, or just check for, the save in flight, and apply its result.
+ * Returns false if it is still running. */
+static bool savestate_writer_finish (bool wait)
+{
+	struct savestate_writer_job *job = savestate_writer_job;
+
+	if (!job)
+		return true;
+	if (!wait && !job->done)
+		return false;
+	if (savestate_writer_tid != BAD_THREAD)
+		uae_wait_thread (savestate_writer_tid);
+	savestate_writer_tid = BAD_THREAD;
+	statefile_ramsave_done (&job->rs, job->done > 0);
+	if (job->done > 0) {
+		write_log (_T("Save of '%s' complete, %u KB in %d ms%s (background)\n"), job->filename, job->written >> 10,
+			(int)(read_processor_time () - job->start) / 1000, job->rs.new_base ? _T("") : _T(" (incremental)"));
+		if (job->rs.new_base && job->rs.incremental)
+			_tcscpy (statefile_base, job->filename);
+	} else {
+		write_log (_T("Save of '%s' failed\n"), job->filename);
+		gui_message (_T("Could not write statefile '%s'."), job->filename);
+	}
+	for (int i = 0; i < job->ramcnt; i++)
+		xfree (job->rams[i].mem);
+	xfree (job->data);
+	xfree (job);
+	savestate_writer_job = NULL;
+	return true;
+}
+
+static int save_state_async (const TCHAR *filename, const TCHAR *description)
+{
+	struct savestate_writer_job *job;
+	struct zfile *f;
+
+	f = zfile_fopen_empty (NULL, filename, 0);
+	if (!f)
+		return 0;
+	job = xcalloc (struct savestate_writer_job, 1);
+	job->start = read_processor_time ();
+	_tcsncpy (job->filename, filename, MAX_DPATH - 1);
+	statefile_ramsave_init (&job->rs);
+	savestate_writer_capturing = true;
+	save_state_internal (f, description, true);
+	savestate_writer_capturing = false;
+	/* without the END hunk, the worker appends RAM chunks and END */
+	job->len = zfile_ftell (f) - 8;
+	job->data = zfile_getdata (f, 0, job->len, NULL);
+	zfile_fclose (f);
+	savestate_rams (savestate_writer_ram, job);
+
+	savestate_writer_job = job;
+	if (!uae_start_thread (_T("statefile"), savestate_writer_thread, job, &savestate_writer_tid)) {
+		/* no thread, write it here */
+		savestate_writer_tid = BAD_THREAD;
+		savestate_writer_thread (job);
+		savestate_writer_finish (true);
+		return 1;
+	}
+	write_log (_T("STATESAVE: captured in %d ms\n"), (int)(read_processor_time () - job->start) / 1000);
+	return 1;
+}
+
 int save_state (const TCHAR *filename, const TCHAR *description)
 {
 	struct zfile *f;
 
+	savestate_writer_finish (true);
   state_incompatible_warn();
   if (!save_filesys_cando()) {
 		gui_message (_T("Filesystem active. Try again later."));
     return -1;
 	}
   custom_prepare_savestate ();
+
+	/* incremental: the first save, or a save over the base, is a full one */
+	statefile_new_base = !currprefs.statefile_incremental || !statefile_base[0]
+		|| !_tcscmp (statefile_base, filename) || !zfile_exists (statefile_base);
+	if (statefile_new_base) {
+		statefile_base_free ();
+		do {
+			statefile_base_id = (uaerand () << 16) ^ uaerand () ^ (uae_u32)read_processor_time ();
+		} while (!statefile_base_id);
+	}
+
+	if (currprefs.statefile_async) {
+		int v = save_state_async (filename, description);
+		/* Not reported through savestate_state: chipset code tests it while
+		 * emulating, and the GUI sets STATE_DOSAVE afterwards for the
+		 * screenshot. savestate_check () logs the result, or shows failures. */
+		statefile_new_base = false;
+		savestate_state = 0;
+		return v;
+	}
+
+	frame_time_t start = read_processor_time ();
 	f = zfile_fopen (filename, _T("w+b"), 0);
   if (!f)
   	return 0;
 	int v = save_state_internal (f, description, true);
-	if (v)
-    write_log (_T("Save of '%s' complete\n"), filename);
+	if (v) {
+    write_log (_T("Save of '%s' complete, %u KB in %d ms%s\n"), filename, (unsigned int)(zfile_ftell (f) >> 10),
+			(int)(read_processor_time () - start) / 1000, statefile_new_base ? _T("") : _T(" (incremental)"));
+		if (statefile_new_base && currprefs.statefile_incremental)
+			_tcscpy (statefile_base, filename);
+	}
   zfile_fclose (f);
+	statefile_new_base = false;
   savestate_state = 0;
 	return v;
 }
 
+/* In-memory snapshots for rewind.
+ *
+ * Every statecapturerate frames the small chunks are saved into a memory
+ * file and RAM is split in pages. A page equal to the same page of the
+ * previous snapshot is shared instead of copied, so a snapshot costs only
+ * the RAM written since the one before. The oldest snapshots are dropped
+ * when statecapturebuffersize MB are used. */
+
+#define STATERECORD_PAGE_SHIFT 12
+#define STATERECORD_PAGE_SIZE (1 << STATERECORD_PAGE_SHIFT)
+#define MAX_STATERECORDS 256
+#define MAX_STATERECORD_RAMS 16
+
+struct staterecord_page {
+	int refcnt;
+	uae_u8 data[STATERECORD_PAGE_SIZE];
+};
+
+struct staterecord_ram {
+	TCHAR name[5];
+	int len;
+	struct staterecord_page **pages;
+};
+
+struct staterecord {
+	uae_u8 *data;
+	int len;
+	int ramcnt;
+	struct staterecord_ram rams[MAX_STATERECORD_RAMS];
+	/* data and page tables, shared pages are counted while they live */
+	size_t memused;
+};
+
+static struct staterecord staterecords[MAX_STATERECORDS];
+static int staterecord_first, staterecord_count;
+static size_t staterecord_memused;
+static int staterecord_frames;
+static struct zfile *staterecord_arena;
+
+static struct staterecord *staterecord_get (int idx)
+{
+	return &staterecords[(staterecord_first + idx) % MAX_STATERECORDS];
+}
+
+static void staterecord_free (struct staterecord *st)
+{
+	for (int i = 0; i < st->ramcnt; i++) {
+		struct staterecord_ram *sr = &st->rams[i];
+		int pages = (sr->len + STATERECORD_PAGE_SIZE - 1) >> STATERECORD_PAGE_SHIFT;
+		for (int j = 0; j < pages; j++) {
+			if (--sr->pages[j]->refcnt == 0) {
+				xfree (sr->pages[j]);
+				staterecord_memused -= sizeof (struct staterecord_page);
+			}
+		}
+		xfree (sr->pages);
+	}
+	xfree (st->data);
+	staterecord_memused -= st->memused;
+	memset (st, 0, sizeof (struct staterecord));
+}
+
+static void staterecord_free_oldest (void)
+{
+	staterecord_free (staterecord_get (0));
+	staterecord_first = (staterecord_first + 1) % MAX_STATERECORDS;
+	staterecord_count--;
+}
+
+static void staterecord_free_newest (void)
+{
+	staterecord_free (staterecord_get (staterecord_count - 1));
+	staterecord_count--;
+}
+
+void savestate_free_records (void)
+{
+	savestate_writer_finish (true);
+	while (staterecord_count > 0)
+		staterecord_free_oldest ();
+	if (staterecord_arena)
+		zfile_fclose (staterecord_arena);
+	staterecord_arena = NULL;
+}
+
+static void staterecord_ram (struct staterecord *st, struct staterecord *prev, uae_u8 *mem, int len, const TCHAR *name)
+{
+	struct staterecord_ram *sr, *psr = NULL;
+	int pages;
+
+	if (!mem || !len || st->ramcnt >= MAX_STATERECORD_RAMS)
+		return;
+	sr = &st->rams[st->ramcnt];
+	if (prev && prev->ramcnt > st->ramcnt) {
+		psr = &prev->rams[st->ramcnt];
+		if (psr->len != len || _tcscmp (psr->name, name))
+			psr = NULL;
+	}
+	st->ramcnt++;
+	_tcscpy (sr->name, name);
+	sr->len = len;
+	pages = (len + STATERECORD_PAGE_SIZE - 1) >> STATERECORD_PAGE_SHIFT;
+	sr->pages = xmalloc (struct staterecord_page*, pages);
+	st->memused += pages * sizeof (struct staterecord_page*);
+	for (int i = 0; i < pages; i++) {
+		int offset = i << STATERECORD_PAGE_SHIFT;
+		int size = len - offset < STATERECORD_PAGE_SIZE ? len - offset : STATERECORD_PAGE_SIZE;
+		struct staterecord_page *p = psr ? psr->pages[i] : NULL;
+		if (p && !memcmp (p->data, mem + offset, size)) {
+			p->refcnt++;
+		} else {
+			p = xmalloc (struct staterecord_page, 1);
+			p->refcnt = 1;
+			memcpy (p->data, mem + offset, size);
+			staterecord_memused += sizeof (struct staterecord_page);
+		}
+		sr->pages[i] = p;
+	}
+}
+
+struct staterecord_rams_ctx {
+	struct staterecord *st, *prev;
+};
+
+static void staterecord_rams_func (void *ud, uae_u8 *mem, int len, const TCHAR *name)
+{
+	struct staterecord_rams_ctx *ctx = (struct staterecord_rams_ctx*)ud;
+	staterecord_ram (ctx->st, ctx->prev, mem, len, name);
+}
+
+static void staterecord_rams (struct staterecord *st, struct staterecord *prev)
+{
+	struct staterecord_rams_ctx ctx = { st, prev };
+	savestate_rams (staterecord_rams_func, &ctx);
+}
+
+/* Called every frame, takes a snapshot when it is time for one */
+void savestate_capture (bool force)
+{
+	struct staterecord *st, *prev;
+	frame_time_t start;
+	size_t limit, used;
+	int len;
+
+	if (!currprefs.statecapture || currprefs.statecapturerate <= 0 || currprefs.statecapturebuffersize <= 0) {
+		if (staterecord_count)
+			savestate_free_records ();
+		return;
+	}
+	if (savestate_state)
+		return;
+	if (!force && ++staterecord_frames < currprefs.statecapturerate)
+		return;
+	staterecord_frames = 0;
+	if (!save_filesys_cando ())
+		return;
+
+	start = read_processor_time ();
+	custom_prepare_savestate ();
+	if (!staterecord_arena)
+		staterecord_arena = zfile_fopen_empty (NULL, _T("statecapture"), 0);
+	zfile_fseek (staterecord_arena, 0, SEEK_SET);
+	savestate_capturing = true;
+	save_state_internal (staterecord_arena, _T("rewind"), true);
+	savestate_capturing = false;
+	/* without the END hunk, RAM chunks go after the other chunks */
+	len = zfile_ftell (staterecord_arena) - 8;
+
+	if (staterecord_count == MAX_STATERECORDS)
+		staterecord_free_oldest ();
+	prev = staterecord_count ? staterecord_get (staterecord_count - 1) : NULL;
+	st = staterecord_get (staterecord_count);
+	staterecord_count++;
+	used = staterecord_memused;
+	st->data = zfile_getdata (staterecord_arena, 0, len, NULL);
+	st->len = len;
+	st->memused = len;
+	staterecord_rams (st, prev);
+	staterecord_memused += st->memused;
+	used = staterecord_memused - used;
+
+	limit = (size_t)currprefs.statecapturebuffersize * 1024 * 1024;
+	while (staterecord_memused > limit && staterecord_count > 1)
+		staterecord_free_oldest ();
+
+	if (staterecord_count == 1 || force)
+		write_log (_T("STATECAPTURE: %d records, %u KB, last %u KB in %d us\n"), staterecord_count,
+			(unsigned int)(staterecord_memused >> 10), (unsigned int)(used >> 10), (int)(read_processor_time () - start));
+}
+
+/* Turn a snapshot back into a statefile in memory */
+static struct zfile *staterecord_build (struct staterecord *st)
+{
+	uae_u8 endhunk[] = { 'E', 'N', 'D', ' ', 0, 0, 0, 8 };
+	struct zfile *f;
+	struct statefile_sink sk;
+
+	f = zfile_fopen_empty (NULL, _T("rewind"), 0);
+	if (!f)
+		return NULL;
+	sk.zf = f;
+	sk.fp = NULL;
+	zfile_fwrite (st->data, 1, st->len, f);
+	for (int i = 0; i < st->ramcnt; i++) {
+		struct staterecord_ram *sr = &st->rams[i];
+		save_chunk_head (&sk, sr->len, sr->name, 0);
+		for (int offset = 0; offset < sr->len; offset += STATERECORD_PAGE_SIZE) {
+			int size = sr->len - offset < STATERECORD_PAGE_SIZE ? sr->len - offset : STATERECORD_PAGE_SIZE;
+			zfile_fwrite (sr->pages[offset >> STATERECORD_PAGE_SHIFT]->data, 1, size, f);
+		}
+		save_chunk_tail (&sk, sr->len);
+	}
+	zfile_fwrite (endhunk, 1, 8, f);
+	zfile_fseek (f, 0, SEEK_SET);
+	return f;
+}
+
+/* Go back to the latest snapshot that is at least half a capture period old.
+ * Newer snapshots are dropped, so calling it again goes further back. */
+void savestate_rewind (void)
+{
+	struct staterecord *st;
+
+	if (savestate_state || staterecord_count == 0)
+		return;
+	if (staterecord_frames < currprefs.statecapturerate / 2 && staterecord_count > 1)
+		staterecord_free_newest ();
+	st = staterecord_get (staterecord_count - 1);
+	staterecord_restore_file = staterecord_build (st);
+	if (!staterecord_restore_file)
+		return;
+	write_log (_T("STATEREWIND: %d records left, %u KB\n"), staterecord_count, (unsigned int)(staterecord_memused >> 10));
+	staterecord_frames = 0;
+	savestate_state = STATE_DORESTORE;
+}
+
 bool savestate_check (void)
 {
+	savestate_writer_finish (false);
 	if (savestate_state == STATE_DORESTORE) {
 		savestate_state = STATE_RESTORE;
 		return true;
@@ -41,6 +41,13 @@ STATIC_INLINE void clear_sound_buffers (void)
 
 #define DEFAULT_SOUND_BITS 16
 #define DEFAULT_SOUND_FREQ 44100
+/* latency budget in samples, split between the ring and the SDL device
+ * buffer (see init_soundbuffer_usage): 1664 samples or ~38 ms at 44.1 kHz,
+ * the sound log shows the measured value. Slow hosts can raise it with
+ * sound_max_buff, up to MAX_SOUND_MAXB. */
+#define DEFAULT_SOUND_MAXB 2048
+#define MIN_SOUND_MAXB 512
+#define MAX_SOUND_MAXB 32768
 #define HAVE_STEREO_SUPPORT
 
 #define FILTER_SOUND_OFF 0
@@ -0,0 +1,159 @@
+ /*
+  * Null sound output for headless builds
+  *
+  * Paula emulation runs as usual, finished buffers are just discarded.
+  */
+
+#include "sysconfig.h"
+#include "sysdeps.h"
+#include "config.h"
+#include "uae.h"
+#include "options.h"
+#include "memory.h"
+#include "newcpu.h"
+#include "custom.h"
+#include "audio.h"
+#include "driveclick.h"
+#include "gensound.h"
+#include "sounddep/sound.h"
+
+uae_u16 sndbuffer[SOUND_BUFFERS_COUNT][(SNDBUFFER_LEN + 32) * DEFAULT_SOUND_CHANNELS];
+uae_u16 *sndbufpt = sndbuffer[0];
+uae_u16 *render_sndbuff = sndbuffer[0];
+uae_u16 *finish_sndbuff = sndbuffer[0] + SNDBUFFER_LEN * 2;
+
+uae_u16 cdaudio_buffer[CDAUDIO_BUFFERS][(CDAUDIO_BUFFER_LEN + 32) * 2];
+uae_u16 *cdbufpt = cdaudio_buffer[0];
+uae_u16 *render_cdbuff = cdaudio_buffer[0];
+uae_u16 *finish_cdbuff = cdaudio_buffer[0] + CDAUDIO_BUFFER_LEN * 2;
+bool cdaudio_active = false;
+
+static int have_sound = 0;
+static float scaled_sample_evtime_orig;
+static float snd_adjust = 1.0f;
+
+void update_sound(double clk)
+{
+	double evtime;
+
+	evtime = clk * CYCLE_UNIT / (double)currprefs.sound_freq;
+	scaled_sample_evtime_orig = evtime;
+	scaled_sample_evtime = scaled_sample_evtime_orig * snd_adjust;
+}
+
+void sound_adjust(float factor)
+{
+  snd_adjust = factor;
+  scaled_sample_evtime = scaled_sample_evtime_orig * snd_adjust;
+}
+
+
+void stop_sound(void)
+{
+}
+
+void finish_sound_buffer(void)
+{
+#ifdef DRIVESOUND
+	driveclick_mix((uae_s16*)render_sndbuff, currprefs.sound_stereo ? SNDBUFFER_LEN * 2 : SNDBUFFER_LEN);
+#endif
+	restart_sound_buffer();
+}
+
+void pause_sound_buffer(void)
+{
+	reset_sound();
+}
+
+void restart_sound_buffer(void)
+{
+	sndbufpt = render_sndbuff = sndbuffer[0];
+	if (currprefs.sound_stereo)
+		finish_sndbuff = sndbufpt + SNDBUFFER_LEN * 2;
+	else
+		finish_sndbuff = sndbufpt + SNDBUFFER_LEN;
+
+	cdbufpt = render_cdbuff = cdaudio_buffer[0];
+	finish_cdbuff = cdbufpt + CDAUDIO_BUFFER_LEN * 2;
+}
+
+void finish_cdaudio_buffer(void)
+{
+	cdbufpt = render_cdbuff = cdaudio_buffer[0];
+	finish_cdbuff = cdbufpt + CDAUDIO_BUFFER_LEN * 2;
+	audio_activate();
+}
+
+
+bool cdaudio_catchup(void)
+{
+	return true;
+}
+
+int setup_sound(void)
+{
+	sound_available = 1;
+	return 1;
+}
+
+static int open_sound(void)
+{
+  config_changed = 1;
+
+	have_sound = 1;
+	sound_available = 1;
+
+	if (currprefs.sound_stereo)
+		sample_handler = sample16s_handler;
+	else
+		sample_handler = sample16_handler;
+
+	restart_sound_buffer();
+	driveclick_init ();
+
+	return 1;
+}
+
+void close_sound(void)
+{
+  config_changed = 1;
+	have_sound = 0;
+}
+
+void pause_sound(void)
+{
+}
+
+void resume_sound(void)
+{
+}
+
+void reset_sound(void)
+{
+	if (!have_sound)
+		return;
+
+	restart_sound_buffer();
+
+	clear_sound_buffers();
+	clear_cdaudio_buffers();
+}
+
+int init_sound (void)
+{
+	if (!sound_available)
+		return 0;
+	if (currprefs.produce_sound <= 1)
+		return 0;
+	if (have_sound)
+		return 1;
+	if (!open_sound ())
+		return 0;
+	driveclick_reset ();
+	return 1;
+}
+
+void sound_volume(int dir)
+{
+  config_changed = 1;
+}
@@ -50,47 +50,93 @@ static int have_sound = 0;
 static float scaled_sample_evtime_orig;
 static float snd_adjust = 1.0f;
 
+/*
+ * Dynamic rate control: the ring fill level is kept at snd_fill_target by
+ * changing the resampling ratio by at most SND_RATE_MAX_DEVIATION. This
+ * absorbs the drift between host display and sound clocks without
+ * dropping blocks. The proportional part reacts to the error, the integral
+ * part takes over a constant drift, so the fill level settles on the
+ * target instead of staying off by drift / SND_RATE_KP.
+ */
+#define SND_RATE_MAX_DEVIATION 0.005f
+#define SND_RATE_KP (2.0f * SND_RATE_MAX_DEVIATION)
+#define SND_RATE_KI (SND_RATE_KP / 256.0f)
+#define SND_FILL_SMOOTH 0.05f
+static float snd_rate_ctrl = 1.0f;
+static float snd_rate_int = 0.0f;
+static float snd_fill_avg = 0.5f;
+static float snd_fill_target = 0.5f;
+
 void update_sound(double clk)
 {
 	double evtime;
   
 	evtime = clk * CYCLE_UNIT / (double)currprefs.sound_freq;
 	scaled_sample_evtime_orig = evtime;
-	scaled_sample_evtime = scaled_sample_evtime_orig * snd_adjust;
+	scaled_sample_evtime = scaled_sample_evtime_orig * snd_adjust * snd_rate_ctrl;
 }
 
 void sound_adjust(float factor)
 {
   snd_adjust = factor;
-  scaled_sample_evtime = scaled_sample_evtime_orig * snd_adjust;
+  scaled_sample_evtime = scaled_sample_evtime_orig * snd_adjust * snd_rate_ctrl;
 }
 
 
 static int s_oldrate = 0, s_oldbits = 0, s_oldstereo = 0;
 static int sound_thread_active = 0, sound_thread_exit = 0;
-static int rdcnt = 0;
-static int wrcnt = 0;
-static const int cnt_max_diff = 4;
 
+/*
+ * Lock-free single producer / single consumer ring between the emulation
+ * thread (finish_sound_buffer) and the SDL callback (sound_thread_mixer).
+ * Positions are free running counters in words. Each side only writes its
+ * own position and publishes it with release semantics, the other side
+ * reads it with acquire semantics.
+ */
+static uae_u16 *snd_ring = NULL;
+static uae_u32 snd_ring_size = 0;
+static uae_u32 snd_ring_wr = 0;
+static uae_u32 snd_ring_rd = 0;
+static int snd_block_len = SNDBUFFER_LEN;
+/* SDL device buffer in samples, and when SDL last took a buffer from us */
+static int snd_dev_samples = 0;
+static uae_u32 snd_dev_ticks = 0;
+static float snd_latency_avg = 0.0f;
+static uae_u32 snd_underruns = 0;
+static uae_u32 snd_overruns = 0;
+static int snd_stats_samples = 0;
+static int cdrdpos = 0;
+
+STATIC_INLINE uae_u32 ring_pos_load(uae_u32 *p)
+{
+  return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
 
-static void sound_copy_produced_block(void *ud, Uint8 *stream, int len)
+STATIC_INLINE void ring_pos_store(uae_u32 *p, uae_u32 v)
 {
-	if (currprefs.sound_stereo)
-	{
-		if (cdaudio_active && currprefs.sound_freq == 44100 && cdrdcnt < cdwrcnt)
-		{
-			for (int i = 0; i < SNDBUFFER_LEN * 2; ++i)
-				sndbuffer[rdcnt & (SOUND_BUFFERS_COUNT - 1)][i] += cdaudio_buffer[cdrdcnt & (CDAUDIO_BUFFERS - 1)][i];
-  		cdrdcnt++; 
-		}
-	}
+  __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
 
-	if (wrcnt - rdcnt >= 1) {
-	  memcpy(stream, sndbuffer[rdcnt & (SOUND_BUFFERS_COUNT - 1)], len);
-		rdcnt++;
-	} else {
-	  memset(stream, 0, len);
-	}
+
+static void mix_cdaudio(uae_u16 *out, int words)
+{
+  while (words > 0) {
+    if (cdrdcnt >= __atomic_load_n(&cdwrcnt, __ATOMIC_ACQUIRE))
+      break;
+    uae_u16 *src = cdaudio_buffer[cdrdcnt & (CDAUDIO_BUFFERS - 1)] + cdrdpos;
+    int l = CDAUDIO_BUFFER_LEN * 2 - cdrdpos;
+    if (l > words)
+      l = words;
+    for (int i = 0; i < l; ++i)
+      out[i] += src[i];
+    out += l;
+    words -= l;
+    cdrdpos += l;
+    if (cdrdpos == CDAUDIO_BUFFER_LEN * 2) {
+      cdrdpos = 0;
+      __atomic_store_n(&cdrdcnt, cdrdcnt + 1, __ATOMIC_RELEASE);
+    }
+  }
 }
 
 
@@ -100,30 +146,104 @@ static void sound_thread_mixer(void *ud, Uint8 *stream, int len)
 	  return;
 	sound_thread_active = 1;
 
-	int sample_size = currprefs.sound_stereo ? 4 : 2;
+  uae_u16 *out = (uae_u16 *)stream;
+  uae_u32 want = len / 2;
+  uae_u32 rd = snd_ring_rd;
+  uae_u32 avail = ring_pos_load(&snd_ring_wr) - rd;
+  uae_u32 n = avail < want ? avail : want;
+
+  __atomic_store_n(&snd_dev_ticks, SDL_GetTicks(), __ATOMIC_RELAXED);
+
+  if (n > 0) {
+    uae_u32 pos = rd & (snd_ring_size - 1);
+    uae_u32 first = snd_ring_size - pos;
+    if (first > n)
+      first = n;
+    memcpy(out, snd_ring + pos, first * 2);
+    memcpy(out + first, snd_ring, (n - first) * 2);
+    ring_pos_store(&snd_ring_rd, rd + n);
+  }
+  if (n < want) {
+    memset(out + n, 0, (want - n) * 2);
+    // Don't count the startup phase before the first samples arrived
+    if (rd != 0)
+      __atomic_add_fetch(&snd_underruns, 1, __ATOMIC_RELAXED);
+  }
 
-	while (len > 0) {
-		int l = len < SNDBUFFER_LEN * sample_size ? len : SNDBUFFER_LEN * sample_size;
-		sound_copy_produced_block(ud, stream, l);
-		stream += l;
-		len -= l;
-	}
+	if (currprefs.sound_stereo && cdaudio_active && currprefs.sound_freq == 44100)
+	  mix_cdaudio(out, want);
 }
 
 
+/*
+ * sound_max_buff is the latency budget in samples and sizes both buffers:
+ * the SDL device buffer gets a quarter of it, the ring is kept filled
+ * with half of it, and blocks of half a device buffer are added to the
+ * ring. A sample waits for the ring fill, the device buffer and on
+ * average half a block, 13/16 of the budget in total.
+ */
 static void init_soundbuffer_usage(void)
 {
+	int channels = currprefs.sound_stereo ? 2 : 1;
+	uae_u32 depth = currprefs.sound_maxbsiz;
+	if (currprefs.sound_maxbsiz < MIN_SOUND_MAXB)
+	  depth = MIN_SOUND_MAXB;
+	if (depth > MAX_SOUND_MAXB)
+	  depth = MAX_SOUND_MAXB;
+	uae_u32 size = MIN_SOUND_MAXB;
+	while (size < depth)
+	  size <<= 1;
+	snd_dev_samples = MIN_SOUND_MAXB / 4;
+	while (snd_dev_samples * 2 <= depth / 4 && snd_dev_samples < SOUND_CONSUMER_BUFFER_LENGTH)
+	  snd_dev_samples <<= 1;
+	snd_fill_target = (float)(depth / 2) / size;
+	size *= channels;
+	if (size != snd_ring_size) {
+	  xfree(snd_ring);
+	  snd_ring = xcalloc(uae_u16, size);
+	  snd_ring_size = size;
+	}
+	snd_block_len = snd_dev_samples / 2;
+	if (snd_block_len > SNDBUFFER_LEN)
+	  snd_block_len = SNDBUFFER_LEN;
+	snd_ring_wr = 0;
+	snd_ring_rd = 0;
+	snd_stats_samples = 0;
+	snd_fill_avg = snd_fill_target;
+	snd_rate_ctrl = 1.0f;
+	snd_rate_int = 0.0f;
+	snd_latency_avg = 0.0f;
+	scaled_sample_evtime = scaled_sample_evtime_orig * snd_adjust;
+
 	sndbufpt = sndbuffer[0];
 	render_sndbuff = sndbuffer[0];
-	finish_sndbuff = sndbuffer[0] + SNDBUFFER_LEN * 2;
-	rdcnt = 0;
-	wrcnt = 0;
+	finish_sndbuff = sndbuffer[0] + snd_block_len * channels;
   
 	cdbufpt = cdaudio_buffer[0];
 	render_cdbuff = cdaudio_buffer[0];
 	finish_cdbuff = cdaudio_buffer[0] + CDAUDIO_BUFFER_LEN * 2;
 	cdrdcnt = 0;
 	cdwrcnt = 0;
+	cdrdpos = 0;
+}
+
+
+static void sound_log_stats(bool force)
+{
+  static uae_u32 last_underruns = 0, last_overruns = 0;
+
+  uae_u32 underruns = __atomic_load_n(&snd_underruns, __ATOMIC_RELAXED);
+  if (force || underruns != last_underruns || snd_overruns != last_overruns) {
+    int channels = currprefs.sound_stereo ? 2 : 1;
+    int fill = snd_fill_avg * snd_ring_size / channels;
+    write_log("Sound: %d underruns, %d overruns, ring %d/%d samples, device %d samples, latency %d ms (planned %d ms), rate %.4f\n",
+      underruns, snd_overruns, fill, snd_ring_size / channels, snd_dev_samples,
+      (int)(snd_latency_avg * 1000 / currprefs.sound_freq),
+      (int)(snd_fill_target * snd_ring_size / channels + snd_dev_samples + snd_block_len / 2) * 1000 / currprefs.sound_freq,
+      snd_rate_ctrl);
+    last_underruns = underruns;
+    last_overruns = snd_overruns;
+  }
 }
 
 
@@ -133,8 +253,6 @@ static int start_sound(int rate, int bits, int stereo)
 	unsigned int bsize;
 
   if(SDL_GetAudioStatus() == SDL_AUDIO_STOPPED) {
-  	init_soundbuffer_usage();
-
     s_oldrate = 0;
     s_oldbits = 0;
     s_oldstereo = 0;
@@ -146,17 +264,23 @@ static int start_sound(int rate, int bits, int stereo)
 	if (rate == s_oldrate && s_oldbits == bits && s_oldstereo == stereo) 
 		return 0;
 
+	if (SDL_GetAudioStatus() != SDL_AUDIO_STOPPED)
+	  SDL_CloseAudio();
+	init_soundbuffer_usage();
+
 	SDL_AudioSpec as;
 	memset(&as, 0, sizeof(as));
   
 	as.freq = rate;
 	as.format = (bits == 8 ? AUDIO_S8 : AUDIO_S16);
 	as.channels = (stereo ? 2 : 1);
-	as.samples = SOUND_CONSUMER_BUFFER_LENGTH;
+	as.samples = snd_dev_samples;
 	as.callback = sound_thread_mixer;
 
 	if (SDL_OpenAudio(&as, NULL))
 		printf("Error when opening SDL audio !\n");
+	else
+	  snd_dev_samples = as.samples;
   
 	s_oldrate = rate; 
 	s_oldbits = bits; 
@@ -177,32 +301,71 @@ void stop_sound(void)
   	SDL_PauseAudio(1);
   	sound_thread_exit = 1;
   	SDL_CloseAudio();
+  	sound_log_stats(true);
   }
 }
 
 void finish_sound_buffer(void)
 {
+	int channels = currprefs.sound_stereo ? 2 : 1;
+
 	if (currprefs.turbo_emulation) {
-		sndbufpt = render_sndbuff = sndbuffer[wrcnt & (SOUND_BUFFERS_COUNT - 1)];
+		sndbufpt = render_sndbuff = sndbuffer[0];
 		return;
 	}
+
+	uae_u32 words = sndbufpt - render_sndbuff;
 #ifdef DRIVESOUND
-	driveclick_mix((uae_s16*)render_sndbuff, currprefs.sound_stereo ? SNDBUFFER_LEN * 2 : SNDBUFFER_LEN);
+	driveclick_mix((uae_s16*)render_sndbuff, words);
 #endif
 
-	wrcnt++;
-	sndbufpt = render_sndbuff = sndbuffer[wrcnt & (SOUND_BUFFERS_COUNT - 1)];
-
-	if (currprefs.sound_stereo)
-		finish_sndbuff = sndbufpt + SNDBUFFER_LEN * 2;
-	else
-		finish_sndbuff = sndbufpt + SNDBUFFER_LEN;
+	uae_u32 wr = snd_ring_wr;
+	if (snd_ring_size - (wr - ring_pos_load(&snd_ring_rd)) < words) {
+	  // Audiodriver has big delay, drop this block
+	  snd_overruns++;
+	} else {
+	  uae_u32 pos = wr & (snd_ring_size - 1);
+	  uae_u32 first = snd_ring_size - pos;
+	  if (first > words)
+	    first = words;
+	  memcpy(snd_ring + pos, render_sndbuff, first * 2);
+	  memcpy(snd_ring, render_sndbuff + first, (words - first) * 2);
+	  wr += words;
+	  ring_pos_store(&snd_ring_wr, wr);
+	}
 
-	if (wrcnt - rdcnt > cnt_max_diff)
-	{
-	  // Audiodriver has big delay, skip two buffers
-		rdcnt = wrcnt - (cnt_max_diff - 1);
-	} 
+	uae_u32 queued = wr - ring_pos_load(&snd_ring_rd);
+	float fill = (float)queued / snd_ring_size;
+	snd_fill_avg += (fill - snd_fill_avg) * SND_FILL_SMOOTH;
+	// More samples buffered than wanted -> longer time per sample -> produce less
+	float err = snd_fill_avg - snd_fill_target;
+	snd_rate_int += err * SND_RATE_KI;
+	if (snd_rate_int > SND_RATE_MAX_DEVIATION)
+	  snd_rate_int = SND_RATE_MAX_DEVIATION;
+	else if (snd_rate_int < -SND_RATE_MAX_DEVIATION)
+	  snd_rate_int = -SND_RATE_MAX_DEVIATION;
+	snd_rate_ctrl = 1.0f + err * SND_RATE_KP + snd_rate_int;
+	if (snd_rate_ctrl > 1.0f + SND_RATE_MAX_DEVIATION)
+	  snd_rate_ctrl = 1.0f + SND_RATE_MAX_DEVIATION;
+	else if (snd_rate_ctrl < 1.0f - SND_RATE_MAX_DEVIATION)
+	  snd_rate_ctrl = 1.0f - SND_RATE_MAX_DEVIATION;
+	scaled_sample_evtime = scaled_sample_evtime_orig * snd_adjust * snd_rate_ctrl;
+
+	// Latency of the sample just added: what is in the ring before it plus
+	// what is left of the buffer SDL is playing
+	int dev_left = snd_dev_samples - (int)((SDL_GetTicks() - __atomic_load_n(&snd_dev_ticks, __ATOMIC_RELAXED)) * currprefs.sound_freq / 1000);
+	if (dev_left < 0)
+	  dev_left = 0;
+	snd_latency_avg += ((float)queued / channels + dev_left - snd_latency_avg) * SND_FILL_SMOOTH;
+
+	sndbufpt = render_sndbuff = sndbuffer[0];
+	finish_sndbuff = sndbufpt + snd_block_len * channels;
+
+	snd_stats_samples += snd_block_len;
+	if (snd_stats_samples >= currprefs.sound_freq) {
+	  snd_stats_samples = 0;
+	  sound_log_stats(false);
+	}
 }
 
 void pause_sound_buffer(void)
@@ -212,11 +375,8 @@ void pause_sound_buffer(void)
 
 void restart_sound_buffer(void)
 {
-	sndbufpt = render_sndbuff = sndbuffer[wrcnt & (SOUND_BUFFERS_COUNT - 1)];
-	if (currprefs.sound_stereo)
-		finish_sndbuff = sndbufpt + SNDBUFFER_LEN * 2;
-	else
-		finish_sndbuff = sndbufpt + SNDBUFFER_LEN;
+	sndbufpt = render_sndbuff = sndbuffer[0];
+	finish_sndbuff = sndbufpt + snd_block_len * (currprefs.sound_stereo ? 2 : 1);
 
 	cdbufpt = render_cdbuff = cdaudio_buffer[cdwrcnt & (CDAUDIO_BUFFERS - 1)];
 	finish_cdbuff = cdbufpt + CDAUDIO_BUFFER_LEN * 2;
@@ -224,7 +384,7 @@ void restart_sound_buffer(void)
 
 void finish_cdaudio_buffer(void)
 {
-	cdwrcnt++;
+	__atomic_store_n(&cdwrcnt, cdwrcnt + 1, __ATOMIC_RELEASE);
 	cdbufpt = render_cdbuff = cdaudio_buffer[cdwrcnt & (CDAUDIO_BUFFERS - 1)];
 	finish_cdbuff = cdbufpt + CDAUDIO_BUFFER_LEN * 2;
 	audio_activate();
@@ -233,7 +393,7 @@ void finish_cdaudio_buffer(void)
 
 bool cdaudio_catchup(void)
 {
-	while ((cdwrcnt > cdrdcnt + CDAUDIO_BUFFERS - 10) && (sound_thread_active != 0) && (quit_program == 0)) {
+	while ((cdwrcnt > __atomic_load_n(&cdrdcnt, __ATOMIC_ACQUIRE) + CDAUDIO_BUFFERS - 10) && (sound_thread_active != 0) && (quit_program == 0)) {
 		sleep_millis(10);
 	}
 	return (sound_thread_active != 0);
@@ -294,10 +454,13 @@ void reset_sound(void)
 	if (!have_sound)
 		return;
 
+	// Callback must not run while both ring positions are reset
+	SDL_LockAudio();
 	init_soundbuffer_usage();
 
 	clear_sound_buffers();
 	clear_cdaudio_buffers();
+	SDL_UnlockAudio();
 }
 
 int init_sound (void)
@@ -23,6 +23,7 @@ STATIC_INLINE int uae_sem_init(uae_sem_t *sem, int dummy, int init)
 #define uae_sem_post(PSEM) SDL_SemPost (*PSEM)
 #define uae_sem_wait(PSEM) SDL_SemWait (*PSEM)
 #define uae_sem_trywait(PSEM) SDL_SemTryWait (*PSEM)
+#define uae_sem_trywait_delay(PSEM, ms) SDL_SemWaitTimeout (*PSEM, ms)
 #define uae_sem_getvalue(PSEM) SDL_SemValue (*PSEM)
 
 #include "commpipe.h"
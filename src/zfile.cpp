@@ -602,6 +602,66 @@ struct zfile *zfile_gunzip (struct zfile *z)
 	return zfile_gunzip (z, NULL);
 }
 
+/* zlib-compress size bytes of src, handing the output to write () 64k at
+ * a time. Returns the number of bytes written or -1. No zfile is involved,
+ * so any thread can use it. */
+int zfile_zcompress (zfile_zwrite_func write, void *ud, const uae_u8 *src, int size, int level)
+{
+  z_stream zs;
+  uae_u8 outbuf[65536];
+  int ret, written = 0;
+
+  memset (&zs, 0, sizeof (zs));
+  if (deflateInit (&zs, level) != Z_OK)
+  	return -1;
+  zs.next_in = (Bytef*)src;
+  zs.avail_in = size;
+  do {
+  	zs.next_out = outbuf;
+  	zs.avail_out = sizeof (outbuf);
+  	ret = deflate (&zs, Z_FINISH);
+  	if (ret == Z_STREAM_ERROR)
+	    break;
+  	int len = sizeof (outbuf) - zs.avail_out;
+  	if (write (ud, outbuf, len) != len) {
+	    ret = Z_STREAM_ERROR;
+	    break;
+  	}
+  	written += len;
+  } while (ret != Z_STREAM_END);
+  deflateEnd (&zs);
+  return ret == Z_STREAM_END ? written : -1;
+}
+
+/* Inflate srcsize bytes read from src into dst, 64k at a time.
+ * Returns the number of bytes decompressed or -1. */
+int zfile_zuncompress (uae_u8 *dst, int dstsize, struct zfile *src, int srcsize)
+{
+  z_stream zs;
+  uae_u8 inbuf[65536];
+  int ret = Z_OK;
+
+  memset (&zs, 0, sizeof (zs));
+  if (inflateInit (&zs) != Z_OK)
+  	return -1;
+  zs.next_out = dst;
+  zs.avail_out = dstsize;
+  while (ret == Z_OK && srcsize > 0) {
+  	int len = srcsize > (int)sizeof (inbuf) ? (int)sizeof (inbuf) : srcsize;
+  	len = zfile_fread (inbuf, 1, len, src);
+  	if (len <= 0)
+	    break;
+  	srcsize -= len;
+  	zs.next_in = inbuf;
+  	zs.avail_in = len;
+  	ret = inflate (&zs, Z_NO_FLUSH);
+  }
+  inflateEnd (&zs);
+  if (ret != Z_STREAM_END)
+  	return -1;
+  return dstsize - zs.avail_out;
+}
+
 static void truncate880k (struct zfile *z)
 {
 	int i;
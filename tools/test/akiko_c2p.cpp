@@ -0,0 +1,107 @@
+/*
+ * Check and benchmark for the Akiko chunky-to-planar conversion.
+ *
+ * The Makefile copies akiko_c2p_do () out of src/akiko.cpp. It is compared
+ * with the table driven loop it replaced on random buffers, then both are
+ * timed. Timings of the NEON build only mean something on an ARM host,
+ * elsewhere it runs the lane by lane model from neon.h.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#ifdef USE_ARMNEON
+#include "neon.h"
+#endif
+
+typedef uint32_t uae_u32;
+typedef uint64_t uae_u64;
+
+#define STATIC_INLINE static inline
+
+static uae_u32 akiko_buffer[8];
+static uae_u32 akiko_result[8];
+
+#include "akiko_c2p.inc"
+
+/* the old code: optimised Chunky-to-Planar algorithm by Mequa */
+static uae_u32 akiko_precalc_shift[32];
+static uae_u32 akiko_precalc_bytenum[32][8];
+static uae_u32 old_result[8];
+
+static void akiko_precalculate (void)
+{
+	for (uae_u32 i = 0; i < 32; i++) {
+		akiko_precalc_shift[i] = 1 << i;
+		for (uae_u32 j = 0; j < 8; j++)
+			akiko_precalc_bytenum[i][j] = (i >> 3) + ((7 - j) << 2);
+	}
+}
+
+static void akiko_c2p_old (void)
+{
+	for (int i = 0; i < 8; i++) {
+		uae_u32 r = 0;
+		for (int b = i; b < 32; b += 8) {
+			for (int j = 0; j < 8; j++)
+				r |= ((akiko_buffer[j] & akiko_precalc_shift[b]) != 0) << akiko_precalc_bytenum[b][j];
+		}
+		old_result[i] = r;
+	}
+}
+
+static uae_u32 rnd (void)
+{
+	static uint64_t s = 0x2545f4914f6cdd1dULL;
+	s ^= s << 13;
+	s ^= s >> 7;
+	s ^= s << 17;
+	return (uae_u32)s;
+}
+
+#define CHECKS 1000000
+#define RUNS 5000000
+
+int main (void)
+{
+	uae_u32 sum = 0;
+	clock_t start;
+	double told, tnew;
+
+	akiko_precalculate ();
+	for (int n = 0; n < CHECKS; n++) {
+		for (int j = 0; j < 8; j++)
+			akiko_buffer[j] = n < 256 ? (n & (1 << j) ? ~0U : 0) : rnd ();
+		akiko_c2p_old ();
+		akiko_c2p_do ();
+		for (int i = 0; i < 8; i++) {
+			if (old_result[i] != akiko_result[i]) {
+				printf ("MISMATCH buffer %08x %08x %08x %08x %08x %08x %08x %08x, plane %d %08x != %08x\n",
+					akiko_buffer[0], akiko_buffer[1], akiko_buffer[2], akiko_buffer[3],
+					akiko_buffer[4], akiko_buffer[5], akiko_buffer[6], akiko_buffer[7],
+					i, akiko_result[i], old_result[i]);
+				return 1;
+			}
+		}
+	}
+
+	start = clock ();
+	for (int n = 0; n < RUNS; n++) {
+		akiko_buffer[n & 7] += n;
+		akiko_c2p_old ();
+		sum += old_result[n & 7];
+	}
+	told = (double)(clock () - start) / CLOCKS_PER_SEC;
+	start = clock ();
+	for (int n = 0; n < RUNS; n++) {
+		akiko_buffer[n & 7] += n;
+		akiko_c2p_do ();
+		sum += akiko_result[n & 7];
+	}
+	tnew = (double)(clock () - start) / CLOCKS_PER_SEC;
+
+	printf ("akiko c2p: %d buffers identical; %d conversions old %.3f s, new %.3f s (%.1fx) [%08x]\n",
+		CHECKS, RUNS, told, tnew, tnew > 0 ? told / tnew : 0, sum);
+	return 0;
+}
@@ -0,0 +1,237 @@
+/*
+ * Differential test for the row blitter in src/blitter.cpp.
+ *
+ * The Makefile copies blitter_dofast(), blitter_dofast_desc() and the row
+ * helpers out of blitter.cpp and puts a use_rows switch in front of the
+ * blit_row_ok() test. Every blit is run twice from the same memory, once
+ * through the old word at a time loop and once through the rows, and the
+ * memory, blitter state, fill carry and pointers must come out the same.
+ *
+ * All 256 minterms are run ascending and descending, without fill, with
+ * inclusive and exclusive fill, and with both fill carry inputs. There
+ * are no generated fast paths here, so every minterm reaches the generic
+ * code.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef USE_ARMNEON
+#include "neon.h"
+#endif
+
+typedef uint8_t uae_u8;
+typedef uint16_t uae_u16;
+typedef uint32_t uae_u32;
+typedef int64_t uae_s64;
+typedef uint32_t uaecptr;
+
+#define STATIC_INLINE static inline
+#define BLITTER_MAX_WORDS 2048
+
+struct bltinfo {
+	int blitzero;
+	int blitashift, blitbshift, blitdownashift, blitdownbshift;
+	uae_u16 bltadat, bltbdat, bltcdat, bltddat;
+	uae_u16 bltaold, bltahold, bltbold, bltbhold, bltafwm, bltalwm;
+	int vblitsize, hblitsize;
+	int bltamod, bltbmod, bltcmod, bltdmod;
+	int got_cycle;
+	int nasty_cnt, wait_nasty;
+	int blitter_nasty, blit_interrupt;
+	int blitter_dangerous_bpl;
+	int blit_main, blit_finald, blit_pending;
+};
+
+static struct bltinfo blt_info;
+static uae_u16 bltcon0, bltcon1;
+static uae_u32 bltapt, bltbpt, bltcpt, bltdpt;
+static int blitfc, blitfill, blitife;
+static uae_u32 blit_masktable[BLITTER_MAX_WORDS];
+static uae_u8 blit_filltable[256][4][2];
+
+#define MEMSIZE 65536
+#define MEMSLACK 8192
+static struct { uae_u8 *baseaddr; } chipmem_bank;
+static uae_u32 chipmem_full_mask = MEMSIZE - 1;
+
+static inline uae_u16 do_get_mem_word (uae_u16 *p)
+{
+	uae_u8 *b = (uae_u8*)p;
+	return (b[0] << 8) | b[1];
+}
+
+static inline void do_put_mem_word (uae_u16 *p, uae_u16 v)
+{
+	uae_u8 *b = (uae_u8*)p;
+	b[0] = v >> 8;
+	b[1] = (uae_u8)v;
+}
+
+static inline void chipmem_wput_indirect (uaecptr addr, uae_u32 w)
+{
+	addr &= chipmem_full_mask;
+	do_put_mem_word ((uae_u16*)(chipmem_bank.baseaddr + addr), w);
+}
+
+typedef void blitter_func (uae_u8*, uae_u8*, uae_u8*, uaecptr, struct bltinfo*);
+static blitter_func *blitfunc_dofast[256], *blitfunc_dofast_desc[256];
+static int use_rows;
+
+#include "blit.h"
+#include "blitter_rows.inc"
+
+/* same table as build_blitfilltable() in blitter.cpp */
+static void build_filltable (void)
+{
+	for (int i = 0; i < BLITTER_MAX_WORDS; i++)
+		blit_masktable[i] = 0xffff;
+	for (unsigned int d = 0; d < 256; d++) {
+		for (int i = 0; i < 4; i++) {
+			int fc = i & 1;
+			uae_u8 data = d;
+			for (unsigned int fillmask = 1; fillmask != 0x100; fillmask <<= 1) {
+				uae_u16 tmp = data;
+				if (fc) {
+					if (i & 2)
+						data |= fillmask;
+					else
+						data ^= fillmask;
+				}
+				if (tmp & fillmask)
+					fc = !fc;
+			}
+			blit_filltable[d][i][0] = data;
+			blit_filltable[d][i][1] = fc;
+		}
+	}
+}
+
+static unsigned int rnd (void)
+{
+	static uint64_t s = 88172645463325252ULL;
+	s ^= s << 13;
+	s ^= s >> 7;
+	s ^= s << 17;
+	return (unsigned int)s;
+}
+
+static int rndmod (void)
+{
+	return ((int)(rnd () % 81) - 40) & ~1;
+}
+
+static uae_u8 memstart[MEMSIZE + MEMSLACK];
+static uae_u8 memout[2][MEMSIZE + MEMSLACK];
+
+#define TRIALS 40
+
+int main (void)
+{
+	static const uae_u16 fillmodes[] = { 0, 0x08, 0x10 };
+	long tests = 0, rows = 0;
+
+	build_filltable ();
+	for (int i = 0; i < MEMSIZE + MEMSLACK; i++)
+		memstart[i] = rnd ();
+	for (int mt = 0; mt < 256; mt++) {
+		for (int desc = 0; desc < 2; desc++) {
+			for (int fill = 0; fill < 3; fill++) {
+				for (int fci = 0; fci < 2; fci++) {
+					for (int trial = 0; trial < TRIALS; trial++) {
+						struct bltinfo bi, out[2];
+						uae_u32 ptrs[2][4];
+						int fcout[2];
+
+						memset (&bi, 0, sizeof bi);
+						bi.hblitsize = 1 + rnd () % (rnd () % 4 == 0 ? 100 : 20);
+						bi.vblitsize = 1 + rnd () % 6;
+						bi.bltamod = rndmod ();
+						bi.bltbmod = rndmod ();
+						bi.bltcmod = rndmod ();
+						bi.bltdmod = rnd () % 3 == 0 ? bi.bltcmod : rndmod ();
+						if (rnd () % 2) {
+							bi.bltamod = abs (bi.bltamod);
+							bi.bltcmod = abs (bi.bltcmod);
+							bi.bltdmod = abs (bi.bltdmod);
+						}
+						bi.blitashift = rnd () % 16;
+						bi.blitbshift = rnd () % 16;
+						bi.blitdownashift = rnd () % 17;
+						bi.blitdownbshift = rnd () % 17;
+						bi.bltadat = rnd ();
+						bi.bltbdat = rnd ();
+						bi.bltcdat = rnd ();
+						bi.bltddat = rnd ();
+						bi.bltaold = rnd ();
+						bi.bltbold = rnd ();
+						bi.bltbhold = rnd ();
+						bi.bltafwm = rnd ();
+						bi.bltalwm = rnd ();
+						bi.blitzero = 1;
+
+						/* random channel enables, so D with and without sources */
+						uae_u16 con0 = (rnd () & 0xf00) | mt;
+						uae_u16 con1 = fillmodes[fill] | (fci ? 4 : 0) | (desc ? 2 : 0);
+						uae_u32 base = 16384 + ((rnd () % 16384) & ~1);
+						/* fresh data around the blit, it stays within 2 KB of base */
+						for (uae_u32 i = base - 4096; i < base + 4096; i++)
+							memstart[i] = rnd ();
+						uae_u32 pa = base + (((int)(rnd () % 257) - 128) & ~1);
+						uae_u32 pb = base + (((int)(rnd () % 257) - 128) & ~1);
+						uae_u32 pc = base + (((int)(rnd () % 257) - 128) & ~1);
+						uae_u32 pd = rnd () % 3 == 0 ? pc : base + (((int)(rnd () % 257) - 128) & ~1);
+
+						for (int r = 0; r < 2; r++) {
+							memcpy (memout[r], memstart, sizeof memstart);
+							chipmem_bank.baseaddr = memout[r];
+							blt_info = bi;
+							bltcon0 = con0;
+							bltcon1 = con1;
+							blitfill = (con1 & 0x18) != 0;
+							blitife = (con1 & 0x08) != 0;
+							bltapt = pa;
+							bltbpt = pb;
+							bltcpt = pc;
+							bltdpt = pd;
+							blitfc = 0;
+							for (int i = 0; i < BLITTER_MAX_WORDS; i++)
+								blit_masktable[i] = 0xffff;
+							use_rows = r;
+							if (desc)
+								blitter_dofast_desc ();
+							else
+								blitter_dofast ();
+							out[r] = blt_info;
+							fcout[r] = blitfc;
+							ptrs[r][0] = bltapt;
+							ptrs[r][1] = bltbpt;
+							ptrs[r][2] = bltcpt;
+							ptrs[r][3] = bltdpt;
+						}
+						tests++;
+						if (memcmp (memout[0], memout[1], sizeof memout[0]) || memcmp (&out[0], &out[1], sizeof out[0])
+							|| fcout[0] != fcout[1] || memcmp (ptrs[0], ptrs[1], sizeof ptrs[0])) {
+							printf ("MISMATCH minterm %02x bltcon0 %04x bltcon1 %04x size %dx%d mod %d/%d/%d/%d\n",
+								mt, con0, con1, bi.hblitsize, bi.vblitsize, bi.bltamod, bi.bltbmod, bi.bltcmod, bi.bltdmod);
+							printf ("  memory %s, state %s, fill carry %s, pointers %s\n",
+								memcmp (memout[0], memout[1], sizeof memout[0]) ? "differs" : "same",
+								memcmp (&out[0], &out[1], sizeof out[0]) ? "differs" : "same",
+								fcout[0] != fcout[1] ? "differs" : "same",
+								memcmp (ptrs[0], ptrs[1], sizeof ptrs[0]) ? "differ" : "same");
+							return 1;
+						}
+						chipmem_bank.baseaddr = memstart;
+						if ((con0 & 0x100) && blit_row_ok ((con0 & 0x800) ? memstart + pa : 0, (con0 & 0x400) ? memstart + pb : 0,
+							(con0 & 0x200) ? memstart + pc : 0, pd, desc))
+							rows++;
+					}
+				}
+			}
+		}
+	}
+	printf ("blitter rows: %ld blits identical, %ld of them took the row path\n", tests, rows);
+	return 0;
+}
@@ -0,0 +1,241 @@
+/*
+ * Check and benchmark for do_cycles_fast () in src/include/events.h.
+ *
+ * The Makefile copies the event code out of events.cpp and
+ * do_cycles_fast () out of events.h. An interpreter like loop runs the
+ * same instruction lengths twice for both schedulers, do_cycles_cpu_norm
+ * and do_cycles_cpu_fastest: once calling through do_cycles as before,
+ * once through do_cycles_fast (). currcycle, nextevent and regs.pissoff
+ * after every instruction and every event handler call are hashed, and
+ * both ways must come out the same. The fastest scheduler also gets sync
+ * lines, so the regs.pissoff countdown of event_check_vsync () is used.
+ *
+ * Then the loops run again without the hashing and are timed in millions
+ * of instructions per second. Only the cycle accounting is measured,
+ * there is no instruction work.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+typedef uint32_t uae_u32;
+typedef int32_t uae_s32;
+typedef int frame_time_t;
+
+#define _T(x) x
+#define CYCLE_UNIT 512
+#define STATIC_INLINE static inline
+#define write_log printf
+
+typedef uae_u32 evt;
+typedef void (*evfunc)(void);
+typedef void (*evfunc2)(uae_u32);
+typedef void (*do_cycles_func)(uae_u32);
+
+struct ev
+{
+	bool active;
+	evt evtime, oldcycles;
+	evfunc handler;
+};
+
+struct ev2
+{
+	bool active;
+	evt evtime;
+	uae_u32 data;
+	evfunc2 handler;
+};
+
+enum {
+	ev_copper,
+	ev_cia, ev_audio, ev_misc, ev_hsync,
+	ev_max
+};
+
+enum {
+	ev2_blitter, ev2_disk, ev2_misc,
+	ev2_max = 12
+};
+
+static struct ev eventtab[ev_max];
+static struct ev2 eventtab2[ev2_max];
+
+static struct { uae_s32 pissoff; } regs;
+static int pissoff_value, speedup_timelimit;
+
+/* host time advances by one per look at the clock */
+static frame_time_t host_time;
+
+static frame_time_t read_processor_time (void)
+{
+	return ++host_time;
+}
+
+/* defined in events.inc */
+extern uae_u32 currcycle, nextevent;
+extern int is_syncline;
+extern frame_time_t vsyncmintime;
+extern int vsynctimebase;
+
+static inline uae_u32 get_cycles (void)
+{
+	return currcycle;
+}
+
+static inline void cycles_do_special (void)
+{
+	regs.pissoff = 0;
+}
+
+static bool use_skip = true;
+static int ev2_next;
+
+#include "events.inc"
+#include "do_cycles.inc"
+
+static uint32_t rnd_state;
+
+static uint32_t rnd (void)
+{
+	rnd_state ^= rnd_state << 13;
+	rnd_state ^= rnd_state >> 17;
+	rnd_state ^= rnd_state << 5;
+	return rnd_state;
+}
+
+static uint64_t hash;
+
+static void note (uae_u32 v)
+{
+	hash = (hash ^ v) * 0x100000001b3ULL;
+}
+
+static void note_state (void)
+{
+	note (currcycle);
+	note (nextevent);
+	note (regs.pissoff);
+}
+
+#define HSYNC_CYCLES (227 * CYCLE_UNIT)
+
+static int lines;
+
+static void ev2_chain (uae_u32 v)
+{
+	note_state ();
+	note (v);
+	if (v & 3)
+		event2_newevent_xx (-1, (1 + rnd () % 300) * CYCLE_UNIT, v - 1, ev2_chain);
+}
+
+static void hsync_handler (void)
+{
+	note_state ();
+	lines++;
+	eventtab[ev_hsync].evtime = get_cycles () + HSYNC_CYCLES;
+	eventtab[ev_hsync].oldcycles = get_cycles ();
+	if (rnd () & 1)
+		event2_newevent_xx (-1, (1 + rnd () % 600) * CYCLE_UNIT, rnd (), ev2_chain);
+	/* a sync point every frame, the CPU may run on for a while */
+	if (lines % 313 == 0) {
+		is_syncline = 1;
+		vsyncmintime = host_time + 1000;
+	}
+	events_schedule ();
+}
+
+static void copper_handler (void)
+{
+	note_state ();
+	eventtab[ev_copper].evtime = get_cycles () + (2 + rnd () % 100) * CYCLE_UNIT;
+	events_schedule ();
+}
+
+#define INSNS 20000000
+
+static void setup (do_cycles_func f)
+{
+	do_cycles = f;
+	ev2_next = ev2_misc;
+	rnd_state = 0x2545f491;
+	hash = 0xcbf29ce484222325ULL;
+	host_time = 0;
+	lines = 0;
+	currcycle = 0;
+	is_syncline = 0;
+	vsyncmintime = 0;
+	vsynctimebase = 1 << 30;
+	speedup_timelimit = 0;
+	pissoff_value = 64 * CYCLE_UNIT;
+	regs.pissoff = 0;
+	for (int i = 0; i < ev_max; i++)
+		eventtab[i].active = false;
+	for (int i = 0; i < ev2_max; i++)
+		eventtab2[i].active = false;
+	eventtab[ev_misc].handler = MISC_handler;
+	eventtab[ev_hsync].handler = hsync_handler;
+	eventtab[ev_hsync].active = true;
+	eventtab[ev_hsync].evtime = HSYNC_CYCLES;
+	eventtab[ev_copper].handler = copper_handler;
+	eventtab[ev_copper].active = true;
+	eventtab[ev_copper].evtime = 10 * CYCLE_UNIT;
+	events_schedule ();
+}
+
+/* 68000 instructions take 4 to 40 cycles */
+static uae_u32 insn_cycles (void)
+{
+	return (4 + 2 * (rnd () % 19)) * CYCLE_UNIT / 2;
+}
+
+static double run (do_cycles_func f, bool fast, bool trace)
+{
+	clock_t start;
+
+	setup (f);
+	start = clock ();
+	for (int n = 0; n < INSNS; n++) {
+		uae_u32 c = insn_cycles ();
+		if (fast)
+			do_cycles_fast (c);
+		else
+			do_cycles (c);
+		if (trace)
+			note_state ();
+	}
+	return (double)(clock () - start) / CLOCKS_PER_SEC;
+}
+
+static bool check (const char *name, do_cycles_func f)
+{
+	double tcall, tfast;
+	uint64_t hcall;
+	int lcall;
+
+	run (f, false, true);
+	hcall = hash;
+	lcall = lines;
+	run (f, true, true);
+	if (hash != hcall || lines != lcall) {
+		printf ("MISMATCH %s: do_cycles %d lines [%016llx], do_cycles_fast %d lines [%016llx]\n",
+			name, lcall, (unsigned long long)hcall, lines, (unsigned long long)hash);
+		return false;
+	}
+	tcall = run (f, false, false);
+	tfast = run (f, true, false);
+	printf ("do_cycles %s: %d instructions, %d lines, state identical; call %.1f MIPS, fast %.1f MIPS\n",
+		name, INSNS, lines, tcall > 0 ? INSNS / tcall / 1e6 : 0, tfast > 0 ? INSNS / tfast / 1e6 : 0);
+	return true;
+}
+
+int main (void)
+{
+	if (!check ("norm", do_cycles_cpu_norm))
+		return 1;
+	if (!check ("fastest", do_cycles_cpu_fastest))
+		return 1;
+	return 0;
+}
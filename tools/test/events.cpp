@@ -0,0 +1,200 @@
+/*
+ * Differential test and benchmark for ev2 scheduling in src/events.cpp.
+ *
+ * The Makefile copies the event code out of events.cpp and puts a
+ * use_skip switch in front of the early out in event2_newevent_xx (), so
+ * the same code runs with the old full MISC_handler () rescan for every
+ * new ev2 event and with the new path. The slot search start of
+ * event2_newevent_xx () is moved out of the function so both runs begin
+ * from the same state.
+ *
+ * The load is modelled on custom.cpp: an hsync event queues a few ev2
+ * events every line, a blitter and a disk event reschedule themselves
+ * on their fixed slots, some ev2 handlers queue further events, and the
+ * CPU loop runs do_cycles_cpu_norm () with instruction sized steps. Every
+ * handler call is hashed with its cycle, and both runs must produce the
+ * same calls in the same order.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+typedef uint32_t uae_u32;
+typedef int32_t uae_s32;
+typedef int frame_time_t;
+
+#define _T(x) x
+#define CYCLE_UNIT 512
+#define write_log printf
+
+typedef uae_u32 evt;
+typedef void (*evfunc)(void);
+typedef void (*evfunc2)(uae_u32);
+typedef void (*do_cycles_func)(uae_u32);
+
+struct ev
+{
+	bool active;
+	evt evtime, oldcycles;
+	evfunc handler;
+};
+
+struct ev2
+{
+	bool active;
+	evt evtime;
+	uae_u32 data;
+	evfunc2 handler;
+};
+
+enum {
+	ev_copper,
+	ev_cia, ev_audio, ev_misc, ev_hsync,
+	ev_max
+};
+
+enum {
+	ev2_blitter, ev2_disk, ev2_misc,
+	ev2_max = 12
+};
+
+static struct ev eventtab[ev_max];
+static struct ev2 eventtab2[ev2_max];
+
+static struct { uae_s32 pissoff; } regs;
+static int pissoff_value = 0, speedup_timelimit = 0;
+
+static frame_time_t read_processor_time (void)
+{
+	return 0;
+}
+
+/* defined in events.inc */
+extern uae_u32 currcycle;
+
+static inline uae_u32 get_cycles (void)
+{
+	return currcycle;
+}
+
+static inline void cycles_do_special (void)
+{
+	regs.pissoff = 0;
+}
+
+static bool use_skip;
+static int ev2_next;
+
+#include "events.inc"
+
+static uint32_t rnd_state;
+
+static uint32_t rnd (void)
+{
+	rnd_state ^= rnd_state << 13;
+	rnd_state ^= rnd_state >> 17;
+	rnd_state ^= rnd_state << 5;
+	return rnd_state;
+}
+
+static uint64_t hash;
+static long calls;
+
+static void note (uae_u32 id, uae_u32 data)
+{
+	hash = (hash ^ ((uint64_t)currcycle << 32 | id << 24 | (data & 0xffffff))) * 0x100000001b3ULL;
+	calls++;
+}
+
+#define HSYNC_CYCLES (227 * CYCLE_UNIT)
+
+static void ev2_plain (uae_u32 v)
+{
+	note (1, v);
+	/* about one in four queues a follow up, like CIA or audio chains */
+	if ((rnd () & 3) == 0)
+		event2_newevent_xx (-1, (1 + rnd () % 400) * CYCLE_UNIT, v + 1, ev2_plain);
+}
+
+static void ev2_blit (uae_u32 v)
+{
+	note (2, v);
+	if (v > 0)
+		event2_newevent_xx (ev2_blitter, (4 + rnd () % 60) * CYCLE_UNIT, v - 1, ev2_blit);
+}
+
+static void ev2_dsk (uae_u32 v)
+{
+	note (3, v);
+	event2_newevent_xx (ev2_disk, (200 + rnd () % 800) * CYCLE_UNIT, v + 1, ev2_dsk);
+}
+
+static void hsync_handler (void)
+{
+	int n = rnd () % 4;
+
+	note (4, 0);
+	eventtab[ev_hsync].evtime = get_cycles () + HSYNC_CYCLES;
+	eventtab[ev_hsync].oldcycles = get_cycles ();
+	for (int i = 0; i < n; i++)
+		event2_newevent_xx (-1, (1 + rnd () % 600) * CYCLE_UNIT, rnd (), ev2_plain);
+	if (!eventtab2[ev2_blitter].active && (rnd () & 7) == 0)
+		event2_newevent_xx (ev2_blitter, (1 + rnd () % 100) * CYCLE_UNIT, rnd () % 40, ev2_blit);
+	events_schedule ();
+}
+
+#define LINES 200000
+
+static double run (bool skip)
+{
+	clock_t start;
+	long lines = 0;
+
+	use_skip = skip;
+	ev2_next = ev2_misc;
+	rnd_state = 0x2545f491;
+	hash = 0xcbf29ce484222325ULL;
+	calls = 0;
+	currcycle = 0;
+	for (int i = 0; i < ev_max; i++)
+		eventtab[i].active = false;
+	for (int i = 0; i < ev2_max; i++)
+		eventtab2[i].active = false;
+	eventtab[ev_misc].handler = MISC_handler;
+	eventtab[ev_hsync].handler = hsync_handler;
+	eventtab[ev_hsync].active = true;
+	eventtab[ev_hsync].evtime = HSYNC_CYCLES;
+	event2_newevent_xx (ev2_disk, 300 * CYCLE_UNIT, 0, ev2_dsk);
+	events_schedule ();
+
+	start = clock ();
+	while (lines < LINES) {
+		uae_u32 before = eventtab[ev_hsync].oldcycles;
+		/* 68000 instructions take 4 to 40 cycles */
+		do_cycles_cpu_norm ((4 + 2 * (rnd () % 19)) * CYCLE_UNIT / 2);
+		if (eventtab[ev_hsync].oldcycles != before)
+			lines++;
+	}
+	return (double)(clock () - start) / CLOCKS_PER_SEC;
+}
+
+int main (void)
+{
+	double told, tnew;
+	uint64_t hold;
+	long cold;
+
+	told = run (false);
+	hold = hash;
+	cold = calls;
+	tnew = run (true);
+	if (hash != hold || calls != cold) {
+		printf ("MISMATCH: old %ld calls [%016llx], new %ld calls [%016llx]\n",
+			cold, (unsigned long long)hold, calls, (unsigned long long)hash);
+		return 1;
+	}
+	printf ("events: %d lines, %ld handler calls identical; rescan every ev2 %.3f s, early out %.3f s (%.1fx)\n",
+		LINES, calls, told, tnew, tnew > 0 ? told / tnew : 0);
+	return 0;
+}
@@ -0,0 +1,118 @@
+/*
+ * NEON for the test programs. On ARM hosts the real intrinsics are used,
+ * elsewhere the few the emulator uses are modelled lane by lane, little
+ * endian like the ARM targets, so the NEON paths can be checked on any
+ * build machine.
+ */
+
+#ifndef TOOLS_TEST_NEON_H
+#define TOOLS_TEST_NEON_H
+
+#if defined(__ARM_NEON) || defined(__aarch64__)
+
+#include <arm_neon.h>
+
+#else
+
+#include <stdint.h>
+#include <string.h>
+
+/* blitter.cpp row blitter */
+struct uint16x8_t { uint16_t v[8]; };
+struct int16x8_t { int16_t v[8]; };
+
+static inline uint16x8_t vld1q_u16 (const uint16_t *p) { uint16x8_t r; for (int i = 0; i < 8; i++) r.v[i] = p[i]; return r; }
+static inline void vst1q_u16 (uint16_t *p, uint16x8_t a) { for (int i = 0; i < 8; i++) p[i] = a.v[i]; }
+static inline uint16x8_t vdupq_n_u16 (uint16_t x) { uint16x8_t r; for (int i = 0; i < 8; i++) r.v[i] = x; return r; }
+static inline int16x8_t vdupq_n_s16 (int16_t x) { int16x8_t r; for (int i = 0; i < 8; i++) r.v[i] = x; return r; }
+static inline uint16x8_t vorrq_u16 (uint16x8_t a, uint16x8_t b) { for (int i = 0; i < 8; i++) a.v[i] |= b.v[i]; return a; }
+static inline uint16x8_t veorq_u16 (uint16x8_t a, uint16x8_t b) { for (int i = 0; i < 8; i++) a.v[i] ^= b.v[i]; return a; }
+static inline uint16x8_t vbslq_u16 (uint16x8_t m, uint16x8_t a, uint16x8_t b)
+{
+	uint16x8_t r;
+	for (int i = 0; i < 8; i++)
+		r.v[i] = (a.v[i] & m.v[i]) | (b.v[i] & ~m.v[i]);
+	return r;
+}
+/* per lane shift by a signed count, negative shifts right */
+static inline uint16x8_t vshlq_u16 (uint16x8_t a, int16x8_t s)
+{
+	uint16x8_t r;
+	for (int i = 0; i < 8; i++) {
+		int k = (int8_t)s.v[i];
+		r.v[i] = k >= 16 || k <= -16 ? 0 : k >= 0 ? (uint16_t)(a.v[i] << k) : (uint16_t)(a.v[i] >> -k);
+	}
+	return r;
+}
+#define vshlq_n_u16(a, n) vshlq_u16 (a, vdupq_n_s16 (n))
+
+/* akiko.cpp C2P */
+struct uint64x2_t { uint64_t v[2]; };
+struct uint8x16_t { uint8_t v[16]; };
+struct uint8x8_t { uint8_t v[8]; };
+struct uint16x4_t { uint16_t v[4]; };
+struct uint8x8x2_t { uint8x8_t val[2]; };
+struct uint16x4x2_t { uint16x4_t val[2]; };
+
+static inline uint64x2_t vdupq_n_u64 (uint64_t a) { uint64x2_t r = { { a, a } }; return r; }
+static inline uint64_t vcreate_u64 (uint64_t a) { return a; }
+static inline uint64x2_t vcombine_u64 (uint64_t a, uint64_t b) { uint64x2_t r = { { a, b } }; return r; }
+static inline uint64x2_t vandq_u64 (uint64x2_t a, uint64x2_t b) { a.v[0] &= b.v[0]; a.v[1] &= b.v[1]; return a; }
+static inline uint64x2_t veorq_u64 (uint64x2_t a, uint64x2_t b) { a.v[0] ^= b.v[0]; a.v[1] ^= b.v[1]; return a; }
+static inline uint64x2_t vshrq_n_u64 (uint64x2_t a, int n) { a.v[0] >>= n; a.v[1] >>= n; return a; }
+static inline uint64x2_t vshlq_n_u64 (uint64x2_t a, int n) { a.v[0] <<= n; a.v[1] <<= n; return a; }
+static inline uint8x16_t vreinterpretq_u8_u64 (uint64x2_t a) { uint8x16_t r; memcpy (r.v, a.v, 16); return r; }
+static inline uint8x8_t vget_low_u8 (uint8x16_t a) { uint8x8_t r; memcpy (r.v, a.v, 8); return r; }
+static inline uint8x8_t vget_high_u8 (uint8x16_t a) { uint8x8_t r; memcpy (r.v, a.v + 8, 8); return r; }
+static inline uint16x4_t vreinterpret_u16_u8 (uint8x8_t a) { uint16x4_t r; memcpy (r.v, a.v, 8); return r; }
+static inline void vst1_u16 (uint16_t *p, uint16x4_t a) { memcpy (p, a.v, 8); }
+static inline uint8x8x2_t vzip_u8 (uint8x8_t a, uint8x8_t b)
+{
+	uint8x8x2_t r;
+	for (int i = 0; i < 8; i++) {
+		r.val[i >> 2].v[2 * (i & 3)] = a.v[i];
+		r.val[i >> 2].v[2 * (i & 3) + 1] = b.v[i];
+	}
+	return r;
+}
+static inline uint16x4x2_t vzip_u16 (uint16x4_t a, uint16x4_t b)
+{
+	uint16x4x2_t r;
+	for (int i = 0; i < 4; i++) {
+		r.val[i >> 1].v[2 * (i & 1)] = a.v[i];
+		r.val[i >> 1].v[2 * (i & 1) + 1] = b.v[i];
+	}
+	return r;
+}
+
+/* audio.cpp sinc BLEP */
+struct int32x4_t { int32_t v[4]; };
+struct uint32x4_t { uint32_t v[4]; };
+struct uint32x2_t { uint32_t v[2]; };
+
+static inline int32x4_t vld1q_s32 (const int32_t *p) { int32x4_t r; for (int i = 0; i < 4; i++) r.v[i] = p[i]; return r; }
+static inline void vst1q_s32 (int32_t *p, int32x4_t a) { for (int i = 0; i < 4; i++) p[i] = a.v[i]; }
+static inline int32x4_t vdupq_n_s32 (int32_t x) { int32x4_t r; for (int i = 0; i < 4; i++) r.v[i] = x; return r; }
+static inline uint32x4_t vdupq_n_u32 (uint32_t x) { uint32x4_t r; for (int i = 0; i < 4; i++) r.v[i] = x; return r; }
+static inline int32x4_t vsubq_s32 (int32x4_t a, int32x4_t b) { for (int i = 0; i < 4; i++) a.v[i] = (int32_t)((uint32_t)a.v[i] - (uint32_t)b.v[i]); return a; }
+static inline int32x4_t vmulq_s32 (int32x4_t a, int32x4_t b) { for (int i = 0; i < 4; i++) a.v[i] = (int32_t)((uint32_t)a.v[i] * (uint32_t)b.v[i]); return a; }
+static inline uint32x4_t vandq_u32 (uint32x4_t a, uint32x4_t b) { for (int i = 0; i < 4; i++) a.v[i] &= b.v[i]; return a; }
+static inline int32x4_t vandq_s32 (int32x4_t a, int32x4_t b) { for (int i = 0; i < 4; i++) a.v[i] &= b.v[i]; return a; }
+static inline uint32x4_t vcltq_s32 (int32x4_t a, int32x4_t b) { uint32x4_t r; for (int i = 0; i < 4; i++) r.v[i] = a.v[i] < b.v[i] ? ~0U : 0; return r; }
+static inline uint32x4_t vcgeq_s32 (int32x4_t a, int32x4_t b) { uint32x4_t r; for (int i = 0; i < 4; i++) r.v[i] = a.v[i] >= b.v[i] ? ~0U : 0; return r; }
+static inline uint32x2_t vget_low_u32 (uint32x4_t a) { uint32x2_t r = { { a.v[0], a.v[1] } }; return r; }
+static inline uint32x2_t vget_high_u32 (uint32x4_t a) { uint32x2_t r = { { a.v[2], a.v[3] } }; return r; }
+static inline uint32x2_t vorr_u32 (uint32x2_t a, uint32x2_t b) { a.v[0] |= b.v[0]; a.v[1] |= b.v[1]; return a; }
+#define vget_lane_u32(a, n) ((a).v[n])
+static inline int32x4_t vbslq_s32 (uint32x4_t m, int32x4_t a, int32x4_t b)
+{
+	int32x4_t r;
+	for (int i = 0; i < 4; i++)
+		r.v[i] = (a.v[i] & m.v[i]) | (b.v[i] & ~m.v[i]);
+	return r;
+}
+static inline int32x4_t vreinterpretq_s32_u32 (uint32x4_t a) { int32x4_t r; memcpy (r.v, a.v, 16); return r; }
+
+#endif
+
+#endif /* TOOLS_TEST_NEON_H */
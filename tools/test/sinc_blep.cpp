@@ -0,0 +1,143 @@
+/*
+ * Check and benchmark for the NEON sinc BLEP mixing in src/audio.cpp.
+ *
+ * The Makefile copies sinc_blep_neon () out of audio.cpp. Four channels
+ * run the same queue updates as sinc_prehandler_paula (), with random
+ * output changes and periods, and after every step the four NEON sums are
+ * compared with the scalar queue walk of samplexx_sinc_handler () for one
+ * of the five winsinc tables. Both are timed afterwards. Timings only mean
+ * something on an ARM host, elsewhere the lane by lane model from neon.h
+ * runs.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "neon.h"
+
+#define AUDIO_CHANNELS_PAULA 4
+#define SINC_QUEUE_MAX_AGE 2048
+#define SINC_QUEUE_LENGTH 256
+
+#include "sinctable.cpp"
+
+typedef struct {
+	int time, output;
+} sinc_queue_t;
+
+struct audio_channel_data2
+{
+	int sinc_output_state;
+	sinc_queue_t sinc_queue[SINC_QUEUE_LENGTH];
+	int sinc_queue_time;
+	int sinc_queue_head;
+};
+
+static struct audio_channel_data2 channels[AUDIO_CHANNELS_PAULA];
+static struct audio_channel_data2 *audio_data[AUDIO_CHANNELS_PAULA];
+
+#include "sinc_blep.inc"
+
+/* the scalar loop from samplexx_sinc_handler () */
+static void sinc_blep_scalar (int const *winsinc, int *sums)
+{
+	for (int i = 0; i < AUDIO_CHANNELS_PAULA; i++) {
+		struct audio_channel_data2 *acd = audio_data[i];
+		int sum = acd->sinc_output_state << 17;
+		int offsetpos = acd->sinc_queue_head & (SINC_QUEUE_LENGTH - 1);
+		for (int j = 0; j < SINC_QUEUE_LENGTH; j += 1) {
+			int age = acd->sinc_queue_time - acd->sinc_queue[offsetpos].time;
+			if (age >= SINC_QUEUE_MAX_AGE || age < 0)
+				break;
+			sum -= winsinc[age] * acd->sinc_queue[offsetpos].output;
+			offsetpos = (offsetpos + 1) & (SINC_QUEUE_LENGTH - 1);
+		}
+		sums[i] = sum;
+	}
+}
+
+static uint32_t rnd (void)
+{
+	static uint64_t s = 0x9e3779b97f4a7c15ULL;
+	s ^= s << 13;
+	s ^= s >> 7;
+	s ^= s << 17;
+	return (uint32_t)s;
+}
+
+/* one sinc_prehandler_paula () step, the sample changes on about a third
+ * of the steps, the period is 8 to 135 cycles */
+static void step (void)
+{
+	for (int i = 0; i < AUDIO_CHANNELS_PAULA; i++) {
+		struct audio_channel_data2 *acd = audio_data[i];
+		if (rnd () % 3 == 0) {
+			/* sample * volume, as in the emulator */
+			int output = ((int)(rnd () & 0xff) - 128) * (int)(rnd () % 65);
+			if (acd->sinc_output_state != output) {
+				acd->sinc_queue_head = (acd->sinc_queue_head - 1) & (SINC_QUEUE_LENGTH - 1);
+				acd->sinc_queue[acd->sinc_queue_head].time = acd->sinc_queue_time;
+				acd->sinc_queue[acd->sinc_queue_head].output = output - acd->sinc_output_state;
+				acd->sinc_output_state = output;
+			}
+		}
+		acd->sinc_queue_time += 8 + rnd () % 128;
+	}
+}
+
+#define CHECKS 2000000
+#define RUNS 2000000
+
+int main (void)
+{
+	int s1[AUDIO_CHANNELS_PAULA], s2[AUDIO_CHANNELS_PAULA];
+	int sum = 0;
+	long walked = 0;
+	clock_t start;
+	double told, tnew;
+
+	/* start from a queue of stale entries, like after a reset */
+	for (int i = 0; i < AUDIO_CHANNELS_PAULA; i++) {
+		audio_data[i] = &channels[i];
+		for (int j = 0; j < SINC_QUEUE_LENGTH; j++) {
+			channels[i].sinc_queue[j].time = rnd ();
+			channels[i].sinc_queue[j].output = rnd () % 16384 - 8192;
+		}
+	}
+
+	for (int n = 0; n < CHECKS; n++) {
+		int const *winsinc = winsinc_integral[n % 5];
+		step ();
+		sinc_blep_scalar (winsinc, s1);
+		sinc_blep_neon (winsinc, s2);
+		for (int i = 0; i < AUDIO_CHANNELS_PAULA; i++) {
+			if (s1[i] != s2[i]) {
+				printf ("MISMATCH step %d table %d channel %d: %d != %d\n", n, n % 5, i, s2[i], s1[i]);
+				return 1;
+			}
+			walked += channels[i].sinc_queue_time - channels[i].sinc_queue[channels[i].sinc_queue_head].time < SINC_QUEUE_MAX_AGE;
+		}
+	}
+
+	start = clock ();
+	for (int n = 0; n < RUNS; n++) {
+		if ((n & 15) == 0)
+			step ();
+		sinc_blep_scalar (winsinc_integral[n % 5], s1);
+		sum += s1[n & 3];
+	}
+	told = (double)(clock () - start) / CLOCKS_PER_SEC;
+	start = clock ();
+	for (int n = 0; n < RUNS; n++) {
+		if ((n & 15) == 0)
+			step ();
+		sinc_blep_neon (winsinc_integral[n % 5], s2);
+		sum += s2[n & 3];
+	}
+	tnew = (double)(clock () - start) / CLOCKS_PER_SEC;
+
+	printf ("sinc blep: %d x 4 channel sums identical (%ld with live entries); %d mixes scalar %.3f s, neon %.3f s (%.1fx) [%08x]\n",
+		CHECKS, walked, RUNS, told, tnew, tnew > 0 ? told / tnew : 0, sum);
+	return 0;
+}